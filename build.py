@@ -15,6 +15,8 @@ sys.path.append(f"{PYTHON_SCRIPT_PATH}/build_tools")
 from build_utils import *
 
 EXE_NAME = f"{APP_NAME}.exe" if is_windows() else f"{APP_NAME}.out"
+# cpu profile zones (TINY_PROFILE_SCOPE). When off they compile to nothing
+PROFILE_ZONES_ENABLED = True
 
 
 #-------------------------------------------------------------------
@@ -31,8 +33,9 @@ def get_compiler_args_clang():
     to_root = "."
     include_root_paths = ["", "external", "external/imgui", "src"]
     include_paths = include_paths_str(to_root, include_root_paths)
+    defines = "-DTINY_PROFILE_ENABLED" if PROFILE_ZONES_ENABLED else ""
     return clean_string(f"""
-        -g -O0 -std=c++17 {build_common_compiler_args()} {include_paths} {cpp_ver_arg()}
+        -g -O0 -std=c++17 {build_common_compiler_args()} {include_paths} {cpp_ver_arg()} {defines}
     """)
 
 
@@ -44,19 +47,34 @@ def get_linker_args_lld_link():
         {library_paths}
         /OUT:{BUILD_LIB_DIR}/{EXE_NAME}
         /DEBUG
-        glfw/lib/glfw3_mt.lib vulkan_lib/vulkan-1.lib
+        glfw/lib/glfw3_mt.lib vulkan_lib/vulkan-1.lib vulkan_lib/shaderc_shared.lib
         libcmt.lib user32.lib gdi32.lib shell32.lib
     """)
 
+def get_linker_args_linux():
+    # links against the system glfw, vulkan loader and shaderc (libglfw3-dev, libvulkan-dev, libshaderc-dev)
+    # for headless CI boxes a software ICD like lavapipe (mesa-vulkan-drivers) is enough to run
+    return clean_string(f"""
+        -o {BUILD_LIB_DIR}/{EXE_NAME}
+        -lglfw -lvulkan -lshaderc_shared -ldl -lpthread
+    """)
+
+def get_linker_args():
+    return get_linker_args_linux() if is_linux() else get_linker_args_lld_link()
+
 def get_game_sources():
     return get_files_with_ext_recursive_walk(SOURCE_DIR, "cpp")
 
 def build_game(standalone_ninjafile_dir = ""):
-    generic_ninja_build(PYTHON_SCRIPT_PATH, get_compiler_args_clang(), get_linker_args_lld_link(), BUILD_LIB_DIR, get_game_sources, EXE_NAME, BIN_DIR)
+    generic_ninja_build(PYTHON_SCRIPT_PATH, get_compiler_args_clang(), get_linker_args(), BUILD_LIB_DIR, get_game_sources, EXE_NAME, BIN_DIR)
    
 def run_game():
     if is_windows():
         command(f"\"{BIN_DIR}\\{EXE_NAME}\" {RESOURCE_DIRECTORY}")
+    elif is_linux():
+        # extra args are forwarded to the game, e.g. `python build.py run --headless --frames 100`
+        extra_args = " ".join([arg for arg in sys.argv[1:] if arg != "run"])
+        command(f"cd {BIN_DIR} && ./{EXE_NAME} {RESOURCE_DIRECTORY} {extra_args}")
 
 def main():
     args = sys.argv[1:]
@@ -66,7 +84,7 @@ def main():
             clean(BUILD_LIB_DIR)
             clean(BIN_DIR)
         elif "regen" in args:
-            generate_ninjafile(PYTHON_SCRIPT_PATH, get_compiler_args_clang(), get_linker_args_lld_link(), BUILD_LIB_DIR, get_game_sources, EXE_NAME, True)
+            generate_ninjafile(PYTHON_SCRIPT_PATH, get_compiler_args_clang(), get_linker_args(), BUILD_LIB_DIR, get_game_sources, EXE_NAME, True)
         elif "norun" in args:
             build_game(standalone_ninjafile_dir)
         elif "run" in args:
@@ -28,7 +28,8 @@ def get_compiler_driver():
     return "clang++"
 
 def get_linker_driver():
-    return "lld-link"
+    # on windows we link with lld-link directly (msvc style args), elsewhere let clang drive the system linker
+    return "lld-link" if is_windows() else "clang++"
 
 def build_dll_compiler_args():
     return "-DTEXPORT -D_USRDLL -D_WINDLL -D_DLL"
@@ -49,7 +50,7 @@ def is_macos():
 def get_ninja_command(ninjabuild_dir: str = ""):
     ninja_exe_dir = UTILS_PYTHON_SCRIPT_PATH
     if is_linux():
-        return f"chmod u+x {ninja_exe_dir}/ninja-linux && {ninja_exe_dir}ninja-linux -C {ninjabuild_dir}"
+        return f"chmod u+x {ninja_exe_dir}/ninja-linux && {ninja_exe_dir}/ninja-linux -C {ninjabuild_dir}"
     elif is_macos():
         return f"chmod 755 {ninja_exe_dir}/ninja-mac && {ninja_exe_dir}/ninja-mac -C {ninjabuild_dir}"
     elif is_windows():
@@ -58,7 +59,7 @@ def get_ninja_command(ninjabuild_dir: str = ""):
 def get_ninja_command_for_ninjafile(ninjabuild_file: str):
     ninja_exe_dir = UTILS_PYTHON_SCRIPT_PATH
     if is_linux():
-        return f"chmod u+x {ninja_exe_dir}/ninja-linux && {ninja_exe_dir}ninja-linux -f {ninjabuild_file}"
+        return f"chmod u+x {ninja_exe_dir}/ninja-linux && {ninja_exe_dir}/ninja-linux -f {ninjabuild_file}"
     elif is_macos():
         return f"chmod 755 {ninja_exe_dir}/ninja-mac && {ninja_exe_dir}/ninja-mac -f {ninjabuild_file}"
     elif is_windows():
@@ -0,0 +1,61 @@
+#include "bake_cache.h"
+#include "file_util.h"
+#include "tiny/tiny_log.h"
+
+#include <stdio.h>
+#include <string>
+#include <filesystem>
+
+constexpr u32 BAKE_CACHE_MAGIC = 0x454b4142; // "BAKE"
+// bump to throw away every cached bake (e.g. after changing the file layout)
+constexpr u32 BAKE_CACHE_VERSION = 1;
+
+struct BakeCacheHeader
+{
+    u32 magic;
+    u32 version;
+    u64 key;
+    u64 size;
+};
+
+static std::string bake_cache_path(const char* dir, const char* name, u64 key)
+{
+    char filename[128];
+    snprintf(filename, sizeof(filename), "%s_%016llx.bin", name, (unsigned long long)key);
+    return std::string(dir) + "/" + filename;
+}
+
+bool bake_cache_load(const char* dir, const char* name, u64 key, std::vector<u8>& data_out)
+{
+    std::string path = bake_cache_path(dir, name, key);
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    BakeCacheHeader header = {};
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+        header.magic == BAKE_CACHE_MAGIC && header.version == BAKE_CACHE_VERSION && header.key == key;
+    if (ok)
+    {
+        data_out.resize((size_t)header.size);
+        ok = fread(data_out.data(), 1, data_out.size(), file) == data_out.size();
+    }
+    fclose(file);
+    if (!ok)
+    {
+        LOG_WARN("Ignoring corrupt bake cache entry %s", path.c_str());
+        data_out.clear();
+    }
+    return ok;
+}
+
+void bake_cache_store(const char* dir, const char* name, u64 key, const void* data, size_t size)
+{
+    std::error_code error = {};
+    std::filesystem::create_directories(dir, error);
+    std::string path = bake_cache_path(dir, name, key);
+    BakeCacheHeader header = {BAKE_CACHE_MAGIC, BAKE_CACHE_VERSION, key, (u64)size};
+    FileChunk chunks[] = {{&header, sizeof(header)}, {data, size}};
+    write_file_atomic(path.c_str(), chunks, (u32)ARRAY_SIZE(chunks));
+}
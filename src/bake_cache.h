@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#include "defines.h"
+
+// on-disk cache for data baked at startup (noise volumes etc). An entry is keyed by a hash (hash_bytes in file_util.h) of everything
+// that went into the bake, so changing any parameter (or the bake version) just misses and rebakes.
+// Entries are written through a temp file + rename, a torn write is never picked up
+
+// name is just to tell entries apart on disk (<dir>/<name>_<key>.bin). False on a miss or a corrupt entry
+bool bake_cache_load(const char* dir, const char* name, u64 key, std::vector<u8>& data_out);
+void bake_cache_store(const char* dir, const char* name, u64 key, const void* data, size_t size);
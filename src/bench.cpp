@@ -0,0 +1,146 @@
+#include "bench.h"
+#include "vulkan_main.h"
+#include "tiny/tiny_log.h"
+#include "tiny/tiny_mem.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+BenchResults bench_init(u64 first_measured_frame, u32 num_frames)
+{
+    BenchResults results = {};
+    results.first_measured_frame = first_measured_frame;
+    results.num_frames = num_frames;
+    results.cpu_ms = (f64*)TSYSALLOC(sizeof(f64) * num_frames);
+    results.gpu_ms = (f64*)TSYSALLOC(sizeof(f64) * num_frames);
+    for (u32 i = 0; i < num_frames; i++)
+    {
+        results.cpu_ms[i] = -1.0;
+        results.gpu_ms[i] = -1.0;
+    }
+    return results;
+}
+
+void bench_free(BenchResults& results)
+{
+    TSYSFREE(results.cpu_ms);
+    TSYSFREE(results.gpu_ms);
+    results.num_frames = 0;
+}
+
+static bool bench_is_measured(const BenchResults* results, u64 frame_index)
+{
+    return results != nullptr &&
+        frame_index >= results->first_measured_frame &&
+        frame_index < results->first_measured_frame + results->num_frames;
+}
+
+void bench_record_cpu(BenchResults* results, u64 frame_index, f64 ms)
+{
+    if (!bench_is_measured(results, frame_index)) return;
+    results->cpu_ms[frame_index - results->first_measured_frame] = ms;
+}
+
+void bench_record_gpu(BenchResults* results, u64 frame_index, f64 ms)
+{
+    if (!bench_is_measured(results, frame_index)) return;
+    results->gpu_ms[frame_index - results->first_measured_frame] = ms;
+}
+
+void bench_pin_frame_state(CloudData& cloud, u64 frame_index)
+{
+    f64 time = frame_index * BENCH_TIMESTEP;
+    cloud = CloudData();
+    // slow orbit around the clouds, starting at the default camera position.
+    // Keeps the same distance from the origin so the view sweeps through both dense and empty sky
+    f32 angle = (f32)(time * 0.25);
+    glm::vec3 start = glm::vec3(cloud.cameraOffset);
+    f32 radius = glm::length(glm::vec2(start.x, start.z));
+    cloud.cameraOffset = glm::vec4(sinf(angle) * radius, start.y, cosf(angle) * radius, 0.0f);
+    cloud.sun_dir_and_time = glm::vec4(glm::normalize(glm::vec3(cloud.sun_dir_and_time)), (f32)time);
+}
+
+struct BenchStats
+{
+    u32 count = 0;
+    f64 min = 0;
+    f64 median = 0;
+    f64 p95 = 0;
+    f64 p99 = 0;
+    f64 mean = 0;
+};
+
+// nearest-rank percentiles over every sample that actually got recorded (>= 0)
+static BenchStats bench_compute_stats(const f64* samples, u32 num_samples)
+{
+    BenchStats stats = {};
+    f64* sorted = (f64*)TSYSALLOC(sizeof(f64) * (num_samples > 0 ? num_samples : 1));
+    for (u32 i = 0; i < num_samples; i++)
+    {
+        if (samples[i] >= 0.0)
+        {
+            sorted[stats.count++] = samples[i];
+        }
+    }
+    if (stats.count > 0)
+    {
+        std::sort(sorted, sorted + stats.count);
+        auto percentile = [&](f64 p)
+        {
+            u32 rank = (u32)ceil(p / 100.0 * stats.count);
+            return sorted[rank > 0 ? rank - 1 : 0];
+        };
+        f64 sum = 0.0;
+        for (u32 i = 0; i < stats.count; i++) sum += sorted[i];
+        stats.min = sorted[0];
+        stats.median = percentile(50.0);
+        stats.p95 = percentile(95.0);
+        stats.p99 = percentile(99.0);
+        stats.mean = sum / stats.count;
+    }
+    TSYSFREE(sorted);
+    return stats;
+}
+
+static void bench_write_stats_json(FILE* out, const char* name, const BenchStats& stats, bool trailing_comma)
+{
+    if (stats.count == 0)
+    {
+        fprintf(out, "  \"%s\": null%s\n", name, trailing_comma ? "," : "");
+        return;
+    }
+    fprintf(out, "  \"%s\": { \"samples\": %u, \"min\": %.4f, \"median\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"mean\": %.4f }%s\n",
+        name, stats.count, stats.min, stats.median, stats.p95, stats.p99, stats.mean, trailing_comma ? "," : "");
+}
+
+static void bench_write_json(FILE* out, const BenchResults& results, u32 warmup_frames, u32 width, u32 height)
+{
+    BenchStats cpu = bench_compute_stats(results.cpu_ms, results.num_frames);
+    BenchStats gpu = bench_compute_stats(results.gpu_ms, results.num_frames);
+    fprintf(out, "{\n");
+    fprintf(out, "  \"width\": %u,\n", width);
+    fprintf(out, "  \"height\": %u,\n", height);
+    fprintf(out, "  \"warmup_frames\": %u,\n", warmup_frames);
+    fprintf(out, "  \"measured_frames\": %u,\n", results.num_frames);
+    bench_write_stats_json(out, "cpu_ms", cpu, true);
+    bench_write_stats_json(out, "gpu_ms", gpu, false);
+    fprintf(out, "}\n");
+}
+
+void bench_report(const BenchResults& results, u32 warmup_frames, u32 width, u32 height, const char* output_path)
+{
+    bench_write_json(stdout, results, warmup_frames, width, height);
+    if (output_path != nullptr)
+    {
+        FILE* file = fopen(output_path, "w");
+        if (file == nullptr)
+        {
+            LOG_ERROR("Failed to open %s for writing", output_path);
+            return;
+        }
+        bench_write_json(file, results, warmup_frames, width, height);
+        fclose(file);
+        LOG_INFO("Wrote benchmark results to %s", output_path);
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "defines.h"
+
+struct CloudData;
+
+// fixed simulation step for benchmark runs. Every frame advances time by exactly this much
+constexpr f64 BENCH_TIMESTEP = 1.0 / 60.0;
+
+// per-frame timings for the measured (post-warmup) frames of a --bench run
+struct BenchResults
+{
+    u64 first_measured_frame = 0;
+    u32 num_frames = 0;
+    f64* cpu_ms = nullptr;
+    f64* gpu_ms = nullptr; // negative if that frame's gpu time never got resolved (or timestamps aren't supported)
+};
+
+BenchResults bench_init(u64 first_measured_frame, u32 num_frames);
+void bench_free(BenchResults& results);
+// ignores frames outside the measured range, so these can be called unconditionally
+void bench_record_cpu(BenchResults* results, u64 frame_index, f64 ms);
+void bench_record_gpu(BenchResults* results, u64 frame_index, f64 ms);
+
+// pins everything that would otherwise vary between runs (time, camera path, cloud params)
+// to a pure function of the frame number
+void bench_pin_frame_state(CloudData& cloud, u64 frame_index);
+
+// writes min/median/p95/p99 to stdout as json, and to output_path too if it isn't null
+void bench_report(const BenchResults& results, u32 warmup_frames, u32 width, u32 height, const char* output_path);
@@ -0,0 +1,47 @@
+#include "file_util.h"
+#include "tiny/tiny_log.h"
+
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <filesystem>
+
+u64 hash_bytes(u64 hash, const void* data, size_t size)
+{
+    const u8* bytes = (const u8*)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+bool write_file_atomic(const char* path, const FileChunk* chunks, u32 num_chunks)
+{
+    std::string temp_path = std::string(path) + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    FILE* file = fopen(temp_path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        LOG_WARN("Failed to open %s for writing", temp_path.c_str());
+        return false;
+    }
+    bool ok = true;
+    for (u32 i = 0; i < num_chunks && ok; i++)
+    {
+        ok = fwrite(chunks[i].data, 1, chunks[i].size, file) == chunks[i].size;
+    }
+    ok = fclose(file) == 0 && ok;
+    std::error_code error = {};
+    if (ok)
+    {
+        std::filesystem::rename(temp_path, path, error);
+    }
+    if (!ok || error)
+    {
+        LOG_WARN("Failed to write %s", path);
+        remove(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
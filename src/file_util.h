@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "defines.h"
+
+// helpers shared by everything that keeps files on disk between runs (shader, pipeline and bake caches)
+
+constexpr u64 HASH_SEED = 0xcbf29ce484222325ull;
+
+// FNV-1a. Chain calls starting from HASH_SEED. Plenty for telling cache entries apart
+u64 hash_bytes(u64 hash, const void* data, size_t size);
+
+struct FileChunk
+{
+    const void* data = nullptr;
+    size_t size = 0;
+};
+
+// writes the chunks back to back into a temp file next to path, then renames it over path. rename replaces atomically
+// on the same filesystem, so another thread (or process) never reads a half written file. The temp name is per thread,
+// so two threads writing the same path don't trip over each other. Logs and returns false on failure, leaving nothing behind
+bool write_file_atomic(const char* path, const FileChunk* chunks, u32 num_chunks);
+
+inline bool write_file_atomic(const char* path, const void* data, size_t size)
+{
+    FileChunk chunk = {data, size};
+    return write_file_atomic(path, &chunk, 1);
+}
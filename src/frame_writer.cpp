@@ -0,0 +1,326 @@
+#include "frame_writer.h"
+#include "tiny/tiny_log.h"
+#include "tiny/tiny_mem.h"
+#include "tiny/tiny_profile.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <filesystem>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#define PIPE_WRITE_MODE "wb" // no newline translation
+#else
+#define PIPE_WRITE_MODE "w"
+#endif
+
+struct FrameJob
+{
+    u32 slot = 0;
+    u64 frame_index = 0;
+};
+
+struct FrameWriter
+{
+    FrameWriterDesc desc = {};
+    size_t frame_size = 0;
+    // staging slots frames are copied into so the renderer can immediately reuse its readback buffer
+    u8* slot_mem = nullptr;
+    std::vector<u32> free_slots = {};
+    std::deque<FrameJob> jobs = {};
+    std::vector<std::thread> threads = {};
+    std::mutex mutex = {};
+    std::condition_variable job_available = {};
+    std::condition_variable slot_available = {};
+    bool shutting_down = false;
+    FILE* pipe = nullptr;
+    u64 frames_written = 0;
+};
+
+static const char* frame_format_extensions[FRAME_FORMAT_COUNT] = {"rgba", "ppm", "qoi", ""};
+
+FrameFormat frame_format_from_string(const char* str)
+{
+    if (strcmp(str, "raw") == 0) return FRAME_FORMAT_RAW;
+    if (strcmp(str, "ppm") == 0) return FRAME_FORMAT_PPM;
+    if (strcmp(str, "qoi") == 0) return FRAME_FORMAT_QOI;
+    if (strcmp(str, "pipe") == 0) return FRAME_FORMAT_PIPE;
+    return FRAME_FORMAT_COUNT;
+}
+
+// ===== ENCODERS
+// each one writes into out (which must be big enough for the worst case) and returns the encoded size
+
+size_t encode_ppm(const u8* rgba, u32 width, u32 height, u8* out)
+{
+    s32 header_size = snprintf((char*)out, 32, "P6\n%u %u\n255\n", width, height);
+    u8* dst = out + header_size;
+    u32 num_pixels = width * height;
+    for (u32 i = 0; i < num_pixels; i++)
+    {
+        dst[i*3 + 0] = rgba[i*4 + 0];
+        dst[i*3 + 1] = rgba[i*4 + 1];
+        dst[i*3 + 2] = rgba[i*4 + 2];
+    }
+    return header_size + num_pixels * 3;
+}
+
+size_t qoi_max_size(u32 width, u32 height)
+{
+    // header + worst case of an RGBA op per pixel + end marker
+    return 14 + (size_t)width * height * 5 + 8;
+}
+
+// straight from the spec https://qoiformat.org/qoi-specification.pdf
+size_t encode_qoi(const u8* rgba, u32 width, u32 height, u8* out)
+{
+    constexpr u8 QOI_OP_INDEX = 0x00;
+    constexpr u8 QOI_OP_DIFF = 0x40;
+    constexpr u8 QOI_OP_LUMA = 0x80;
+    constexpr u8 QOI_OP_RUN = 0xc0;
+    constexpr u8 QOI_OP_RGB = 0xfe;
+    constexpr u8 QOI_OP_RGBA = 0xff;
+    size_t p = 0;
+    auto write_u32_be = [&](u32 v)
+    {
+        out[p++] = (v >> 24) & 0xff;
+        out[p++] = (v >> 16) & 0xff;
+        out[p++] = (v >> 8) & 0xff;
+        out[p++] = v & 0xff;
+    };
+    out[p++] = 'q'; out[p++] = 'o'; out[p++] = 'i'; out[p++] = 'f';
+    write_u32_be(width);
+    write_u32_be(height);
+    out[p++] = 4; // channels
+    out[p++] = 0; // sRGB with linear alpha
+
+    u8 index[64][4] = {};
+    u8 prev[4] = {0, 0, 0, 255};
+    u32 run = 0;
+    u32 num_pixels = width * height;
+    for (u32 i = 0; i < num_pixels; i++)
+    {
+        const u8* px = &rgba[i*4];
+        if (memcmp(px, prev, 4) == 0)
+        {
+            run++;
+            if (run == 62 || i == num_pixels - 1)
+            {
+                out[p++] = QOI_OP_RUN | (run - 1);
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0)
+        {
+            out[p++] = QOI_OP_RUN | (run - 1);
+            run = 0;
+        }
+        u32 hash = (px[0]*3 + px[1]*5 + px[2]*7 + px[3]*11) % 64;
+        if (memcmp(index[hash], px, 4) == 0)
+        {
+            out[p++] = QOI_OP_INDEX | hash;
+        }
+        else
+        {
+            memcpy(index[hash], px, 4);
+            if (px[3] == prev[3])
+            {
+                // explicitly signed - s8 is plain char, whose signedness depends on the platform
+                signed char vr = (signed char)(px[0] - prev[0]);
+                signed char vg = (signed char)(px[1] - prev[1]);
+                signed char vb = (signed char)(px[2] - prev[2]);
+                signed char vg_r = vr - vg;
+                signed char vg_b = vb - vg;
+                if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2)
+                {
+                    out[p++] = QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+                }
+                else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8)
+                {
+                    out[p++] = QOI_OP_LUMA | (vg + 32);
+                    out[p++] = (vg_r + 8) << 4 | (vg_b + 8);
+                }
+                else
+                {
+                    out[p++] = QOI_OP_RGB;
+                    out[p++] = px[0]; out[p++] = px[1]; out[p++] = px[2];
+                }
+            }
+            else
+            {
+                out[p++] = QOI_OP_RGBA;
+                out[p++] = px[0]; out[p++] = px[1]; out[p++] = px[2]; out[p++] = px[3];
+            }
+        }
+        memcpy(prev, px, 4);
+    }
+    // end marker
+    for (u32 i = 0; i < 7; i++) out[p++] = 0;
+    out[p++] = 1;
+    return p;
+}
+
+// ===== END ENCODERS
+
+void write_frame(FrameWriter* writer, const u8* rgba, u64 frame_index, u8* scratch)
+{
+    TINY_PROFILE_SCOPE("write_frame");
+    const FrameWriterDesc& desc = writer->desc;
+    if (desc.format == FRAME_FORMAT_PIPE)
+    {
+        // single encoder thread in pipe mode, so this is never contended and frames stay in order
+        fwrite(rgba, 1, writer->frame_size, writer->pipe);
+        return;
+    }
+    const u8* data = rgba;
+    size_t size = writer->frame_size;
+    if (desc.format == FRAME_FORMAT_PPM)
+    {
+        size = encode_ppm(rgba, desc.width, desc.height, scratch);
+        data = scratch;
+    }
+    else if (desc.format == FRAME_FORMAT_QOI)
+    {
+        size = encode_qoi(rgba, desc.width, desc.height, scratch);
+        data = scratch;
+    }
+    char path[PATH_MAX];
+    snprintf(path, PATH_MAX, "%s/frame_%06llu.%s", desc.output_dir, (unsigned long long)frame_index, frame_format_extensions[desc.format]);
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr)
+    {
+        LOG_ERROR("Failed to open %s for writing", path);
+        return;
+    }
+    fwrite(data, 1, size, file);
+    fclose(file);
+}
+
+void encoder_thread_main(FrameWriter* writer)
+{
+    tiny_profile_set_thread_name("Frame encoder");
+    // per thread scratch for encoded output so encoders never share anything but the queue
+    size_t scratch_size = qoi_max_size(writer->desc.width, writer->desc.height);
+    u8* scratch = writer->desc.format == FRAME_FORMAT_PIPE ? nullptr : (u8*)TSYSALLOC(scratch_size);
+    while (true)
+    {
+        FrameJob job = {};
+        {
+            std::unique_lock<std::mutex> lock(writer->mutex);
+            writer->job_available.wait(lock, [writer]{ return !writer->jobs.empty() || writer->shutting_down; });
+            if (writer->jobs.empty())
+            {
+                break; // shutting down and fully drained
+            }
+            job = writer->jobs.front();
+            writer->jobs.pop_front();
+        }
+        write_frame(writer, writer->slot_mem + job.slot * writer->frame_size, job.frame_index, scratch);
+        {
+            std::lock_guard<std::mutex> lock(writer->mutex);
+            writer->free_slots.push_back(job.slot);
+            writer->frames_written++;
+        }
+        writer->slot_available.notify_one();
+    }
+    if (scratch)
+    {
+        TSYSFREE(scratch);
+    }
+}
+
+FrameWriter* frame_writer_init(const FrameWriterDesc& desc)
+{
+    FrameWriter* writer = new FrameWriter();
+    writer->desc = desc;
+    writer->frame_size = (size_t)desc.width * desc.height * 4;
+    if (desc.format == FRAME_FORMAT_PIPE)
+    {
+        if (desc.pipe_command == nullptr)
+        {
+            LOG_ERROR("Frame format pipe without a pipe command");
+            delete writer;
+            return nullptr;
+        }
+        writer->pipe = popen(desc.pipe_command, PIPE_WRITE_MODE);
+        if (writer->pipe == nullptr)
+        {
+            LOG_ERROR("Failed to launch frame encoder: %s", desc.pipe_command);
+            delete writer;
+            return nullptr;
+        }
+        writer->desc.num_threads = 1;
+    }
+    else
+    {
+        std::error_code err;
+        std::filesystem::create_directories(desc.output_dir, err);
+    }
+    if (writer->desc.num_threads == 0)
+    {
+        u32 hw_threads = std::thread::hardware_concurrency();
+        writer->desc.num_threads = hw_threads > 2 ? hw_threads / 2 : 1;
+    }
+    // a couple of slots per thread so the renderer has somewhere to put frames while every encoder is busy
+    u32 num_slots = writer->desc.num_threads * 2;
+    writer->slot_mem = (u8*)TSYSALLOC(writer->frame_size * num_slots);
+    for (u32 i = 0; i < num_slots; i++)
+    {
+        writer->free_slots.push_back(i);
+    }
+    for (u32 i = 0; i < writer->desc.num_threads; i++)
+    {
+        writer->threads.emplace_back(encoder_thread_main, writer);
+    }
+    LOG_INFO("Frame writer: %u encoder threads, %u slots", writer->desc.num_threads, num_slots);
+    return writer;
+}
+
+void frame_writer_submit(FrameWriter* writer, const void* rgba, u64 frame_index)
+{
+    u32 slot = 0;
+    {
+        std::unique_lock<std::mutex> lock(writer->mutex);
+        if (writer->free_slots.empty())
+        {
+            TINY_PROFILE_SCOPE("frame_writer_backpressure");
+            // backpressure rather than dropping frames. Only happens if encoding is slower than rendering
+            writer->slot_available.wait(lock, [writer]{ return !writer->free_slots.empty(); });
+        }
+        slot = writer->free_slots.back();
+        writer->free_slots.pop_back();
+    }
+    TMEMCPY(writer->slot_mem + slot * writer->frame_size, rgba, writer->frame_size);
+    {
+        std::lock_guard<std::mutex> lock(writer->mutex);
+        writer->jobs.push_back({slot, frame_index});
+    }
+    writer->job_available.notify_one();
+}
+
+void frame_writer_shutdown(FrameWriter* writer)
+{
+    {
+        std::lock_guard<std::mutex> lock(writer->mutex);
+        writer->shutting_down = true;
+    }
+    writer->job_available.notify_all();
+    for (std::thread& thread : writer->threads)
+    {
+        thread.join();
+    }
+    if (writer->pipe)
+    {
+        pclose(writer->pipe);
+    }
+    LOG_INFO("Frame writer finished. %llu frames written", (unsigned long long)writer->frames_written);
+    TSYSFREE(writer->slot_mem);
+    delete writer;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "defines.h"
+
+// streams rendered frames to disk (or another process) on a pool of encoder threads
+// so the render loop never waits on file I/O.
+// Frames are tightly packed RGBA8 (sRGB), top row first.
+
+enum FrameFormat
+{
+    FRAME_FORMAT_RAW = 0, // raw RGBA bytes, no header
+    FRAME_FORMAT_PPM,     // binary P6, alpha dropped
+    FRAME_FORMAT_QOI,     // https://qoiformat.org
+    FRAME_FORMAT_PIPE,    // raw RGBA bytes written to the stdin of an external encoder (ffmpeg etc)
+
+    FRAME_FORMAT_COUNT,
+};
+
+struct FrameWriterDesc
+{
+    FrameFormat format = FRAME_FORMAT_PPM;
+    // directory frames are written to. Ignored for FRAME_FORMAT_PIPE
+    const char* output_dir = nullptr;
+    // command whose stdin receives the frames. Only used for FRAME_FORMAT_PIPE
+    const char* pipe_command = nullptr;
+    u32 width = 0;
+    u32 height = 0;
+    // 0 picks based on the number of hardware threads. Pipe output is always a single thread to keep frames in order
+    u32 num_threads = 0;
+};
+
+struct FrameWriter;
+
+FrameWriter* frame_writer_init(const FrameWriterDesc& desc);
+// copies the frame into one of the writer's staging slots and queues it for encoding.
+// Only blocks if every slot is still being encoded (encoders can't keep up with the renderer)
+void frame_writer_submit(FrameWriter* writer, const void* rgba, u64 frame_index);
+// finishes every queued frame, joins the encoder threads and frees the writer
+void frame_writer_shutdown(FrameWriter* writer);
+
+// "raw" | "ppm" | "qoi" | "pipe". Returns FRAME_FORMAT_COUNT if unknown
+FrameFormat frame_format_from_string(const char* str);
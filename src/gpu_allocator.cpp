@@ -0,0 +1,315 @@
+#include "gpu_allocator.h"
+#include "tiny/tiny_log.h"
+#include "tiny/tiny_mem.h"
+#include "tiny/tiny_profile.h"
+
+#include "imgui.h"
+
+#include <stdlib.h>
+
+constexpr VkDeviceSize GPU_DEFAULT_BLOCK_SIZE = MEGABYTES_BYTES(64ull);
+
+static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+void gpu_allocator_init(GpuAllocator* allocator, VkPhysicalDevice physical_device, VkDevice logical_device)
+{
+    allocator->logical_device = logical_device;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &allocator->memory_properties);
+    // small heaps (the 256MB device local + host visible one on discrete gpus without resizable BAR, software renderers)
+    // get smaller blocks so one block can't eat the whole thing. Every other heap keeps the default
+    for (u32 i = 0; i < allocator->memory_properties.memoryHeapCount; i++)
+    {
+        VkDeviceSize heap_size = allocator->memory_properties.memoryHeaps[i].size;
+        allocator->heap_block_sizes[i] = heap_size / 8 < GPU_DEFAULT_BLOCK_SIZE ? heap_size / 8 : GPU_DEFAULT_BLOCK_SIZE;
+    }
+}
+
+static VkDeviceSize block_size_for_type(const GpuAllocator* allocator, u32 memory_type)
+{
+    return allocator->heap_block_sizes[allocator->memory_properties.memoryTypes[memory_type].heapIndex];
+}
+
+void gpu_allocator_destroy(GpuAllocator* allocator)
+{
+    for (GpuMemoryBlock& block : allocator->blocks)
+    {
+        if (block.used > 0)
+        {
+            LOG_WARN("GPU memory block (type %u) freed with %llu bytes still allocated", block.memory_type, (unsigned long long)block.used);
+        }
+        // freeing implicitly unmaps
+        vkFreeMemory(allocator->logical_device, block.memory, nullptr);
+    }
+    allocator->blocks.clear();
+    if (allocator->num_dedicated_allocations > 0)
+    {
+        LOG_WARN("%u dedicated GPU allocations were never freed", allocator->num_dedicated_allocations);
+    }
+}
+
+// required flags must all be there. Preferred ones are tried first, then dropped.
+// Types with any of the avoided flags are only used if nothing else fits
+static u32 find_memory_type(
+    const VkPhysicalDeviceMemoryProperties& mem_props,
+    u32 type_filter,
+    VkMemoryPropertyFlags required,
+    VkMemoryPropertyFlags preferred,
+    VkMemoryPropertyFlags avoided)
+{
+    VkMemoryPropertyFlags wanted[4][2] =
+    {
+        {required | preferred, avoided},
+        {required, avoided},
+        {required | preferred, 0},
+        {required, 0},
+    };
+    for (u32 pass = 0; pass < 4; pass++)
+    {
+        for (u32 i = 0; i < mem_props.memoryTypeCount; i++)
+        {
+            VkMemoryPropertyFlags flags = mem_props.memoryTypes[i].propertyFlags;
+            bool has_wanted = (flags & wanted[pass][0]) == wanted[pass][0];
+            bool has_avoided = (flags & wanted[pass][1]) != 0;
+            if (type_filter & (1 << i) && has_wanted && !has_avoided)
+            {
+                return i;
+            }
+        }
+    }
+    return U32_INVALID_ID;
+}
+
+static u32 find_memory_type_for_usage(const VkPhysicalDeviceMemoryProperties& mem_props, u32 type_filter, GpuMemoryUsage usage)
+{
+    // every host visible usage asks for coherent too, so nothing ever has to flush/invalidate mapped ranges
+    const VkMemoryPropertyFlags host = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    switch (usage)
+    {
+        case GPU_MEMORY_GPU_ONLY: return find_memory_type(mem_props, type_filter, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, 0);
+        case GPU_MEMORY_CPU_TO_GPU: return find_memory_type(mem_props, type_filter, host, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+        case GPU_MEMORY_CPU_ONLY: return find_memory_type(mem_props, type_filter, host, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        case GPU_MEMORY_GPU_TO_CPU: return find_memory_type(mem_props, type_filter, host, VK_MEMORY_PROPERTY_HOST_CACHED_BIT, 0);
+        default: return U32_INVALID_ID;
+    }
+}
+
+static bool allocate_device_memory(GpuAllocator* allocator, VkDeviceSize size, u32 memory_type, VkDeviceMemory& memory, void*& mapped)
+{
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = size;
+    alloc_info.memoryTypeIndex = memory_type;
+    VkResult result = vkAllocateMemory(allocator->logical_device, &alloc_info, nullptr, &memory);
+    if (result != VK_SUCCESS)
+    {
+        LOG_ERROR("vkAllocateMemory of %llu bytes from memory type %u failed (%i)", (unsigned long long)size, memory_type, result);
+        return false;
+    }
+    mapped = nullptr;
+    if (allocator->memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    {
+        // persistent mapping of the whole thing. Allocations just offset into it
+        vkMapMemory(allocator->logical_device, memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+    }
+    return true;
+}
+
+// first fit. Alignment padding at the front of a range stays behind as its own free range
+static bool block_try_alloc(GpuMemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset_out)
+{
+    for (u32 i = 0; i < block.free_ranges.size(); i++)
+    {
+        GpuFreeRange range = block.free_ranges[i];
+        VkDeviceSize aligned = align_up(range.offset, alignment);
+        VkDeviceSize range_end = range.offset + range.size;
+        if (aligned + size > range_end)
+        {
+            continue;
+        }
+        block.free_ranges.erase(block.free_ranges.begin() + i);
+        u32 insert_at = i;
+        if (aligned > range.offset)
+        {
+            block.free_ranges.insert(block.free_ranges.begin() + insert_at, {range.offset, aligned - range.offset});
+            insert_at++;
+        }
+        if (aligned + size < range_end)
+        {
+            block.free_ranges.insert(block.free_ranges.begin() + insert_at, {aligned + size, range_end - (aligned + size)});
+        }
+        block.used += size;
+        offset_out = aligned;
+        return true;
+    }
+    return false;
+}
+
+static void block_free(GpuMemoryBlock& block, VkDeviceSize offset, VkDeviceSize size)
+{
+    u32 i = 0;
+    while (i < block.free_ranges.size() && block.free_ranges[i].offset < offset)
+    {
+        i++;
+    }
+    block.free_ranges.insert(block.free_ranges.begin() + i, {offset, size});
+    // merge with the next range, then the previous one
+    if (i + 1 < block.free_ranges.size() && offset + size == block.free_ranges[i + 1].offset)
+    {
+        block.free_ranges[i].size += block.free_ranges[i + 1].size;
+        block.free_ranges.erase(block.free_ranges.begin() + i + 1);
+    }
+    if (i > 0 && block.free_ranges[i - 1].offset + block.free_ranges[i - 1].size == offset)
+    {
+        block.free_ranges[i - 1].size += block.free_ranges[i].size;
+        block.free_ranges.erase(block.free_ranges.begin() + i);
+    }
+    block.used -= size;
+}
+
+GpuAllocation gpu_alloc(GpuAllocator* allocator, const VkMemoryRequirements& requirements, GpuMemoryUsage usage, bool linear)
+{
+    TINY_PROFILE_SCOPE("gpu_alloc");
+    GpuAllocation allocation = {};
+    u32 memory_type = find_memory_type_for_usage(allocator->memory_properties, requirements.memoryTypeBits, usage);
+    if (memory_type == U32_INVALID_ID)
+    {
+        LOG_ERROR("No memory type fits usage %i (type bits %x)", usage, requirements.memoryTypeBits);
+        return allocation;
+    }
+    allocation.memory_type = memory_type;
+    allocation.size = requirements.size;
+
+    const VkDeviceSize block_size = block_size_for_type(allocator, memory_type);
+    if (requirements.size > block_size / 2)
+    {
+        // big ones would just fragment the blocks. Render targets at high res, volume textures, readback buffers
+        void* mapped = nullptr;
+        if (allocate_device_memory(allocator, requirements.size, memory_type, allocation.memory, mapped))
+        {
+            allocation.mapped = mapped;
+            allocator->num_dedicated_allocations++;
+            allocator->dedicated_bytes += requirements.size;
+        }
+        return allocation;
+    }
+
+    for (u32 i = 0; i < allocator->blocks.size(); i++)
+    {
+        GpuMemoryBlock& block = allocator->blocks[i];
+        if (block.memory_type != memory_type || block.linear != linear)
+        {
+            continue;
+        }
+        VkDeviceSize offset = 0;
+        if (block_try_alloc(block, requirements.size, requirements.alignment, offset))
+        {
+            allocation.memory = block.memory;
+            allocation.offset = offset;
+            allocation.mapped = block.mapped ? (u8*)block.mapped + offset : nullptr;
+            allocation.block_index = i;
+            allocator->num_allocations++;
+            return allocation;
+        }
+    }
+
+    // nothing had room. New block
+    GpuMemoryBlock block = {};
+    block.size = block_size;
+    block.memory_type = memory_type;
+    block.linear = linear;
+    if (!allocate_device_memory(allocator, block.size, memory_type, block.memory, block.mapped))
+    {
+        return allocation;
+    }
+    block.free_ranges.push_back({0, block.size});
+    VkDeviceSize offset = 0;
+    block_try_alloc(block, requirements.size, requirements.alignment, offset);
+    allocation.memory = block.memory;
+    allocation.offset = offset;
+    allocation.mapped = block.mapped ? (u8*)block.mapped + offset : nullptr;
+    allocation.block_index = (u32)allocator->blocks.size();
+    allocator->blocks.push_back(block);
+    allocator->num_allocations++;
+    LOG_INFO("New GPU memory block: %llu MB of type %u (%s)", (unsigned long long)(block.size / MEGABYTES_BYTES(1ull)), memory_type, linear ? "buffers" : "images");
+    return allocation;
+}
+
+void gpu_free(GpuAllocator* allocator, GpuAllocation& allocation)
+{
+    if (allocation.memory == VK_NULL_HANDLE)
+    {
+        return;
+    }
+    if (allocation.block_index == U32_INVALID_ID)
+    {
+        vkFreeMemory(allocator->logical_device, allocation.memory, nullptr);
+        allocator->num_dedicated_allocations--;
+        allocator->dedicated_bytes -= allocation.size;
+    }
+    else
+    {
+        // blocks are kept around even when empty, they'll just get reused
+        block_free(allocator->blocks[allocation.block_index], allocation.offset, allocation.size);
+        allocator->num_allocations--;
+    }
+    allocation = {};
+}
+
+GpuAllocation gpu_alloc_buffer(GpuAllocator* allocator, VkBuffer buffer, GpuMemoryUsage usage)
+{
+    VkMemoryRequirements requirements = {};
+    vkGetBufferMemoryRequirements(allocator->logical_device, buffer, &requirements);
+    GpuAllocation allocation = gpu_alloc(allocator, requirements, usage, true);
+    if (allocation.memory == VK_NULL_HANDLE)
+    {
+        // binding a null memory handle is invalid, and nothing that allocates through here can do without its resource
+        LOG_FATAL("Out of GPU memory for a buffer of %llu bytes", (unsigned long long)requirements.size);
+        exit(EXIT_FAILURE);
+    }
+    VkResult result = vkBindBufferMemory(allocator->logical_device, buffer, allocation.memory, allocation.offset);
+    if (result != VK_SUCCESS)
+    {
+        LOG_FATAL("vkBindBufferMemory failed (%i)", result);
+        exit(EXIT_FAILURE);
+    }
+    return allocation;
+}
+
+GpuAllocation gpu_alloc_image(GpuAllocator* allocator, VkImage image, GpuMemoryUsage usage)
+{
+    VkMemoryRequirements requirements = {};
+    vkGetImageMemoryRequirements(allocator->logical_device, image, &requirements);
+    // every image in here is optimal tiling
+    GpuAllocation allocation = gpu_alloc(allocator, requirements, usage, false);
+    if (allocation.memory == VK_NULL_HANDLE)
+    {
+        LOG_FATAL("Out of GPU memory for an image of %llu bytes", (unsigned long long)requirements.size);
+        exit(EXIT_FAILURE);
+    }
+    VkResult result = vkBindImageMemory(allocator->logical_device, image, allocation.memory, allocation.offset);
+    if (result != VK_SUCCESS)
+    {
+        LOG_FATAL("vkBindImageMemory failed (%i)", result);
+        exit(EXIT_FAILURE);
+    }
+    return allocation;
+}
+
+void gpu_allocator_imgui(const GpuAllocator* allocator)
+{
+    if (!ImGui::CollapsingHeader("GPU Memory"))
+    {
+        return;
+    }
+    for (u32 i = 0; i < allocator->blocks.size(); i++)
+    {
+        const GpuMemoryBlock& block = allocator->blocks[i];
+        ImGui::Text("Block %u (type %u, %s): %.2f / %.0f MB, %u free ranges", i, block.memory_type, block.linear ? "buffers" : "images",
+            block.used / (f64)MEGABYTES_BYTES(1), block.size / (f64)MEGABYTES_BYTES(1), (u32)block.free_ranges.size());
+    }
+    ImGui::Text("%u sub-allocations, %u dedicated (%.2f MB)", allocator->num_allocations, allocator->num_dedicated_allocations,
+        allocator->dedicated_bytes / (f64)MEGABYTES_BYTES(1));
+}
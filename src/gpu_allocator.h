@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+#include "defines.h"
+
+// sub-allocates buffers and images out of big VkDeviceMemory blocks instead of one vkAllocateMemory per resource.
+// Blocks are per memory type, and buffers and (optimal tiling) images never share a block so bufferImageGranularity
+// is never an issue. Host visible blocks are mapped once when they're created and stay mapped.
+// Anything bigger than half a block gets its own dedicated allocation
+
+// what the memory is going to be used for. Picks the memory type
+enum GpuMemoryUsage
+{
+    GPU_MEMORY_GPU_ONLY = 0, // device local. Vertex/index buffers, render targets, textures
+    GPU_MEMORY_CPU_TO_GPU, // host visible, device local if there's a type like that (integrated, resizable BAR). Written by the cpu every frame
+    GPU_MEMORY_CPU_ONLY, // host visible, avoids device local. Staging for uploads
+    GPU_MEMORY_GPU_TO_CPU, // host visible, cached if possible. Readback
+
+    GPU_MEMORY_USAGE_COUNT,
+};
+
+struct GpuAllocation
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void* mapped = nullptr; // already offset to this allocation. null unless host visible
+    u32 memory_type = 0;
+    u32 block_index = U32_INVALID_ID; // U32_INVALID_ID for dedicated allocations
+};
+
+struct GpuFreeRange
+{
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+};
+
+struct GpuMemoryBlock
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    VkDeviceSize used = 0;
+    void* mapped = nullptr;
+    u32 memory_type = 0;
+    bool linear = true; // buffers (and linear images) vs optimal tiling images
+    std::vector<GpuFreeRange> free_ranges = {}; // sorted by offset, neighbours always merged
+};
+
+struct GpuAllocator
+{
+    VkDevice logical_device = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties memory_properties = {};
+    VkDeviceSize heap_block_sizes[VK_MAX_MEMORY_HEAPS] = {}; // block size for each heap, see gpu_allocator_init
+    std::vector<GpuMemoryBlock> blocks = {};
+    // stats
+    u32 num_allocations = 0;
+    u32 num_dedicated_allocations = 0;
+    VkDeviceSize dedicated_bytes = 0;
+};
+
+void gpu_allocator_init(GpuAllocator* allocator, VkPhysicalDevice physical_device, VkDevice logical_device);
+void gpu_allocator_destroy(GpuAllocator* allocator);
+
+GpuAllocation gpu_alloc(GpuAllocator* allocator, const VkMemoryRequirements& requirements, GpuMemoryUsage usage, bool linear);
+void gpu_free(GpuAllocator* allocator, GpuAllocation& allocation);
+// allocate + bind
+GpuAllocation gpu_alloc_buffer(GpuAllocator* allocator, VkBuffer buffer, GpuMemoryUsage usage);
+GpuAllocation gpu_alloc_image(GpuAllocator* allocator, VkImage image, GpuMemoryUsage usage);
+
+// draws into whatever imgui window is currently open
+void gpu_allocator_imgui(const GpuAllocator* allocator);
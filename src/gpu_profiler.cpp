@@ -0,0 +1,269 @@
+#include "vulkan_main.h"
+#include "gpu_profiler.h"
+#include "tiny/tiny_log.h"
+
+#include "imgui.h"
+
+#include <stdio.h>
+
+const char* gpu_scope_names[GPU_SCOPE_COUNT] =
+{
+    "Frame",
+    "Terrain",
+    "Cone",
+    "Scene",
+    "Light grid",
+    "Occupancy",
+    "Clouds",
+    "Composite",
+    "ImGui",
+    "Readback",
+};
+
+constexpr u32 TIMESTAMPS_PER_SLOT = GPU_SCOPE_COUNT * 2;
+
+void gpu_profiler_init(
+    GpuProfiler* profiler,
+    Arena* arena,
+    VkDevice logical_device,
+    VkPhysicalDevice physical_device,
+    u32 graphics_family,
+    u32 num_slots,
+    bool pipeline_stats_enabled)
+{
+    profiler->num_slots = num_slots;
+    profiler->pending_frame_indices = arena_alloc_type(arena, u64, num_slots);
+    for (u32 i = 0; i < num_slots; i++)
+    {
+        profiler->pending_frame_indices[i] = UINT64_MAX;
+    }
+    for (u32 i = 0; i < GPU_SCOPE_COUNT; i++)
+    {
+        profiler->last_ms[i] = -1.0;
+    }
+
+    u32 queue_family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, nullptr);
+    ArenaTemp arena_temp = arena_temp_init(arena);
+    VkQueueFamilyProperties* queue_family_properties = arena_alloc_type(&arena_temp, VkQueueFamilyProperties, queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, queue_family_properties);
+    u32 timestamp_valid_bits = queue_family_properties[graphics_family].timestampValidBits;
+    arena_temp_end(arena_temp);
+    if (timestamp_valid_bits == 0)
+    {
+        LOG_WARN("Graphics queue doesn't support timestamps. No GPU timings available");
+    }
+    else
+    {
+        VkPhysicalDeviceProperties properties = {};
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
+        profiler->timestamp_period_ns = properties.limits.timestampPeriod;
+        profiler->timestamp_mask = timestamp_valid_bits >= 64 ? ~0ull : (1ull << timestamp_valid_bits) - 1;
+        VkQueryPoolCreateInfo pool_info = {};
+        pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        pool_info.queryCount = TIMESTAMPS_PER_SLOT * num_slots;
+        if (vkCreateQueryPool(logical_device, &pool_info, nullptr, &profiler->timestamp_pool) != VK_SUCCESS)
+        {
+            LOG_WARN("Failed to create the timestamp query pool. No GPU timings available");
+            profiler->timestamp_pool = VK_NULL_HANDLE;
+        }
+    }
+
+    if (pipeline_stats_enabled)
+    {
+        VkQueryPoolCreateInfo pool_info = {};
+        pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        pool_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        pool_info.queryCount = num_slots;
+        pool_info.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+        if (vkCreateQueryPool(logical_device, &pool_info, nullptr, &profiler->stats_pool) != VK_SUCCESS)
+        {
+            LOG_WARN("Failed to create the pipeline statistics query pool. No invocation counts available");
+            profiler->stats_pool = VK_NULL_HANDLE;
+        }
+    }
+}
+
+void gpu_profiler_destroy(GpuProfiler* profiler, VkDevice logical_device)
+{
+    if (profiler->timestamp_pool != VK_NULL_HANDLE)
+    {
+        vkDestroyQueryPool(logical_device, profiler->timestamp_pool, nullptr);
+    }
+    if (profiler->stats_pool != VK_NULL_HANDLE)
+    {
+        vkDestroyQueryPool(logical_device, profiler->stats_pool, nullptr);
+    }
+}
+
+void gpu_profiler_begin_frame(GpuProfiler* profiler, VkCommandBuffer cmd_buffer, u32 slot)
+{
+    if (profiler->timestamp_pool != VK_NULL_HANDLE)
+    {
+        vkCmdResetQueryPool(cmd_buffer, profiler->timestamp_pool, slot * TIMESTAMPS_PER_SLOT, TIMESTAMPS_PER_SLOT);
+    }
+    if (profiler->stats_pool != VK_NULL_HANDLE)
+    {
+        vkCmdResetQueryPool(cmd_buffer, profiler->stats_pool, slot, 1);
+    }
+}
+
+void gpu_profiler_begin_scope(GpuProfiler* profiler, VkCommandBuffer cmd_buffer, u32 slot, GpuScope scope)
+{
+    if (profiler->timestamp_pool == VK_NULL_HANDLE) return;
+    vkCmdWriteTimestamp(cmd_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, profiler->timestamp_pool, slot * TIMESTAMPS_PER_SLOT + scope * 2);
+}
+
+void gpu_profiler_end_scope(GpuProfiler* profiler, VkCommandBuffer cmd_buffer, u32 slot, GpuScope scope)
+{
+    if (profiler->timestamp_pool == VK_NULL_HANDLE) return;
+    vkCmdWriteTimestamp(cmd_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, profiler->timestamp_pool, slot * TIMESTAMPS_PER_SLOT + scope * 2 + 1);
+}
+
+void gpu_profiler_begin_stats(GpuProfiler* profiler, VkCommandBuffer cmd_buffer, u32 slot)
+{
+    if (profiler->stats_pool == VK_NULL_HANDLE) return;
+    vkCmdBeginQuery(cmd_buffer, profiler->stats_pool, slot, 0);
+}
+
+void gpu_profiler_end_stats(GpuProfiler* profiler, VkCommandBuffer cmd_buffer, u32 slot)
+{
+    if (profiler->stats_pool == VK_NULL_HANDLE) return;
+    vkCmdEndQuery(cmd_buffer, profiler->stats_pool, slot);
+}
+
+void gpu_profiler_frame_submitted(GpuProfiler* profiler, u32 slot, u64 frame_index)
+{
+    profiler->pending_frame_indices[slot] = frame_index;
+}
+
+bool gpu_profiler_resolve(GpuProfiler* profiler, VkDevice logical_device, u32 slot, u64* frame_index_out)
+{
+    u64& frame_index = profiler->pending_frame_indices[slot];
+    if (frame_index == UINT64_MAX)
+    {
+        return false;
+    }
+    if (profiler->timestamp_pool != VK_NULL_HANDLE)
+    {
+        // value + availability pairs. Unwritten scopes are simply unavailable, so this can't stall or fail on them
+        u64 timestamps[TIMESTAMPS_PER_SLOT][2] = {};
+        vkGetQueryPoolResults(logical_device, profiler->timestamp_pool, slot * TIMESTAMPS_PER_SLOT, TIMESTAMPS_PER_SLOT,
+            sizeof(timestamps), timestamps, sizeof(timestamps[0]), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+        for (u32 scope = 0; scope < GPU_SCOPE_COUNT; scope++)
+        {
+            const u64* begin = timestamps[scope * 2];
+            const u64* end = timestamps[scope * 2 + 1];
+            bool available = begin[1] != 0 && end[1] != 0;
+            // masked so a scope that spans the counter wrapping still comes out as the (small) difference
+            u64 ticks = (end[0] - begin[0]) & profiler->timestamp_mask;
+            profiler->last_ms[scope] = available ? (f64)ticks * profiler->timestamp_period_ns / 1000000.0 : -1.0;
+        }
+    }
+    if (profiler->stats_pool != VK_NULL_HANDLE)
+    {
+        u64 invocations[2] = {};
+        vkGetQueryPoolResults(logical_device, profiler->stats_pool, slot, 1,
+            sizeof(invocations), invocations, sizeof(invocations), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+        profiler->last_fragment_invocations = invocations[1] != 0 ? invocations[0] : 0;
+    }
+
+    u32 head = profiler->history_head;
+    for (u32 scope = 0; scope < GPU_SCOPE_COUNT; scope++)
+    {
+        profiler->history_ms[scope][head] = (f32)profiler->last_ms[scope];
+    }
+    profiler->history_fragment_invocations[head] = profiler->last_fragment_invocations;
+    profiler->history_frame_indices[head] = frame_index;
+    profiler->history_head = (head + 1) % GPU_PROFILER_HISTORY;
+    if (profiler->history_count < GPU_PROFILER_HISTORY) profiler->history_count++;
+
+    if (frame_index_out) *frame_index_out = frame_index;
+    frame_index = UINT64_MAX;
+    return true;
+}
+
+f64 gpu_profiler_average_ms(const GpuProfiler* profiler, GpuScope scope)
+{
+    f64 sum = 0.0;
+    u32 count = 0;
+    for (u32 i = 0; i < profiler->history_count; i++)
+    {
+        f32 ms = profiler->history_ms[scope][i];
+        if (ms >= 0.0f)
+        {
+            sum += ms;
+            count++;
+        }
+    }
+    return count > 0 ? sum / count : -1.0;
+}
+
+void gpu_profiler_imgui(GpuProfiler* profiler, u32 num_pixels)
+{
+    if (!ImGui::CollapsingHeader("GPU Profiler", ImGuiTreeNodeFlags_DefaultOpen))
+    {
+        return;
+    }
+    if (profiler->timestamp_pool == VK_NULL_HANDLE)
+    {
+        ImGui::Text("Timestamps not supported on this device");
+        return;
+    }
+    for (u32 scope = 0; scope < GPU_SCOPE_COUNT; scope++)
+    {
+        f64 avg = gpu_profiler_average_ms(profiler, (GpuScope)scope);
+        if (avg < 0.0) continue; // never written (e.g. readback while windowed)
+        ImGui::Text("%-10s %7.3f ms (avg %7.3f)", gpu_scope_names[scope], profiler->last_ms[scope], avg);
+    }
+    // oldest to newest, starting right after the head
+    ImGui::PlotLines("Frame ms", profiler->history_ms[GPU_SCOPE_FRAME], profiler->history_count,
+        profiler->history_count == GPU_PROFILER_HISTORY ? profiler->history_head : 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 60));
+    if (profiler->stats_pool != VK_NULL_HANDLE)
+    {
+        u64 invocations = profiler->last_fragment_invocations;
+        ImGui::Text("Fragment invocations: %llu (%.2f / pixel)", (unsigned long long)invocations, num_pixels > 0 ? (f64)invocations / num_pixels : 0.0);
+        f64 scene_ms = gpu_profiler_average_ms(profiler, GPU_SCOPE_SCENE);
+        if (scene_ms > 0.0 && invocations > 0)
+        {
+            ImGui::Text("Scene: %.2f ns / invocation", scene_ms * 1000000.0 / invocations);
+        }
+    }
+    if (ImGui::Button("Export CSV"))
+    {
+        gpu_profiler_export_csv(profiler, "gpu_timings.csv");
+    }
+}
+
+bool gpu_profiler_export_csv(const GpuProfiler* profiler, const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (file == nullptr)
+    {
+        LOG_ERROR("Failed to open %s for writing", path);
+        return false;
+    }
+    fprintf(file, "frame");
+    for (u32 scope = 0; scope < GPU_SCOPE_COUNT; scope++)
+    {
+        fprintf(file, ",%s_ms", gpu_scope_names[scope]);
+    }
+    fprintf(file, ",fragment_invocations\n");
+    u32 start = profiler->history_count == GPU_PROFILER_HISTORY ? profiler->history_head : 0;
+    for (u32 i = 0; i < profiler->history_count; i++)
+    {
+        u32 idx = (start + i) % GPU_PROFILER_HISTORY;
+        fprintf(file, "%llu", (unsigned long long)profiler->history_frame_indices[idx]);
+        for (u32 scope = 0; scope < GPU_SCOPE_COUNT; scope++)
+        {
+            f32 ms = profiler->history_ms[scope][idx];
+            if (ms >= 0.0f) fprintf(file, ",%.4f", ms);
+            else fprintf(file, ",");
+        }
+        fprintf(file, ",%llu\n", (unsigned long long)profiler->history_fragment_invocations[idx]);
+    }
+    fclose(file);
+    LOG_INFO("Exported %u frames of GPU timings to %s", profiler->history_count, path);
+    return true;
+}
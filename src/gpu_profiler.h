@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "defines.h"
+#include "tiny/tiny_arena.h"
+
+// timestamp scopes recorded every frame.
+// Each scope is a begin/end timestamp pair per frame in flight. Scopes that weren't written in a frame
+// (imgui when headless, readback when not writing frames) just show up as unavailable
+enum GpuScope
+{
+    GPU_SCOPE_FRAME = 0, // whole command buffer
+    GPU_SCOPE_TERRAIN, // heightfield, min/max pyramid and horizon bake. Only on the frame after startup or a shader reload
+    GPU_SCOPE_CONE, // cone march prepass, a ray per tile. Skipped when it's toggled off
+    GPU_SCOPE_SCENE, // sdf raymarch, full res
+    GPU_SCOPE_LIGHT_GRID, // sun transmittance grid update, skipped on frames with nothing to update
+    GPU_SCOPE_OCCUPANCY, // occupancy pyramid rebuild, runs whenever the light grid does
+    GPU_SCOPE_CLOUDS, // cloud compute pass, reduced res
+    GPU_SCOPE_COMPOSITE, // cloud upsample + composite into the swapchain image
+    GPU_SCOPE_IMGUI,
+    GPU_SCOPE_READBACK,
+
+    GPU_SCOPE_COUNT,
+};
+
+constexpr u32 GPU_PROFILER_HISTORY = 240;
+
+struct GpuProfiler
+{
+    VkQueryPool timestamp_pool = VK_NULL_HANDLE; // VK_NULL_HANDLE if the graphics queue can't do timestamps
+    VkQueryPool stats_pool = VK_NULL_HANDLE; // fragment invocations of the scene pass. VK_NULL_HANDLE if pipelineStatisticsQuery isn't supported
+    f64 timestamp_period_ns = 0.0;
+    u64 timestamp_mask = ~0ull; // timestampValidBits worth of ones. Counters narrower than 64 bits wrap
+    u32 num_slots = 0;
+    u64* pending_frame_indices = nullptr; // which frame's queries are pending in each slot. UINT64_MAX if none
+    // results are read back once a slot's fence has signaled, so they lag MAX_FRAMES_IN_FLIGHT frames behind
+    f64 last_ms[GPU_SCOPE_COUNT] = {}; // negative if that scope wasn't written last frame
+    u64 last_fragment_invocations = 0;
+    // rolling history, newest entry at history_head - 1
+    f32 history_ms[GPU_SCOPE_COUNT][GPU_PROFILER_HISTORY] = {};
+    u64 history_fragment_invocations[GPU_PROFILER_HISTORY] = {};
+    u64 history_frame_indices[GPU_PROFILER_HISTORY] = {};
+    u32 history_head = 0;
+    u32 history_count = 0;
+};
+
+extern const char* gpu_scope_names[GPU_SCOPE_COUNT];
+
+void gpu_profiler_init(
+    GpuProfiler* profiler,
+    Arena* arena,
+    VkDevice logical_device,
+    VkPhysicalDevice physical_device,
+    u32 graphics_family,
+    u32 num_slots,
+    bool pipeline_stats_enabled);
+void gpu_profiler_destroy(GpuProfiler* profiler, VkDevice logical_device);
+
+// resets this slot's queries. Must be recorded outside a render pass, before any scopes
+void gpu_profiler_begin_frame(GpuProfiler* profiler, VkCommandBuffer cmd_buffer, u32 slot);
+void gpu_profiler_begin_scope(GpuProfiler* profiler, VkCommandBuffer cmd_buffer, u32 slot, GpuScope scope);
+void gpu_profiler_end_scope(GpuProfiler* profiler, VkCommandBuffer cmd_buffer, u32 slot, GpuScope scope);
+// pipeline statistics for the scene pass. Begin and end must be in the same subpass
+void gpu_profiler_begin_stats(GpuProfiler* profiler, VkCommandBuffer cmd_buffer, u32 slot);
+void gpu_profiler_end_stats(GpuProfiler* profiler, VkCommandBuffer cmd_buffer, u32 slot);
+void gpu_profiler_frame_submitted(GpuProfiler* profiler, u32 slot, u64 frame_index);
+
+// reads back whatever the last frame in this slot wrote. Never waits - only call once the slot's fence has signaled.
+// Returns false if there was nothing pending
+bool gpu_profiler_resolve(GpuProfiler* profiler, VkDevice logical_device, u32 slot, u64* frame_index_out);
+
+f64 gpu_profiler_average_ms(const GpuProfiler* profiler, GpuScope scope);
+// draws into whatever imgui window is currently open
+void gpu_profiler_imgui(GpuProfiler* profiler, u32 num_pixels);
+bool gpu_profiler_export_csv(const GpuProfiler* profiler, const char* path);
@@ -10,6 +10,11 @@
 #include "defines.h"
 #include "vulkan_main.h"
 #include "tiny/tiny_log.h"
+#include "tiny/tiny_profile.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
 
 u32 SCREEN_WIDTH = 800; // default
 u32 SCREEN_HEIGHT = 600;
@@ -51,13 +56,223 @@ void mainLoop()
     }
 }
 
+// unknown args are ignored (the resource directory is passed as a bare arg)
+LaunchOptions parse_launch_options(int argc, char** argv)
+{
+    LaunchOptions options = {};
+    options.width = SCREEN_WIDTH;
+    options.height = SCREEN_HEIGHT;
+    for (s32 i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (strcmp(arg, "--headless") == 0)
+        {
+            options.headless = true;
+        }
+        else if (strcmp(arg, "--width") == 0 && has_value)
+        {
+            options.width = (u32)atoi(argv[++i]);
+        }
+        else if (strcmp(arg, "--height") == 0 && has_value)
+        {
+            options.height = (u32)atoi(argv[++i]);
+        }
+        else if (strcmp(arg, "--frames") == 0 && has_value)
+        {
+            options.frame_count = (u32)atoi(argv[++i]);
+        }
+        else if (strcmp(arg, "--out") == 0 && has_value)
+        {
+            options.output_dir = argv[++i];
+        }
+        else if (strcmp(arg, "--format") == 0 && has_value)
+        {
+            FrameFormat format = frame_format_from_string(argv[++i]);
+            if (format == FRAME_FORMAT_COUNT)
+            {
+                LOG_WARN("Unknown frame format %s, using ppm", argv[i]);
+                format = FRAME_FORMAT_PPM;
+            }
+            options.output_format = format;
+        }
+        else if (strcmp(arg, "--pipe") == 0 && has_value)
+        {
+            // e.g. --pipe "ffmpeg -f rawvideo -pix_fmt rgba -s 800x600 -i - out.mp4"
+            options.pipe_command = argv[++i];
+        }
+        else if (strcmp(arg, "--writer-threads") == 0 && has_value)
+        {
+            options.writer_threads = (u32)atoi(argv[++i]);
+        }
+        else if (strcmp(arg, "--bench") == 0)
+        {
+            options.bench = true;
+            options.headless = true;
+        }
+        else if (strcmp(arg, "--warmup") == 0 && has_value)
+        {
+            options.bench_warmup_frames = (u32)atoi(argv[++i]);
+        }
+        else if (strcmp(arg, "--bench-frames") == 0 && has_value)
+        {
+            options.bench_frames = (u32)atoi(argv[++i]);
+        }
+        else if (strcmp(arg, "--bench-out") == 0 && has_value)
+        {
+            options.bench_output = argv[++i];
+        }
+        else if (strcmp(arg, "--gpu-csv") == 0 && has_value)
+        {
+            options.gpu_csv_output = argv[++i];
+        }
+        else if (strcmp(arg, "--trace") == 0 && has_value)
+        {
+            options.trace_output = argv[++i];
+        }
+        else if (strcmp(arg, "--pipeline-cache") == 0 && has_value)
+        {
+            options.pipeline_cache_path = argv[++i];
+        }
+        else if (strcmp(arg, "--quality") == 0 && has_value)
+        {
+            QualityPreset quality = quality_preset_from_string(argv[++i]);
+            if (quality == QUALITY_PRESET_COUNT)
+            {
+                LOG_WARN("Unknown quality %s, using high", argv[i]);
+                quality = QUALITY_HIGH;
+            }
+            options.quality = quality;
+        }
+        else if (strcmp(arg, "--cloud-downsample") == 0 && has_value)
+        {
+            u32 downsample = (u32)atoi(argv[++i]);
+            if (downsample != 1 && downsample != 2 && downsample != 4)
+            {
+                LOG_WARN("Cloud downsample has to be 1, 2 or 4, got %s. Using 2", argv[i]);
+                downsample = 2;
+            }
+            options.cloud_downsample = downsample;
+        }
+        else if (strcmp(arg, "--noise-size") == 0 && has_value)
+        {
+            u32 size = (u32)atoi(argv[++i]);
+            if (size < 16 || size > NOISE_MAX_SIZE || (size & (size - 1)) != 0)
+            {
+                LOG_WARN("Noise size has to be a power of two from 16 to %u, got %s. Using 128", NOISE_MAX_SIZE, argv[i]);
+                size = 128;
+            }
+            options.noise.size = size;
+        }
+        else if (strcmp(arg, "--noise-format") == 0 && has_value)
+        {
+            NoiseFormat format = noise_format_from_string(argv[++i]);
+            if (format == NOISE_FORMAT_COUNT)
+            {
+                LOG_WARN("Unknown noise format %s, using r8", argv[i]);
+                format = NOISE_FORMAT_R8;
+            }
+            options.noise.format = format;
+        }
+        else if (strcmp(arg, "--procedural-noise") == 0)
+        {
+            options.procedural_noise = true;
+        }
+        else if (strcmp(arg, "--lod-bias") == 0 && has_value)
+        {
+            options.lod_bias = (f32)atof(argv[++i]);
+        }
+        else if (strcmp(arg, "--no-relaxed-tracing") == 0)
+        {
+            options.relaxed_tracing = false;
+        }
+        else if (strcmp(arg, "--no-cone-prepass") == 0)
+        {
+            options.cone_prepass = false;
+        }
+        else if (strcmp(arg, "--sdf-size") == 0 && has_value)
+        {
+            u32 size = (u32)atoi(argv[++i]);
+            if (size < 4 * SDF_BRICK_SIZE || size % (4 * SDF_BRICK_SIZE) != 0)
+            {
+                LOG_WARN("Sdf size has to be a multiple of %u, got %s. Using 128", 4 * SDF_BRICK_SIZE, argv[i]);
+                size = 128;
+            }
+            options.sdf_size = size;
+        }
+        else if (strcmp(arg, "--no-pipeline-cache") == 0)
+        {
+            options.pipeline_cache_path = nullptr;
+        }
+    }
+    // --pipe can come before or after --format, so this can only be checked once everything's parsed
+    if (options.output_format == FRAME_FORMAT_PIPE && options.pipe_command == nullptr)
+    {
+        LOG_WARN("Frame format pipe needs a --pipe command, using ppm");
+        options.output_format = FRAME_FORMAT_PPM;
+    }
+    return options;
+}
+
+void run_headless(const LaunchOptions& options)
+{
+    LOG_INFO("Running headless %ux%u for %u frames", options.width, options.height, options.frame_count);
+    RuntimeData runtime = initVulkan(options);
+    auto start_time = std::chrono::steady_clock::now();
+    u32 frames_rendered = 0;
+    while (options.frame_count == 0 || frames_rendered < options.frame_count)
+    {
+        vulkanMainLoop(runtime);
+        frames_rendered++;
+    }
+    vkDeviceWaitIdle(runtime.logical_device);
+    f64 elapsed = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start_time).count();
+    LOG_INFO("Rendered %u frames in %.3fs (%.2f fps)", frames_rendered, elapsed, frames_rendered / elapsed);
+    vulkanCleanup(runtime);
+}
+
+// N warmup frames then M measured frames of pinned, identical work every run
+void run_bench(const LaunchOptions& options)
+{
+    LOG_INFO("Benchmarking %ux%u: %u warmup + %u measured frames", options.width, options.height, options.bench_warmup_frames, options.bench_frames);
+    RuntimeData runtime = initVulkan(options);
+    BenchResults results = bench_init(options.bench_warmup_frames, options.bench_frames);
+    runtime.bench_results = &results;
+    u32 total_frames = options.bench_warmup_frames + options.bench_frames;
+    for (u32 i = 0; i < total_frames; i++)
+    {
+        u64 frame_index = runtime.frame_index;
+        auto frame_start = std::chrono::steady_clock::now();
+        vulkanMainLoop(runtime);
+        f64 frame_ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - frame_start).count();
+        bench_record_cpu(&results, frame_index, frame_ms);
+    }
+    // resolves the gpu timings of the last frames in flight
+    vulkanCleanup(runtime);
+    bench_report(results, options.bench_warmup_frames, options.width, options.height, options.bench_output);
+    bench_free(results);
+}
+
 int main(int argc, char** argv)
 {
+    tiny_profile_init();
+    tiny_profile_set_thread_name("Main");
     s8 cwd[PATH_MAX];
     getcwd(cwd, PATH_MAX);
     LOG_INFO("CWD: %s", cwd);
+    LaunchOptions options = parse_launch_options(argc, argv);
+    if (options.bench)
+    {
+        run_bench(options);
+        return 0;
+    }
+    if (options.headless)
+    {
+        run_headless(options);
+        return 0;
+    }
     initWindow();
-    RuntimeData runtime = initVulkan();
+    RuntimeData runtime = initVulkan(options);
     glfwSetWindowUserPointer(glob_glfw_window, &runtime);
     while(!should_close_window(glob_glfw_window)) 
     {
@@ -0,0 +1,386 @@
+#include "noise_bake.h"
+#include "bake_cache.h"
+#include "file_util.h"
+#include "tiny/tiny_log.h"
+#include "tiny/tiny_profile.h"
+
+#include <math.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#include <emmintrin.h>
+#define NOISE_BAKE_USE_SSE2 1
+#endif
+
+// bump whenever the noise below changes, so old bakes aren't picked up from the cache
+constexpr u32 NOISE_BAKE_VERSION = 1;
+constexpr u32 NOISE_LANES = 4;
+
+// octaves of the shape and detail volumes. Cell counts are per tile and double every octave, so every octave tiles
+constexpr u32 SHAPE_PERLIN_CELLS = 4;
+constexpr u32 SHAPE_PERLIN_OCTAVES = 4;
+constexpr u32 SHAPE_WORLEY_CELLS = 4;
+constexpr u32 DETAIL_CELLS = 8;
+constexpr u32 DETAIL_OCTAVES = 4;
+
+// ===== 4 wide math. SSE2 on x64 (always there, no runtime check needed), plain loops anywhere else
+
+#ifdef NOISE_BAKE_USE_SSE2
+typedef __m128 f4;
+typedef __m128i i4;
+static inline f4 f4_set1(f32 x) { return _mm_set1_ps(x); }
+static inline f4 f4_lane_index() { return _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f); }
+static inline f4 f4_add(f4 a, f4 b) { return _mm_add_ps(a, b); }
+static inline f4 f4_sub(f4 a, f4 b) { return _mm_sub_ps(a, b); }
+static inline f4 f4_mul(f4 a, f4 b) { return _mm_mul_ps(a, b); }
+static inline f4 f4_div(f4 a, f4 b) { return _mm_div_ps(a, b); }
+static inline f4 f4_min(f4 a, f4 b) { return _mm_min_ps(a, b); }
+static inline f4 f4_max(f4 a, f4 b) { return _mm_max_ps(a, b); }
+static inline f4 f4_sqrt(f4 a) { return _mm_sqrt_ps(a); }
+// no roundps before SSE4.1. Truncate, then step down wherever that rounded up (negatives)
+static inline f4 f4_floor(f4 a)
+{
+    f4 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.0f)));
+}
+// mask lanes are all ones or all zeros
+static inline f4 f4_select(i4 mask, f4 a, f4 b)
+{
+    f4 m = _mm_castsi128_ps(mask);
+    return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+}
+static inline void f4_store(f32* out, f4 a) { _mm_storeu_ps(out, a); }
+static inline f4 f4_from_i4(i4 a) { return _mm_cvtepi32_ps(a); }
+static inline i4 i4_from_f4(f4 a) { return _mm_cvttps_epi32(a); }
+static inline i4 i4_set1(u32 x) { return _mm_set1_epi32((s32)x); }
+static inline i4 i4_add(i4 a, i4 b) { return _mm_add_epi32(a, b); }
+static inline i4 i4_and(i4 a, i4 b) { return _mm_and_si128(a, b); }
+static inline i4 i4_or(i4 a, i4 b) { return _mm_or_si128(a, b); }
+static inline i4 i4_xor(i4 a, i4 b) { return _mm_xor_si128(a, b); }
+static inline i4 i4_shr(i4 a, s32 bits) { return _mm_srl_epi32(a, _mm_cvtsi32_si128(bits)); }
+static inline i4 i4_eq(i4 a, i4 b) { return _mm_cmpeq_epi32(a, b); }
+static inline i4 i4_lt(i4 a, i4 b) { return _mm_cmplt_epi32(a, b); }
+// low 32 bits of a 32x32 multiply. pmulld is SSE4.1, so pmuludq the even and odd lanes and interleave
+static inline i4 i4_mul(i4 a, i4 b)
+{
+    i4 even = _mm_mul_epu32(a, b);
+    i4 odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+#else
+struct f4 { f32 v[NOISE_LANES]; };
+struct i4 { u32 v[NOISE_LANES]; };
+#define NOISE_LANEWISE(type, expr) type r; for (u32 i = 0; i < NOISE_LANES; i++) { r.v[i] = (expr); } return r;
+static inline f4 f4_set1(f32 x) { NOISE_LANEWISE(f4, x) }
+static inline f4 f4_lane_index() { NOISE_LANEWISE(f4, (f32)i) }
+static inline f4 f4_add(f4 a, f4 b) { NOISE_LANEWISE(f4, a.v[i] + b.v[i]) }
+static inline f4 f4_sub(f4 a, f4 b) { NOISE_LANEWISE(f4, a.v[i] - b.v[i]) }
+static inline f4 f4_mul(f4 a, f4 b) { NOISE_LANEWISE(f4, a.v[i] * b.v[i]) }
+static inline f4 f4_div(f4 a, f4 b) { NOISE_LANEWISE(f4, a.v[i] / b.v[i]) }
+static inline f4 f4_min(f4 a, f4 b) { NOISE_LANEWISE(f4, a.v[i] < b.v[i] ? a.v[i] : b.v[i]) }
+static inline f4 f4_max(f4 a, f4 b) { NOISE_LANEWISE(f4, a.v[i] > b.v[i] ? a.v[i] : b.v[i]) }
+static inline f4 f4_sqrt(f4 a) { NOISE_LANEWISE(f4, sqrtf(a.v[i])) }
+static inline f4 f4_floor(f4 a) { NOISE_LANEWISE(f4, floorf(a.v[i])) }
+static inline f4 f4_select(i4 mask, f4 a, f4 b) { NOISE_LANEWISE(f4, mask.v[i] ? a.v[i] : b.v[i]) }
+static inline void f4_store(f32* out, f4 a) { memcpy(out, a.v, sizeof(a.v)); }
+static inline f4 f4_from_i4(i4 a) { NOISE_LANEWISE(f4, (f32)(s32)a.v[i]) }
+static inline i4 i4_from_f4(f4 a) { NOISE_LANEWISE(i4, (u32)(s32)a.v[i]) }
+static inline i4 i4_set1(u32 x) { NOISE_LANEWISE(i4, x) }
+static inline i4 i4_add(i4 a, i4 b) { NOISE_LANEWISE(i4, a.v[i] + b.v[i]) }
+static inline i4 i4_and(i4 a, i4 b) { NOISE_LANEWISE(i4, a.v[i] & b.v[i]) }
+static inline i4 i4_or(i4 a, i4 b) { NOISE_LANEWISE(i4, a.v[i] | b.v[i]) }
+static inline i4 i4_xor(i4 a, i4 b) { NOISE_LANEWISE(i4, a.v[i] ^ b.v[i]) }
+static inline i4 i4_shr(i4 a, s32 bits) { NOISE_LANEWISE(i4, a.v[i] >> bits) }
+static inline i4 i4_eq(i4 a, i4 b) { NOISE_LANEWISE(i4, a.v[i] == b.v[i] ? 0xffffffffu : 0u) }
+static inline i4 i4_lt(i4 a, i4 b) { NOISE_LANEWISE(i4, (s32)a.v[i] < (s32)b.v[i] ? 0xffffffffu : 0u) }
+static inline i4 i4_mul(i4 a, i4 b) { NOISE_LANEWISE(i4, a.v[i] * b.v[i]) }
+#undef NOISE_LANEWISE
+#endif
+
+static inline f4 f4_neg(f4 a) { return f4_sub(f4_set1(0.0f), a); }
+static inline f4 f4_lerp(f4 a, f4 b, f4 t) { return f4_add(a, f4_mul(f4_sub(b, a), t)); }
+static inline f4 f4_saturate(f4 a) { return f4_min(f4_max(a, f4_set1(0.0f)), f4_set1(1.0f)); }
+
+// ===== NOISE
+
+static inline i4 hash3(i4 x, i4 y, i4 z, u32 seed)
+{
+    i4 h = i4_xor(i4_mul(x, i4_set1(0x8da6b343u)), i4_mul(y, i4_set1(0xd8163841u)));
+    h = i4_xor(h, i4_mul(z, i4_set1(0xcb1ab31fu)));
+    h = i4_xor(h, i4_set1(seed));
+    h = i4_xor(h, i4_shr(h, 13));
+    h = i4_mul(h, i4_set1(0x85ebca6bu));
+    return i4_xor(h, i4_shr(h, 16));
+}
+
+// 6t^5 - 15t^4 + 10t^3
+static inline f4 fade(f4 t)
+{
+    f4 inner = f4_add(f4_mul(t, f4_sub(f4_mul(t, f4_set1(6.0f)), f4_set1(15.0f))), f4_set1(10.0f));
+    return f4_mul(f4_mul(f4_mul(t, t), t), inner);
+}
+
+// improved perlin noise gradient: dot with one of 12 cube edge directions picked by the low 4 hash bits
+static inline f4 grad(i4 hash, f4 x, f4 y, f4 z)
+{
+    i4 h = i4_and(hash, i4_set1(15));
+    i4 zero = i4_set1(0);
+    f4 u = f4_select(i4_lt(h, i4_set1(8)), x, y);
+    i4 h_is_12_or_14 = i4_or(i4_eq(h, i4_set1(12)), i4_eq(h, i4_set1(14)));
+    f4 v = f4_select(i4_lt(h, i4_set1(4)), y, f4_select(h_is_12_or_14, x, z));
+    u = f4_select(i4_eq(i4_and(h, i4_set1(1)), zero), u, f4_neg(u));
+    v = f4_select(i4_eq(i4_and(h, i4_set1(2)), zero), v, f4_neg(v));
+    return f4_add(u, v);
+}
+
+// gradient noise whose lattice wraps every `period` cells (power of two). Roughly [-1, 1]
+static f4 perlin(f4 x, f4 y, f4 z, u32 period, u32 seed)
+{
+    f4 fx = f4_floor(x);
+    f4 fy = f4_floor(y);
+    f4 fz = f4_floor(z);
+    i4 mask = i4_set1(period - 1);
+    i4 one = i4_set1(1);
+    i4 x0 = i4_and(i4_from_f4(fx), mask);
+    i4 y0 = i4_and(i4_from_f4(fy), mask);
+    i4 z0 = i4_and(i4_from_f4(fz), mask);
+    i4 x1 = i4_and(i4_add(x0, one), mask);
+    i4 y1 = i4_and(i4_add(y0, one), mask);
+    i4 z1 = i4_and(i4_add(z0, one), mask);
+    f4 tx0 = f4_sub(x, fx);
+    f4 ty0 = f4_sub(y, fy);
+    f4 tz0 = f4_sub(z, fz);
+    f4 tx1 = f4_sub(tx0, f4_set1(1.0f));
+    f4 ty1 = f4_sub(ty0, f4_set1(1.0f));
+    f4 tz1 = f4_sub(tz0, f4_set1(1.0f));
+
+    f4 n000 = grad(hash3(x0, y0, z0, seed), tx0, ty0, tz0);
+    f4 n100 = grad(hash3(x1, y0, z0, seed), tx1, ty0, tz0);
+    f4 n010 = grad(hash3(x0, y1, z0, seed), tx0, ty1, tz0);
+    f4 n110 = grad(hash3(x1, y1, z0, seed), tx1, ty1, tz0);
+    f4 n001 = grad(hash3(x0, y0, z1, seed), tx0, ty0, tz1);
+    f4 n101 = grad(hash3(x1, y0, z1, seed), tx1, ty0, tz1);
+    f4 n011 = grad(hash3(x0, y1, z1, seed), tx0, ty1, tz1);
+    f4 n111 = grad(hash3(x1, y1, z1, seed), tx1, ty1, tz1);
+
+    f4 u = fade(tx0);
+    f4 v = fade(ty0);
+    f4 w = fade(tz0);
+    f4 nz0 = f4_lerp(f4_lerp(n000, n100, u), f4_lerp(n010, n110, u), v);
+    f4 nz1 = f4_lerp(f4_lerp(n001, n101, u), f4_lerp(n011, n111, u), v);
+    return f4_lerp(nz0, nz1, w);
+}
+
+// distance to the closest feature point (one per cell, cells wrapping every `period`), clamped to [0, 1]
+static f4 worley(f4 x, f4 y, f4 z, u32 period, u32 seed)
+{
+    f4 fx = f4_floor(x);
+    f4 fy = f4_floor(y);
+    f4 fz = f4_floor(z);
+    i4 ix = i4_from_f4(fx);
+    i4 iy = i4_from_f4(fy);
+    i4 iz = i4_from_f4(fz);
+    f4 tx = f4_sub(x, fx);
+    f4 ty = f4_sub(y, fy);
+    f4 tz = f4_sub(z, fz);
+    i4 mask = i4_set1(period - 1);
+    i4 bits = i4_set1(1023);
+    f4 to_unit = f4_set1(1.0f / 1024.0f);
+    f4 min_dist2 = f4_set1(3.0f);
+    for (s32 dz = -1; dz <= 1; dz++)
+    {
+        for (s32 dy = -1; dy <= 1; dy++)
+        {
+            for (s32 dx = -1; dx <= 1; dx++)
+            {
+                i4 cx = i4_and(i4_add(ix, i4_set1((u32)dx)), mask);
+                i4 cy = i4_and(i4_add(iy, i4_set1((u32)dy)), mask);
+                i4 cz = i4_and(i4_add(iz, i4_set1((u32)dz)), mask);
+                i4 h = hash3(cx, cy, cz, seed);
+                // 10 hash bits per axis place the feature point inside its cell
+                f4 px = f4_add(f4_mul(f4_from_i4(i4_and(h, bits)), to_unit), f4_sub(f4_set1((f32)dx), tx));
+                f4 py = f4_add(f4_mul(f4_from_i4(i4_and(i4_shr(h, 10), bits)), to_unit), f4_sub(f4_set1((f32)dy), ty));
+                f4 pz = f4_add(f4_mul(f4_from_i4(i4_and(i4_shr(h, 20), bits)), to_unit), f4_sub(f4_set1((f32)dz), tz));
+                f4 dist2 = f4_add(f4_add(f4_mul(px, px), f4_mul(py, py)), f4_mul(pz, pz));
+                min_dist2 = f4_min(min_dist2, dist2);
+            }
+        }
+    }
+    return f4_min(f4_sqrt(min_dist2), f4_set1(1.0f));
+}
+
+// perlin octaves starting at `cells` per tile, normalized back to about [-1, 1]
+static f4 perlin_fbm(f4 x, f4 y, f4 z, u32 cells, u32 octaves, u32 seed)
+{
+    f4 result = f4_set1(0.0f);
+    f32 amplitude = 1.0f;
+    f32 total = 0.0f;
+    for (u32 i = 0; i < octaves; i++)
+    {
+        f4 scale = f4_set1((f32)cells);
+        f4 octave = perlin(f4_mul(x, scale), f4_mul(y, scale), f4_mul(z, scale), cells, seed + i);
+        result = f4_add(result, f4_mul(octave, f4_set1(amplitude)));
+        total += amplitude;
+        amplitude *= 0.5f;
+        cells *= 2;
+    }
+    return f4_mul(result, f4_set1(1.0f / total));
+}
+
+// inverted worley (1 at feature points) summed over 3 octaves, [0, 1]
+static f4 worley_fbm(f4 x, f4 y, f4 z, u32 cells, u32 seed)
+{
+    const f32 weights[3] = {0.625f, 0.25f, 0.125f};
+    f4 result = f4_set1(0.0f);
+    for (u32 i = 0; i < ARRAY_SIZE(weights); i++)
+    {
+        f4 scale = f4_set1((f32)cells);
+        f4 octave = f4_sub(f4_set1(1.0f), worley(f4_mul(x, scale), f4_mul(y, scale), f4_mul(z, scale), cells, seed + i));
+        result = f4_add(result, f4_mul(octave, f4_set1(weights[i])));
+        cells *= 2;
+    }
+    return result;
+}
+
+// ===== BAKE
+
+struct NoiseBakeJob
+{
+    const NoiseBakeDesc* desc = nullptr;
+    u8* shape = nullptr;
+    u8* detail = nullptr;
+    std::atomic<u32> next_slice = {0};
+};
+
+static void store_unorm(f4 value, NoiseFormat format, u8* dst)
+{
+    f32 values[NOISE_LANES];
+    f4_store(values, f4_saturate(value));
+    for (u32 i = 0; i < NOISE_LANES; i++)
+    {
+        if (format == NOISE_FORMAT_R16)
+        {
+            u16 texel = (u16)(values[i] * 65535.0f + 0.5f);
+            memcpy(dst + i * sizeof(u16), &texel, sizeof(u16));
+        }
+        else
+        {
+            dst[i] = (u8)(values[i] * 255.0f + 0.5f);
+        }
+    }
+}
+
+// takes z slices off the job until there are none left. Every thread (including the caller) runs this
+static void noise_bake_worker(NoiseBakeJob* job)
+{
+    TINY_PROFILE_SCOPE("noise_bake_worker");
+    const NoiseBakeDesc& desc = *job->desc;
+    const u32 size = desc.size;
+    const u32 texel_bytes = noise_format_bytes(desc.format);
+    const f32 inv_size = 1.0f / (f32)size;
+    const u32 perlin_seed = desc.seed;
+    const u32 worley_seed = desc.seed ^ 0x9e3779b9u;
+    const u32 detail_seed = desc.seed ^ 0x7f4a7c15u;
+    const f4 lane_offsets = f4_add(f4_lane_index(), f4_set1(0.5f));
+    u32 z = 0;
+    while ((z = job->next_slice.fetch_add(1)) < size)
+    {
+        // texel centers, in tile space [0, 1)
+        f4 pz = f4_set1(((f32)z + 0.5f) * inv_size);
+        for (u32 y = 0; y < size; y++)
+        {
+            f4 py = f4_set1(((f32)y + 0.5f) * inv_size);
+            for (u32 x = 0; x < size; x += NOISE_LANES)
+            {
+                f4 px = f4_mul(f4_add(f4_set1((f32)x), lane_offsets), f4_set1(inv_size));
+                size_t offset = (((size_t)z * size + y) * size + x) * texel_bytes;
+
+                // perlin-worley: the perlin fbm pushed up towards 1 around worley feature points, so it billows
+                f4 perlin01 = f4_add(f4_mul(perlin_fbm(px, py, pz, SHAPE_PERLIN_CELLS, SHAPE_PERLIN_OCTAVES, perlin_seed), f4_set1(0.5f)), f4_set1(0.5f));
+                f4 cells = worley_fbm(px, py, pz, SHAPE_WORLEY_CELLS, worley_seed);
+                f4 shape = f4_add(cells, f4_mul(perlin01, f4_sub(f4_set1(1.0f), cells)));
+                store_unorm(shape, desc.format, job->shape + offset);
+
+                f4 detail = perlin_fbm(px, py, pz, DETAIL_CELLS, DETAIL_OCTAVES, detail_seed);
+                store_unorm(f4_add(f4_mul(detail, f4_set1(0.5f)), f4_set1(0.5f)), desc.format, job->detail + offset);
+            }
+        }
+    }
+}
+
+NoiseVolumes noise_bake(const NoiseBakeDesc& desc, u32 num_threads, const char* cache_dir)
+{
+    TINY_PROFILE_FUNCTION();
+    NoiseVolumes volumes = {};
+    volumes.desc = desc;
+    TINY_ASSERT((desc.size & (desc.size - 1)) == 0 && desc.size >= NOISE_LANES);
+    const size_t volume_bytes = (size_t)desc.size * desc.size * desc.size * noise_format_bytes(desc.format);
+
+    u64 key = hash_bytes(HASH_SEED, &NOISE_BAKE_VERSION, sizeof(NOISE_BAKE_VERSION));
+    key = hash_bytes(key, &desc.size, sizeof(desc.size));
+    key = hash_bytes(key, &desc.format, sizeof(desc.format));
+    key = hash_bytes(key, &desc.seed, sizeof(desc.seed));
+    std::vector<u8> cached = {};
+    if (cache_dir != nullptr && bake_cache_load(cache_dir, "noise", key, cached) && cached.size() == volume_bytes * 2)
+    {
+        volumes.shape.assign(cached.begin(), cached.begin() + volume_bytes);
+        volumes.detail.assign(cached.begin() + volume_bytes, cached.end());
+        LOG_INFO("Loaded %u^3 noise volumes from the bake cache", desc.size);
+        return volumes;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    // one buffer for both so the cache entry can be written straight out of it
+    std::vector<u8> texels(volume_bytes * 2);
+    NoiseBakeJob job = {};
+    job.desc = &desc;
+    job.shape = texels.data();
+    job.detail = texels.data() + volume_bytes;
+    if (num_threads == 0)
+    {
+        num_threads = std::thread::hardware_concurrency();
+    }
+    num_threads = num_threads < 1 ? 1 : (num_threads > desc.size ? desc.size : num_threads);
+    std::vector<std::thread> threads = {};
+    for (u32 i = 1; i < num_threads; i++)
+    {
+        threads.emplace_back(noise_bake_worker, &job);
+    }
+    noise_bake_worker(&job);
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    f64 ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("Baked %u^3 noise volumes (%s) in %.2fms on %u threads",
+        desc.size, desc.format == NOISE_FORMAT_R16 ? "r16" : "r8", ms, num_threads);
+
+    if (cache_dir != nullptr)
+    {
+        bake_cache_store(cache_dir, "noise", key, texels.data(), texels.size());
+    }
+    volumes.shape.assign(texels.begin(), texels.begin() + volume_bytes);
+    volumes.detail.assign(texels.begin() + volume_bytes, texels.end());
+    return volumes;
+}
+
+u32 noise_format_bytes(NoiseFormat format)
+{
+    return format == NOISE_FORMAT_R16 ? 2 : 1;
+}
+
+NoiseFormat noise_format_from_string(const char* str)
+{
+    if (strcmp(str, "r8") == 0)
+    {
+        return NOISE_FORMAT_R8;
+    }
+    if (strcmp(str, "r16") == 0)
+    {
+        return NOISE_FORMAT_R16;
+    }
+    return NOISE_FORMAT_COUNT;
+}
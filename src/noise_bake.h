@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+
+#include "defines.h"
+
+// bakes the tileable 3D noise the clouds sample instead of evaluating fbm() per sample.
+//  shape: Perlin-Worley (gradient fbm eroded by inverted worley fbm), the billowy low frequency cloud shape
+//  detail: gradient noise fbm, higher frequency, for breaking up the edges
+// Both tile in every axis (every octave's lattice wraps at the volume size) and are stored as unorm [0,1].
+// Slices are spread over worker threads, and each thread evaluates 4 texels along x at a time with SSE2 (scalar elsewhere).
+// Bakes are cached on disk under a hash of the desc, so only the first run with a given desc pays for it
+
+enum NoiseFormat
+{
+    NOISE_FORMAT_R8 = 0,
+    NOISE_FORMAT_R16,
+
+    NOISE_FORMAT_COUNT,
+};
+
+// every doubling is 8x the memory and bake time. 256^3 r16 is already 32MB per volume
+constexpr u32 NOISE_MAX_SIZE = 256;
+
+struct NoiseBakeDesc
+{
+    u32 size = 128; // texels per side. Power of two
+    NoiseFormat format = NOISE_FORMAT_R8;
+    u32 seed = 1337;
+};
+
+struct NoiseVolumes
+{
+    NoiseBakeDesc desc = {};
+    std::vector<u8> shape = {}; // size^3 texels, x fastest
+    std::vector<u8> detail = {};
+};
+
+// num_threads 0 = one per hardware thread. cache_dir can be null to always bake
+NoiseVolumes noise_bake(const NoiseBakeDesc& desc, u32 num_threads, const char* cache_dir);
+
+u32 noise_format_bytes(NoiseFormat format);
+// "r8" / "r16". NOISE_FORMAT_COUNT if it's neither
+NoiseFormat noise_format_from_string(const char* str);
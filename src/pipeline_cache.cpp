@@ -0,0 +1,142 @@
+#include "pipeline_cache.h"
+#include "file_util.h"
+#include "tiny/tiny_log.h"
+#include "tiny/tiny_mem.h"
+#include "tiny/tiny_profile.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+// VkPipelineCacheHeaderVersionOne, read by hand since it's tightly packed and we don't want to rely on struct layout
+constexpr size_t PIPELINE_CACHE_HEADER_SIZE = 16 + VK_UUID_SIZE;
+
+static u32 read_u32_le(const u8* bytes)
+{
+    return (u32)bytes[0] | ((u32)bytes[1] << 8) | ((u32)bytes[2] << 16) | ((u32)bytes[3] << 24);
+}
+
+// drivers are supposed to reject incompatible data themselves, but not all of them do it gracefully
+static bool pipeline_cache_header_valid(const std::vector<u8>& data, const VkPhysicalDeviceProperties& properties, const char* path)
+{
+    if (data.size() < PIPELINE_CACHE_HEADER_SIZE)
+    {
+        LOG_WARN("Pipeline cache %s is too small (%zu bytes), ignoring it", path, data.size());
+        return false;
+    }
+    u32 header_size = read_u32_le(&data[0]);
+    u32 header_version = read_u32_le(&data[4]);
+    u32 vendor_id = read_u32_le(&data[8]);
+    u32 device_id = read_u32_le(&data[12]);
+    const u8* uuid = &data[16];
+    if (header_size < PIPELINE_CACHE_HEADER_SIZE || header_size > data.size() || header_version != VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+    {
+        LOG_WARN("Pipeline cache %s has a bad header (size %u version %u), ignoring it", path, header_size, header_version);
+        return false;
+    }
+    if (vendor_id != properties.vendorID || device_id != properties.deviceID || memcmp(uuid, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+    {
+        // different gpu or the driver was updated
+        LOG_INFO("Pipeline cache %s was made by a different device/driver, starting cold", path);
+        return false;
+    }
+    return true;
+}
+
+static bool read_whole_file(const char* path, std::vector<u8>& data_out)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    bool ok = size > 0;
+    if (ok)
+    {
+        data_out.resize((size_t)size);
+        ok = fread(data_out.data(), 1, data_out.size(), file) == data_out.size();
+    }
+    fclose(file);
+    return ok;
+}
+
+void pipeline_cache_init(PipelineCache* cache, VkPhysicalDevice physical_device, VkDevice logical_device, const char* path)
+{
+    TINY_PROFILE_FUNCTION();
+    *cache = {};
+    cache->path = path;
+    std::vector<u8> data = {};
+    if (path != nullptr && read_whole_file(path, data))
+    {
+        VkPhysicalDeviceProperties properties = {};
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
+        if (!pipeline_cache_header_valid(data, properties, path))
+        {
+            data.clear();
+        }
+    }
+    VkPipelineCacheCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    info.initialDataSize = data.size();
+    info.pInitialData = data.empty() ? nullptr : data.data();
+    VkResult result = vkCreatePipelineCache(logical_device, &info, nullptr, &cache->cache);
+    if (result != VK_SUCCESS && !data.empty())
+    {
+        // passed our checks but the driver still didn't like it
+        LOG_WARN("Driver rejected pipeline cache %s, starting cold", path);
+        data.clear();
+        info.initialDataSize = 0;
+        info.pInitialData = nullptr;
+        result = vkCreatePipelineCache(logical_device, &info, nullptr, &cache->cache);
+    }
+    if (result != VK_SUCCESS)
+    {
+        LOG_ERROR("Failed to create pipeline cache (%i)", result);
+        cache->cache = VK_NULL_HANDLE; // pipelines just get created without one
+    }
+    cache->warm = !data.empty();
+    cache->loaded_size = data.size();
+    if (cache->warm)
+    {
+        LOG_INFO("Loaded pipeline cache %s (%zu bytes)", path, data.size());
+    }
+}
+
+bool pipeline_cache_save(const PipelineCache* cache, VkDevice logical_device)
+{
+    TINY_PROFILE_FUNCTION();
+    if (cache->path == nullptr || cache->cache == VK_NULL_HANDLE)
+    {
+        return false;
+    }
+    size_t size = 0;
+    VkResult result = vkGetPipelineCacheData(logical_device, cache->cache, &size, nullptr);
+    if (result != VK_SUCCESS || size == 0)
+    {
+        return false;
+    }
+    std::vector<u8> data(size);
+    // VK_INCOMPLETE can only happen if the cache grew in between, which it can't with nothing compiling
+    result = vkGetPipelineCacheData(logical_device, cache->cache, &size, data.data());
+    if (result != VK_SUCCESS)
+    {
+        LOG_ERROR("Failed to get pipeline cache data (%i)", result);
+        return false;
+    }
+    if (!write_file_atomic(cache->path, data.data(), size))
+    {
+        return false;
+    }
+    LOG_INFO("Saved pipeline cache %s (%zu bytes)", cache->path, size);
+    return true;
+}
+
+void pipeline_cache_destroy(PipelineCache* cache, VkDevice logical_device)
+{
+    pipeline_cache_save(cache, logical_device);
+    vkDestroyPipelineCache(logical_device, cache->cache, nullptr);
+    cache->cache = VK_NULL_HANDLE;
+}
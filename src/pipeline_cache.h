@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "defines.h"
+
+// one VkPipelineCache for every pipeline we (and imgui) create, persisted between runs.
+// The blob on disk is only handed to the driver if its header matches this exact device + driver,
+// otherwise we start cold. Saved through a temp file + rename so a crash mid-write can't leave a torn cache behind
+
+struct PipelineCache
+{
+    VkPipelineCache cache = VK_NULL_HANDLE;
+    const char* path = nullptr; // null = don't load or save, always cold
+    bool warm = false; // started from valid data on disk
+    size_t loaded_size = 0;
+    f64 create_ms = 0.0; // time spent creating pipelines at startup, cold vs warm is the whole point of this
+};
+
+void pipeline_cache_init(PipelineCache* cache, VkPhysicalDevice physical_device, VkDevice logical_device, const char* path);
+// writes the cache back to disk (if it has a path) then destroys it. Call after every pipeline using it has been created
+void pipeline_cache_destroy(PipelineCache* cache, VkDevice logical_device);
+bool pipeline_cache_save(const PipelineCache* cache, VkDevice logical_device);
@@ -0,0 +1,374 @@
+#include "shader_compiler.h"
+#include "file_util.h"
+#include "tiny/tiny_log.h"
+#include "tiny/tiny_mem.h"
+#include "tiny/tiny_profile.h"
+
+#include "shaderc/shaderc.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <filesystem>
+
+constexpr u32 SPIRV_MAGIC = 0x07230203;
+// bump to throw away every cached spirv (e.g. after changing compile options below)
+constexpr u32 SHADER_CACHE_VERSION = 1;
+constexpr u32 SHADER_WATCH_INTERVAL_MS = 250;
+
+struct ShaderCompiler
+{
+    shaderc_compiler_t compiler = nullptr;
+    std::string source_dir = {};
+    std::string cache_dir = {};
+    u64 compiler_hash = 0; // shaderc's spirv version/revision + our options. Part of every cache key
+    std::mutex stats_mutex = {};
+    u32 num_compiled = 0;
+    u32 num_cache_hits = 0;
+};
+
+static const char* shader_stage_names[SHADER_STAGE_COUNT] = {"vert", "frag", "comp"};
+static const shaderc_shader_kind shader_stage_kinds[SHADER_STAGE_COUNT] = 
+{
+    shaderc_glsl_vertex_shader, 
+    shaderc_glsl_fragment_shader, 
+    shaderc_glsl_compute_shader
+};
+
+static u64 hash_string(u64 hash, const char* str)
+{
+    // include the terminator so ("ab","c") and ("a","bc") hash differently
+    return hash_bytes(hash, str, strlen(str) + 1);
+}
+
+static bool read_file(const std::string& path, std::string& contents_out)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    bool ok = size >= 0;
+    if (ok)
+    {
+        contents_out.resize((size_t)size);
+        ok = fread(contents_out.data(), 1, contents_out.size(), file) == contents_out.size();
+    }
+    fclose(file);
+    return ok;
+}
+
+ShaderCompiler* shader_compiler_init(const char* source_dir, const char* cache_dir)
+{
+    shaderc_compiler_t shaderc = shaderc_compiler_initialize();
+    if (shaderc == nullptr)
+    {
+        LOG_ERROR("Failed to initialize shaderc");
+        return nullptr;
+    }
+    ShaderCompiler* compiler = new ShaderCompiler();
+    compiler->compiler = shaderc;
+    compiler->source_dir = source_dir;
+    compiler->cache_dir = cache_dir;
+    std::error_code error = {};
+    std::filesystem::create_directories(compiler->cache_dir, error);
+    if (error)
+    {
+        LOG_WARN("Failed to create shader cache directory %s: %s", cache_dir, error.message().c_str());
+    }
+    u32 spirv_version = 0;
+    u32 spirv_revision = 0;
+    shaderc_get_spv_version(&spirv_version, &spirv_revision);
+    u64 hash = HASH_SEED;
+    hash = hash_bytes(hash, &SHADER_CACHE_VERSION, sizeof(SHADER_CACHE_VERSION));
+    hash = hash_bytes(hash, &spirv_version, sizeof(spirv_version));
+    hash = hash_bytes(hash, &spirv_revision, sizeof(spirv_revision));
+    compiler->compiler_hash = hash;
+    return compiler;
+}
+
+void shader_compiler_destroy(ShaderCompiler* compiler)
+{
+    if (compiler == nullptr)
+    {
+        return;
+    }
+    LOG_INFO("Shader compiler: %u compiled, %u from cache", compiler->num_compiled, compiler->num_cache_hits);
+    shaderc_compiler_release(compiler->compiler);
+    delete compiler;
+}
+
+// #include "file" is looked up in source_dir. Includes of includes work the same way
+struct ShaderInclude
+{
+    shaderc_include_result result = {};
+    std::string name = {};
+    std::string contents = {};
+};
+
+static shaderc_include_result* shader_include_resolve(void* user_data, const char* requested_source, int, 
+    const char*, size_t)
+{
+    ShaderCompiler* compiler = (ShaderCompiler*)user_data;
+    ShaderInclude* include = new ShaderInclude();
+    include->name = compiler->source_dir + requested_source;
+    if (!read_file(include->name, include->contents))
+    {
+        // empty source name + the error in content is how shaderc wants failures reported
+        include->contents = "Can't open include " + include->name;
+        include->name.clear();
+    }
+    include->result.source_name = include->name.c_str();
+    include->result.source_name_length = include->name.size();
+    include->result.content = include->contents.c_str();
+    include->result.content_length = include->contents.size();
+    include->result.user_data = include;
+    return &include->result;
+}
+
+static void shader_include_release(void*, shaderc_include_result* result)
+{
+    delete (ShaderInclude*)result->user_data;
+}
+
+static bool load_cached_spirv(const std::string& path, std::vector<u32>& spirv_out)
+{
+    std::string bytes = {};
+    if (!read_file(path, bytes) || bytes.size() < sizeof(u32) || bytes.size() % sizeof(u32) != 0)
+    {
+        return false;
+    }
+    u32 magic = 0;
+    TMEMCPY(&magic, bytes.data(), sizeof(magic));
+    if (magic != SPIRV_MAGIC)
+    {
+        return false;
+    }
+    spirv_out.resize(bytes.size() / sizeof(u32));
+    TMEMCPY(spirv_out.data(), bytes.data(), bytes.size());
+    return true;
+}
+
+bool shader_compile(
+    ShaderCompiler* compiler,
+    const char* filename,
+    ShaderStage stage,
+    const ShaderDefine* defines,
+    u32 num_defines,
+    std::vector<u32>& spirv_out)
+{
+    TINY_PROFILE_FUNCTION();
+    std::string path = compiler->source_dir + filename;
+    std::string source = {};
+    if (!read_file(path, source))
+    {
+        LOG_ERROR("Failed to read shader %s", path.c_str());
+        return false;
+    }
+
+    shaderc_compile_options_t options = shaderc_compile_options_initialize();
+    shaderc_compile_options_set_source_language(options, shaderc_source_language_glsl);
+    shaderc_compile_options_set_target_env(options, shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_0);
+    shaderc_compile_options_set_optimization_level(options, shaderc_optimization_level_performance);
+    shaderc_compile_options_set_include_callbacks(options, shader_include_resolve, shader_include_release, compiler);
+    for (u32 i = 0; i < num_defines; i++)
+    {
+        const char* value = defines[i].value ? defines[i].value : "";
+        shaderc_compile_options_add_macro_definition(options, defines[i].name, strlen(defines[i].name), value, strlen(value));
+    }
+
+    // the key is the preprocessed source, so edits to included files (and the defines) are covered.
+    // Preprocessing is cheap next to an actual compile
+    shaderc_compilation_result_t result = shaderc_compile_into_preprocessed_text(compiler->compiler, source.data(), source.size(), 
+        shader_stage_kinds[stage], path.c_str(), "main", options);
+    bool ok = shaderc_result_get_compilation_status(result) == shaderc_compilation_status_success;
+    if (!ok)
+    {
+        LOG_ERROR("Failed to preprocess %s:\n%s", path.c_str(), shaderc_result_get_error_message(result));
+        shaderc_result_release(result);
+        shaderc_compile_options_release(options);
+        return false;
+    }
+    u64 key = compiler->compiler_hash;
+    key = hash_bytes(key, &stage, sizeof(stage));
+    key = hash_bytes(key, shaderc_result_get_bytes(result), shaderc_result_get_length(result));
+    for (u32 i = 0; i < num_defines; i++)
+    {
+        key = hash_string(key, defines[i].name);
+        key = hash_string(key, defines[i].value ? defines[i].value : "");
+    }
+    shaderc_result_release(result);
+    char cache_name[64];
+    snprintf(cache_name, sizeof(cache_name), "%016llx.%s.spv", (unsigned long long)key, shader_stage_names[stage]);
+    std::string cache_path = compiler->cache_dir + "/" + cache_name;
+    if (load_cached_spirv(cache_path, spirv_out))
+    {
+        shaderc_compile_options_release(options);
+        std::lock_guard<std::mutex> lock(compiler->stats_mutex);
+        compiler->num_cache_hits++;
+        return true;
+    }
+
+    result = shaderc_compile_into_spv(compiler->compiler, source.data(), source.size(), 
+        shader_stage_kinds[stage], path.c_str(), "main", options);
+    ok = shaderc_result_get_compilation_status(result) == shaderc_compilation_status_success;
+    if (ok)
+    {
+        size_t size = shaderc_result_get_length(result);
+        spirv_out.resize(size / sizeof(u32));
+        TMEMCPY(spirv_out.data(), shaderc_result_get_bytes(result), size);
+        write_file_atomic(cache_path.c_str(), spirv_out.data(), size);
+        std::lock_guard<std::mutex> lock(compiler->stats_mutex);
+        compiler->num_compiled++;
+    }
+    else
+    {
+        LOG_ERROR("Failed to compile %s:\n%s", path.c_str(), shaderc_result_get_error_message(result));
+    }
+    shaderc_result_release(result);
+    shaderc_compile_options_release(options);
+    return ok;
+}
+
+// ===== hot reload
+
+struct ShaderHotReload
+{
+    ShaderCompiler* compiler = nullptr;
+    std::vector<ShaderWatch> watches = {};
+    std::vector<std::string> watched_files = {}; // the watches' files, then the includes
+    std::vector<std::filesystem::file_time_type> write_times = {}; // per watched file
+    std::thread thread = {};
+    std::mutex mutex = {};
+    std::condition_variable wake = {};
+    bool stop = false;
+    // filled by the watcher thread, handed out by poll
+    bool ready = false;
+    std::vector<std::vector<u32>> spirv = {};
+};
+
+static std::filesystem::file_time_type shader_write_time(const ShaderHotReload* reload, u32 file)
+{
+    std::error_code error = {};
+    // editors often replace the file on save, so it can briefly not exist. That just counts as no change
+    auto time = std::filesystem::last_write_time(reload->watched_files[file], error);
+    return error ? reload->write_times[file] : time;
+}
+
+static void shader_hot_reload_thread(ShaderHotReload* reload)
+{
+    tiny_profile_set_thread_name("Shader hot reload");
+    std::unique_lock<std::mutex> lock(reload->mutex);
+    while (!reload->stop)
+    {
+        reload->wake.wait_for(lock, std::chrono::milliseconds(SHADER_WATCH_INTERVAL_MS));
+        if (reload->stop)
+        {
+            break;
+        }
+        lock.unlock();
+        bool changed = false;
+        for (u32 i = 0; i < reload->watched_files.size(); i++)
+        {
+            auto time = shader_write_time(reload, i);
+            if (time != reload->write_times[i])
+            {
+                reload->write_times[i] = time;
+                changed = true;
+            }
+        }
+        if (changed)
+        {
+            TINY_PROFILE_SCOPE("shader_hot_reload_compile");
+            // unchanged shaders come straight out of the spirv cache. A failed compile keeps whatever's running
+            std::vector<std::vector<u32>> spirv(reload->watches.size());
+            bool ok = true;
+            for (u32 i = 0; i < reload->watches.size() && ok; i++)
+            {
+                const ShaderWatch& watch = reload->watches[i];
+                ok = shader_compile(reload->compiler, watch.filename, watch.stage, watch.defines, watch.num_defines, spirv[i]);
+            }
+            if (ok)
+            {
+                LOG_INFO("Shaders recompiled");
+                lock.lock();
+                reload->spirv = std::move(spirv);
+                reload->ready = true;
+                continue;
+            }
+        }
+        lock.lock();
+    }
+}
+
+ShaderHotReload* shader_hot_reload_start(
+    ShaderCompiler* compiler, 
+    const ShaderWatch* watches, 
+    u32 num_watches, 
+    const char* const* includes, 
+    u32 num_includes)
+{
+    if (compiler == nullptr)
+    {
+        return nullptr;
+    }
+    ShaderHotReload* reload = new ShaderHotReload();
+    reload->compiler = compiler;
+    reload->watches.assign(watches, watches + num_watches);
+    for (u32 i = 0; i < num_watches; i++)
+    {
+        reload->watched_files.push_back(compiler->source_dir + watches[i].filename);
+    }
+    for (u32 i = 0; i < num_includes; i++)
+    {
+        reload->watched_files.push_back(compiler->source_dir + includes[i]);
+    }
+    reload->write_times.resize(reload->watched_files.size());
+    for (u32 i = 0; i < reload->watched_files.size(); i++)
+    {
+        reload->write_times[i] = shader_write_time(reload, i);
+    }
+    reload->thread = std::thread(shader_hot_reload_thread, reload);
+    return reload;
+}
+
+void shader_hot_reload_stop(ShaderHotReload* reload)
+{
+    if (reload == nullptr)
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(reload->mutex);
+        reload->stop = true;
+    }
+    reload->wake.notify_all();
+    reload->thread.join();
+    delete reload;
+}
+
+bool shader_hot_reload_poll(ShaderHotReload* reload, std::vector<u32>* spirv_out)
+{
+    if (reload == nullptr)
+    {
+        return false;
+    }
+    // try_lock so the render thread never sits behind the watcher
+    std::unique_lock<std::mutex> lock(reload->mutex, std::try_to_lock);
+    if (!lock.owns_lock() || !reload->ready)
+    {
+        return false;
+    }
+    for (u32 i = 0; i < reload->spirv.size(); i++)
+    {
+        spirv_out[i] = std::move(reload->spirv[i]);
+    }
+    reload->ready = false;
+    return true;
+}
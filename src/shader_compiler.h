@@ -0,0 +1,63 @@
+#pragma once
+
+#include "defines.h"
+
+#include <vector>
+
+// compiles GLSL to SPIR-V at runtime through shaderc, instead of relying on prebuilt .spv files.
+// Every result is cached on disk under a hash of (source, stage, defines, compiler version),
+// so only shaders that actually changed ever hit the compiler. #include "file" is resolved relative to the source dir
+// and is part of the hash, since the key is taken from the preprocessed source.
+// The hot reloader watches source files on a background thread and recompiles them as soon as they're saved
+
+enum ShaderStage
+{
+    SHADER_STAGE_VERTEX = 0,
+    SHADER_STAGE_FRAGMENT,
+    SHADER_STAGE_COMPUTE,
+
+    SHADER_STAGE_COUNT,
+};
+
+struct ShaderDefine
+{
+    const char* name = nullptr;
+    const char* value = nullptr; // null = defined with no value
+};
+
+struct ShaderCompiler;
+
+// source_dir is where shader filenames are looked up, spirv goes in cache_dir (created if needed)
+ShaderCompiler* shader_compiler_init(const char* source_dir, const char* cache_dir);
+void shader_compiler_destroy(ShaderCompiler* compiler);
+// safe to call from multiple threads. On failure the error is logged and spirv_out is left untouched
+bool shader_compile(
+    ShaderCompiler* compiler,
+    const char* filename,
+    ShaderStage stage,
+    const ShaderDefine* defines,
+    u32 num_defines,
+    std::vector<u32>& spirv_out);
+
+struct ShaderWatch
+{
+    const char* filename = nullptr;
+    ShaderStage stage = SHADER_STAGE_VERTEX;
+    // compiled with these every time. Must outlive the hot reloader
+    const ShaderDefine* defines = nullptr;
+    u32 num_defines = 0;
+};
+
+struct ShaderHotReload;
+
+// polls the watched files' (and the includes they share) write times on its own thread. When any of them changes, 
+// all of the watches get (re)compiled and the results are held until the render thread picks them up
+ShaderHotReload* shader_hot_reload_start(
+    ShaderCompiler* compiler, 
+    const ShaderWatch* watches, 
+    u32 num_watches, 
+    const char* const* includes, 
+    u32 num_includes);
+void shader_hot_reload_stop(ShaderHotReload* reload);
+// never blocks on a compile. Returns true (once per successful rebuild) with spirv_out[i] matching watches[i]
+bool shader_hot_reload_poll(ShaderHotReload* reload, std::vector<u32>* spirv_out);
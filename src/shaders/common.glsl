@@ -0,0 +1,879 @@
+// shared by every pass that raymarches the scene or the clouds. Included, never compiled on its own
+
+struct CloudData 
+{
+    vec4 cameraOffset;
+    //     ( pointMagnitudeScalar, cloudDensityNoiseScalar, cloudDensityNoiseFreq, cloudDensityPointLengthFreq )
+    vec4 cloudDensityParams;
+    vec4 sun_dir_and_time;
+};
+
+layout(set = 0, binding = 0) uniform uniform_buffer_obj {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+    vec4 resolution; // xy = full res framebuffer size, z = cloud pass downsample factor
+    CloudData cloud;
+    vec4 prevCameraOffset; // camera the cloud history was rendered with
+    vec4 temporal; // x = frame index, y = 1 if the cloud history can be reprojected
+    vec4 lightGridUpdate; // x = first z slice light_grid.comp updates this frame, y = stride between updated slices
+    vec4 lod; // x = fbm LOD bias in octaves, positive drops detail sooner
+    vec4 debug; // x = step heatmap mode (STEP_HEATMAP_*), y = frame slot the step counters go to
+} ubo;
+
+// tileable noise volumes baked at startup (noise_bake.h), repeat-sampled
+layout(set = 0, binding = 1) uniform sampler3D noiseShape;
+layout(set = 0, binding = 2) uniform sampler3D noiseDetail;
+// sun transmittance over the cloud volume, written by light_grid.comp. White border, outside the grid is fully lit
+layout(set = 0, binding = 3) uniform sampler3D lightGridTransmittance;
+// min/max density per cell over the light grid box, mip pyramid (occupancy.comp). r = min, g = max. Only texelFetch'd
+layout(set = 0, binding = 4) uniform sampler3D occupancy;
+// the ground, baked once (TerrainMap in vulkan_main.h). r = height, gb = height gradient (d/dx, d/dz), a = fbm the ground is colored by
+layout(set = 0, binding = 5) uniform sampler2D terrainMap;
+// r = min, g = max height, mip pyramid (terrain_minmax.comp). Level 0 texel c covers the bilinear patch between map texels c and c + 1.
+// Only texelFetch'd
+layout(set = 0, binding = 6) uniform sampler2D terrainMinMax;
+// tangent of the horizon elevation around each texel (terrain_horizon.comp). 4 directions per layer, see terrain_horizon_shadow
+layout(set = 0, binding = 7) uniform sampler2DArray terrainHorizon;
+// static geometry's signed distance, baked (sdf_bake.comp) over SDF_CENTER +- SDF_HALF_EXTENT. Clamped to the narrow band
+layout(set = 0, binding = 8) uniform sampler3D sdfVolume;
+// a texel per SDF_BRICK_SIZE^3 voxels (sdf_bricks.comp). g = 1 if the brick is in the band, otherwise r = +-band. Only texelFetch'd
+layout(set = 0, binding = 9) uniform sampler3D sdfBricks;
+
+// march step counters (StepStats in step_stats.h). Every marcher counts its loop iterations into marchSteps,
+// and while a heatmap is on each pass adds its rays' counts into this frame slot's totals and histograms
+#define STEP_COUNTER_RAYMARCH 0
+#define STEP_COUNTER_SHADOWS 1
+#define STEP_COUNTER_CLOUDS 2
+#define STEP_COUNTER_LIGHT 3
+#define STEP_COUNTER_COUNT 4
+#define STEP_HISTOGRAM_BINS 16
+#define STEP_HEATMAP_OFF 0
+#define STEP_HEATMAP_SCENE 1
+#define STEP_HEATMAP_CLOUDS 2
+struct StepStatsData
+{
+    uint maxSteps[STEP_COUNTER_COUNT];
+    uint invocations[STEP_COUNTER_COUNT];
+    uint steps[STEP_COUNTER_COUNT];
+    uint histogram[STEP_COUNTER_COUNT * STEP_HISTOGRAM_BINS];
+};
+// fragment shaders are built with NO_FRAGMENT_STORES on devices without fragmentStoresAndAtomics, where they can't
+// write storage buffers at all. They still count into marchSteps (so their heatmap works), the totals just aren't recorded
+#ifdef NO_FRAGMENT_STORES
+layout(set = 0, binding = 10, std430) readonly buffer step_stats_buffer
+#else
+layout(set = 0, binding = 10, std430) buffer step_stats_buffer
+#endif
+{
+    StepStatsData frames[]; // one per frame slot
+} stepStats;
+
+int marchSteps[STEP_COUNTER_COUNT] = int[](0, 0, 0, 0);
+
+int step_heatmap_mode()
+{
+    return int(ubo.debug.x);
+}
+
+// adds this invocation's count for counter into the frame's totals. maxSteps is the loop's bound, the histogram spans 0..maxSteps
+void step_stats_record(int counter, int maxSteps)
+{
+#ifndef NO_FRAGMENT_STORES
+    if (step_heatmap_mode() == STEP_HEATMAP_OFF)
+    {
+        return;
+    }
+    uint slot = uint(ubo.debug.y);
+    int steps = marchSteps[counter];
+    int bin = min(steps * STEP_HISTOGRAM_BINS / (maxSteps + 1), STEP_HISTOGRAM_BINS - 1);
+    stepStats.frames[slot].maxSteps[counter] = uint(maxSteps);
+    atomicAdd(stepStats.frames[slot].invocations[counter], 1u);
+    atomicAdd(stepStats.frames[slot].steps[counter], uint(steps));
+    atomicAdd(stepStats.frames[slot].histogram[counter * STEP_HISTOGRAM_BINS + bin], 1u);
+#endif
+}
+
+// false color for x in 0..1: blue (few steps) through green and yellow to red (at the bound)
+vec3 step_heatmap(float x)
+{
+    x = clamp(x, 0.0, 1.0);
+    return clamp(vec3(4.0 * x - 2.0, 2.0 - abs(4.0 * x - 2.0), 2.0 - 4.0 * x), 0.0, 1.0);
+}
+
+// quality knobs, set per pipeline through specialization constants (see ShaderQuality in vulkan_main.h).
+// The defaults here are the "high" preset
+layout(constant_id = 0) const int MAX_STEPS = 30;
+layout(constant_id = 1) const int CLOUD_SAMPLE_COUNT = 64;
+layout(constant_id = 2) const int LIGHT_SAMPLE_COUNT = 3;
+layout(constant_id = 3) const bool USE_LIGHT = true;
+layout(constant_id = 4) const int FBM_OCTAVES = 12;
+// clouds read the baked noise volumes instead of evaluating fbm() per sample. Off = procedural reference
+layout(constant_id = 5) const bool BAKED_NOISE = true;
+// over-relaxed sphere tracing in raymarch(). Off = plain sphere tracing
+layout(constant_id = 6) const bool RELAXED_TRACING = true;
+// the scene pass starts its rays where scene_cone.comp's tile cone got to. Off = every ray starts at the camera
+layout(constant_id = 7) const bool CONE_PREPASS = true;
+
+#define PI 3.14159265359
+
+float hash(float n)
+{
+    return fract(sin(n) * 43758.5453);
+}
+float noise(in vec3 x)
+{
+    vec3 p = floor(x);
+    vec3 f = fract(x);
+    
+    f = f * f * (3.0 - 2.0 * f);
+    
+    float n = p.x + p.y * 57.0 + 113.0 * p.z;
+    
+    float res = mix(mix(mix(hash(n +   0.0), hash(n +   1.0), f.x),
+                        mix(hash(n +  57.0), hash(n +  58.0), f.x), f.y),
+                    mix(mix(hash(n + 113.0), hash(n + 114.0), f.x),
+                        mix(hash(n + 170.0), hash(n + 171.0), f.x), f.y), f.z);
+    return res;
+}
+
+float gettime()
+{
+    return ubo.cloud.sun_dir_and_time.w;
+}
+vec3 get_sun_dir()
+{
+    return normalize(ubo.cloud.sun_dir_and_time.xyz);
+}
+
+vec3 camera_origin(vec3 cameraOffset)
+{
+    return normalize(cameraOffset) * 40.0;
+}
+
+// world space size of a pixel dist units away from the camera. pixelSize in full res pixels.
+// camera_ray's image plane is 1 unit high at unit distance
+float pixel_footprint(float dist, float pixelSize)
+{
+    return dist * pixelSize / ubo.resolution.y;
+}
+
+
+#define SURF_EPSILON 0.001
+#define MAX_DIST 100.0
+// how far past the safe sphere a relaxed step goes. Steps that overshoot get caught and redone at 1
+#define RELAXATION 1.6
+// CONE_TILE_SIZE in vulkan_main.h
+#define CONE_TILE_SIZE 8
+
+// surfaces only need to be found to within a pixel. Far away that's a lot more than SURF_EPSILON,
+// and it's what saves the most steps on rays grazing the ground
+float hit_epsilon(float t)
+{
+    return max(SURF_EPSILON, pixel_footprint(t, 0.5));
+}
+
+mat2 rotate2D(float a) 
+{
+    float sa = sin(a);
+    float ca = cos(a);
+    return mat2(ca, -sa, sa, ca);
+}
+
+mat3 rotate3DX(float angle)
+{
+    float c = cos(angle);
+    float s = sin(angle);
+    return mat3(1,  0, 0,
+                0,  c, -s,
+                0,  s, c);
+}
+
+mat3 rotate3DY(float angle)
+{
+    float c = cos(angle);
+    float s = sin(angle);
+    return mat3(c,  0,  s,
+                0,  1,  0,
+                -s, 0,  c);
+}
+
+mat3 rotate3DZ(float angle)
+{
+    float c = cos(angle);
+    float s = sin(angle);
+    return mat3(c, -s, 0,
+                s, c,  0,
+                0, 0,  1);
+}
+
+vec3 repeat(vec3 p, float c) 
+{
+    return mod(p,c) - 0.5 * c; // (0.5 *c centers the tiling around the origin)
+}
+
+float remap(float value, float min1, float max1, float min2, float max2) 
+{
+    return min2 + (value - min1) * (max2 - min2) / (max1 - min1);
+}
+
+// footprint is the size of what's being shaded in p's units (0 = every octave). Octaves whose lattice is finer than
+// about 2 footprints would only alias, so they're faded out and replaced by their mean (noise() averages 0.5).
+// The result averages the same at every LOD, only the detail goes
+float fbm(vec3 p, float footprint) 
+{
+    footprint *= exp2(ubo.lod.x);
+    float res = 0.0;
+    float amp = 0.8;
+    float freq = 1.5;
+    float scale = 0.8; // lattice cells per unit of p this octave
+    for(int i = 0; i < FBM_OCTAVES; i++) {
+        // full detail while a cell spans 4+ footprints, gone at 2
+        float fade = clamp(2.0 - 4.0 * footprint * scale, 0.0, 1.0);
+        if (fade <= 0.0)
+        {
+            // every octave left is finer still. amp halves each octave
+            res += 0.5 * amp * 2.0 * (1.0 - exp2(float(i - FBM_OCTAVES)));
+            break;
+        }
+        res += amp * mix(0.5, noise(p * 0.8), fade);
+        amp *= 0.5;
+        freq *= 1.05;
+        p = p * freq * rotate3DZ(PI / 4.0);
+        scale *= freq;
+    }
+    return res;
+}
+
+// world units one tile of the baked volumes covers
+#define BAKED_NOISE_PERIOD 8.0
+// brings the baked mean up to roughly fbm()'s, so the density params look the same either way
+#define BAKED_NOISE_SCALE 1.2
+
+// coarsest feature of the detail volume, in p's units: a tile is BAKED_NOISE_PERIOD / 4, split into 8 cells
+#define BAKED_DETAIL_CELL (BAKED_NOISE_PERIOD / 32.0)
+
+// stand-in for fbm() in the cloud density: 2 filtered fetches instead of FBM_OCTAVES value noise evaluations.
+// footprint as in fbm(). The detail fetch fades to its mean (and is skipped) once its features get below a couple of footprints
+float baked_fbm(vec3 p, float footprint)
+{
+    footprint *= exp2(ubo.lod.x);
+    vec3 uvw = p / BAKED_NOISE_PERIOD;
+    float shape = textureLod(noiseShape, uvw, 0.0).r;
+    float detailFade = clamp(2.0 - 4.0 * footprint / BAKED_DETAIL_CELL, 0.0, 1.0);
+    float detail = detailFade > 0.0 ? mix(0.5, textureLod(noiseDetail, uvw * 4.0, 0.0).r, detailFade) : 0.5;
+    return (shape * 0.75 + detail * 0.25) * BAKED_NOISE_SCALE;
+}
+
+// NOTE: sdf's conventionally return negative inside an object and positive outside the object
+float sdfBox(vec3 p, vec3 b) 
+{
+    vec3 q = abs(p) - b;
+    return length(max(q, 0.0)) + min(max(q.x, max(q.y, q.z)), 0.0);
+}
+
+float sdfSphere(vec3 p, float radius)
+{
+    return length(p) - radius;
+}
+
+vec4 sdfMin(vec4 obj1, vec4 obj2)
+{
+    return obj1.w < obj2.w ? obj1 : obj2;
+}
+
+// NOTE: to self, to translate you must move in the *opposite* direction to the desired position
+// imagine yourself as a point in a raymarched scene with a sphere: if you take 2 steps to the right, the sphere will appear to you two steps further to the left
+// scaling is also odd.  
+// the animated objects only. The ground is baked: scene_static() to sphere trace it, terrain_trace() for exact hits
+vec4 scene(vec3 point)
+{
+    float time = gettime();
+    vec3 objColor = vec3(1.0, 0, 0);
+    float objSdf = sdfSphere(point + vec3(10,0,0)*sin(time), 1.0);
+    vec4 obj1 = vec4(objColor, objSdf);
+    return obj1;
+}
+
+// the square the terrain maps cover, centered on the origin. Past it the ground is the flat TERRAIN_BASE_HEIGHT plane,
+// the displacement falls off with distance and is down to about 1% of a unit by the edge
+#define TERRAIN_HALF_EXTENT 64.0
+#define TERRAIN_BASE_HEIGHT -1.0
+// TERRAIN_MINMAX_LEVELS in vulkan_main.h
+#define TERRAIN_MINMAX_LEVELS 8
+#define TERRAIN_MAX_STEPS 160
+#define TERRAIN_REFINE_STEPS 6
+
+vec3 terrain_color(float noise)
+{
+    vec3 planeColor = vec3(246,215,176)/255.0;
+    return mix(planeColor, vec3(225,191,146)/255.0, noise);
+}
+
+vec2 terrain_uv(vec2 xz)
+{
+    return xz / (2.0 * TERRAIN_HALF_EXTENT) + 0.5;
+}
+
+bool terrain_inside(vec2 xz)
+{
+    return all(lessThanEqual(abs(xz), vec2(TERRAIN_HALF_EXTENT)));
+}
+
+// what terrain_bake.comp bakes: the base plane pushed down by fbm, falling off with distance from the origin.
+// fbm is evaluated on the undisplaced plane. footprint as in fbm()
+float terrain_height(vec2 xz, float footprint, out float noise)
+{
+    vec3 p = vec3(xz.x, TERRAIN_BASE_HEIGHT, xz.y);
+    noise = fbm(p, footprint);
+    return TERRAIN_BASE_HEIGHT - noise / length(p);
+}
+
+// ray height above the bilinear heightfield at t
+float terrain_clearance(vec3 rayOrigin, vec3 rayDirection, float t)
+{
+    vec3 p = rayOrigin + rayDirection * t;
+    return p.y - textureLod(terrainMap, terrain_uv(p.xz), 0.0).r;
+}
+
+// crossing between tAbove (ray over the heightfield) and tBelow (under it): bisection, then a secant step between the last two
+float terrain_refine(vec3 rayOrigin, vec3 rayDirection, float tAbove, float tBelow)
+{
+    float fAbove = terrain_clearance(rayOrigin, rayDirection, tAbove);
+    float fBelow = terrain_clearance(rayOrigin, rayDirection, tBelow);
+    for (int i = 0; i < TERRAIN_REFINE_STEPS; i++)
+    {
+        float tMid = (tAbove + tBelow) * 0.5;
+        float fMid = terrain_clearance(rayOrigin, rayDirection, tMid);
+        if (fMid > 0.0)
+        {
+            tAbove = tMid;
+            fAbove = fMid;
+        }
+        else
+        {
+            tBelow = tMid;
+            fBelow = fMid;
+        }
+    }
+    return mix(tAbove, tBelow, clamp(fAbove / max(fAbove - fBelow, 1e-6), 0.0, 1.0));
+}
+
+// first crossing of the ray with the heightfield between tStart and tEnd (both inside the square), tEnd if there is none.
+// Walks the min/max pyramid: a cell the ray passes over whole is skipped in one step (and the walk moves up a level,
+// the next cell is likely clear too), a cell it dips into below its max is looked at a level down.
+// Cells are in level 0 patch units: the heightfield's texel centers sit on integer coordinates
+float terrain_trace_square(vec3 rayOrigin, vec3 rayDirection, float tStart, float tEnd)
+{
+    float mapSize = float(textureSize(terrainMap, 0).x);
+    float texelWorld = 2.0 * TERRAIN_HALF_EXTENT / mapSize;
+    vec2 cellOrigin = (rayOrigin.xz + TERRAIN_HALF_EXTENT) / texelWorld - 0.5;
+    vec2 cellDirection = rayDirection.xz / texelWorld;
+    vec2 safeDirection = mix(vec2(1e-6), cellDirection, greaterThan(abs(cellDirection), vec2(1e-6)));
+    vec2 farSide = step(0.0, cellDirection);
+    int level = TERRAIN_MINMAX_LEVELS - 1;
+    float t = tStart;
+    for (int i = 0; i < TERRAIN_MAX_STEPS && t < tEnd; i++)
+    {
+        float cellSize = float(1 << level);
+        ivec2 cell = ivec2(floor((cellOrigin + cellDirection * t) / cellSize));
+        cell = clamp(cell, ivec2(0), textureSize(terrainMinMax, level) - 1);
+        vec2 minMax = texelFetch(terrainMinMax, cell, level).rg;
+        vec2 tFar = ((vec2(cell) + farSide) * cellSize - cellOrigin) / safeDirection;
+        float tExit = min(min(tFar.x, tFar.y), tEnd);
+        float yEnter = rayOrigin.y + rayDirection.y * t;
+        float yExit = rayOrigin.y + rayDirection.y * tExit;
+        if (min(yEnter, yExit) > minMax.g)
+        {
+            // nudged past the boundary so the next lookup lands in the next cell
+            t = tExit + max(1e-4, tExit * 1e-5);
+            level = min(level + 1, TERRAIN_MINMAX_LEVELS - 1);
+            continue;
+        }
+        if (level > 0)
+        {
+            // dips under the max somewhere in here. Nothing to hit before it gets down to it
+            if (yEnter > minMax.g)
+            {
+                t = (minMax.g - rayOrigin.y) / rayDirection.y;
+            }
+            level--;
+            continue;
+        }
+        // one bilinear patch. The height along the ray is quadratic in here, so a crossing that dips in and back out
+        // between entry and exit shows up at the midpoint
+        if (terrain_clearance(rayOrigin, rayDirection, t) <= 0.0)
+        {
+            return t;
+        }
+        float tMid = (t + tExit) * 0.5;
+        if (yExit <= minMax.r || terrain_clearance(rayOrigin, rayDirection, tExit) <= 0.0)
+        {
+            return terrain_refine(rayOrigin, rayDirection, t, tExit);
+        }
+        if (terrain_clearance(rayOrigin, rayDirection, tMid) <= 0.0)
+        {
+            return terrain_refine(rayOrigin, rayDirection, t, tMid);
+        }
+        t = tExit + max(1e-4, tExit * 1e-5);
+    }
+    return tEnd;
+}
+
+// distance along the ray to the ground, tMax if it's not hit before that. Nothing is looked for before tMin.
+// Inside the square that's the heightfield, past it the flat base plane
+float terrain_trace(vec3 rayOrigin, vec3 rayDirection, float tMin, float tMax)
+{
+    float tHit = tMax;
+    if (rayDirection.y < 0.0)
+    {
+        // the heightfield is all at or under the base plane, so the plane outside the square can't hide anything inside it
+        float tPlane = (TERRAIN_BASE_HEIGHT - rayOrigin.y) / rayDirection.y;
+        if (tPlane > tMin && tPlane < tHit && !terrain_inside(rayOrigin.xz + rayDirection.xz * tPlane))
+        {
+            tHit = tPlane;
+        }
+    }
+    vec2 safeDirection = mix(vec2(1e-6), rayDirection.xz, greaterThan(abs(rayDirection.xz), vec2(1e-6)));
+    vec2 t0 = (-TERRAIN_HALF_EXTENT - rayOrigin.xz) / safeDirection;
+    vec2 t1 = (TERRAIN_HALF_EXTENT - rayOrigin.xz) / safeDirection;
+    vec2 tNear = min(t0, t1);
+    vec2 tFar = max(t0, t1);
+    float tEnter = max(max(tNear.x, tNear.y), tMin);
+    float tExit = min(min(tFar.x, tFar.y), tHit);
+    if (tExit > tEnter)
+    {
+        tHit = min(tHit, terrain_trace_square(rayOrigin, rayDirection, tEnter, tExit));
+    }
+    return tHit;
+}
+
+// the box the static sdf volume covers. Holds all of the ground's relief the sphere can get near
+#define SDF_CENTER vec3(0.0, -1.0, 0.0)
+#define SDF_HALF_EXTENT vec3(16.0, 4.0, 16.0)
+// SDF_BRICK_SIZE in vulkan_main.h
+#define SDF_BRICK_SIZE 8
+
+vec3 sdf_uvw(vec3 point)
+{
+    return (point - SDF_CENTER) / (2.0 * SDF_HALF_EXTENT) + 0.5;
+}
+vec3 sdf_voxel_pos(ivec3 voxel, ivec3 size)
+{
+    return SDF_CENTER + ((vec3(voxel) + 0.5) / vec3(size) - 0.5) * (2.0 * SDF_HALF_EXTENT);
+}
+// distance the volume keeps exact values up to: a brick's width
+float sdf_band(ivec3 size)
+{
+    return float(SDF_BRICK_SIZE) * 2.0 * SDF_HALF_EXTENT.x / float(size.x);
+}
+
+// signed distance to the static geometry (the ground). Exact-ish in the band, a lower bound anywhere else,
+// which is all sphere tracing needs. Costs a fetch or two instead of a heightfield trace
+float scene_static(vec3 point)
+{
+    // all of the ground is at or under the base plane, so the height above it bounds the distance anywhere.
+    // Past the square that's the exact distance
+    float aboveBase = point.y - TERRAIN_BASE_HEIGHT;
+    vec3 uvw = sdf_uvw(point);
+    if (any(lessThan(uvw, vec3(0.0))) || any(greaterThan(uvw, vec3(1.0))))
+    {
+        return aboveBase;
+    }
+    ivec3 bricksSize = textureSize(sdfBricks, 0);
+    vec2 brick = texelFetch(sdfBricks, min(ivec3(uvw * vec3(bricksSize)), bricksSize - 1), 0).rg;
+    if (brick.g == 0.0)
+    {
+        // nowhere near the surface
+        return brick.r > 0.0 ? max(brick.r, aboveBase) : brick.r;
+    }
+    return textureLod(sdfVolume, uvw, 0.0).r;
+}
+
+// 1 lit, 0 shadowed by the terrain around xz (a point on the ground). The horizon map holds the highest elevation
+// the ground rises to in TERRAIN_HORIZON_DIRECTIONS azimuths, the sun is compared against it between the nearest two
+#define TERRAIN_HORIZON_DIRECTIONS 8
+float terrain_horizon_shadow(vec2 xz, vec3 sunDir)
+{
+    if (!terrain_inside(xz))
+    {
+        return 1.0;
+    }
+    float sunTan = sunDir.y / max(length(sunDir.xz), 1e-4);
+    // direction k of the map looks along (cos, sin) of k * 2pi / TERRAIN_HORIZON_DIRECTIONS in xz
+    float azimuth = fract(atan(sunDir.z, sunDir.x) / (2.0 * PI)) * float(TERRAIN_HORIZON_DIRECTIONS);
+    int k0 = int(azimuth) % TERRAIN_HORIZON_DIRECTIONS;
+    int k1 = (k0 + 1) % TERRAIN_HORIZON_DIRECTIONS;
+    vec2 uv = terrain_uv(xz);
+    vec4 layer0 = textureLod(terrainHorizon, vec3(uv, 0.0), 0.0);
+    vec4 layer1 = textureLod(terrainHorizon, vec3(uv, 1.0), 0.0);
+    float horizon[TERRAIN_HORIZON_DIRECTIONS] = float[](layer0.x, layer0.y, layer0.z, layer0.w, layer1.x, layer1.y, layer1.z, layer1.w);
+    float horizonTan = mix(horizon[k0], horizon[k1], fract(azimuth));
+    // a little penumbra: the directions are coarse, and the sun isn't a point
+    return smoothstep(-0.05, 0.05, sunTan - horizonTan);
+}
+
+// footprint: world space size of the sample, picks the noise LOD
+float cloudDensitySample(vec3 point, float footprint)
+{
+    float timescroll = gettime() * 0.3;
+    float pointMagnitudeScalar = ubo.cloud.cloudDensityParams.x;
+    float cloudDensityNoiseScalar = ubo.cloud.cloudDensityParams.y;
+    float cloudDensityNoiseFreq = ubo.cloud.cloudDensityParams.z;
+    float cloudDensityPointLengthFreq = ubo.cloud.cloudDensityParams.w;
+    // this is generally a sphere shape. Note the similarity to sdfSphere
+    // except here we modulate some of the calculations and use fractal brownian motion for our "sphere" radius
+    // need to invert some operations though since we aren't measuring distance to a surface
+    // we are returning the *density* at some point which is positive in our shape, and <= 0 outside the shape
+    point.y -= 10.0;
+    float sphere = SURF_EPSILON - length(point * cloudDensityPointLengthFreq) * pointMagnitudeScalar;
+    vec3 noisePoint = point * cloudDensityNoiseFreq + timescroll;
+    float noiseFootprint = footprint * cloudDensityNoiseFreq;
+    float noise = (BAKED_NOISE ? baked_fbm(noisePoint, noiseFootprint) : fbm(noisePoint, noiseFootprint)) * cloudDensityNoiseScalar;
+    return sphere + noise;
+}
+
+// how far cloudDensitySample() at footprint can be from the density with every noise octave in, for bounds built from
+// low detail samples (the occupancy grid). A faded octave stands in for its mean 0.5, so it's off by at most half its amplitude
+float cloud_density_lod_error(float footprint)
+{
+    float cloudDensityNoiseScalar = ubo.cloud.cloudDensityParams.y;
+    float cloudDensityNoiseFreq = ubo.cloud.cloudDensityParams.z;
+    float noiseFootprint = footprint * cloudDensityNoiseFreq * exp2(ubo.lod.x);
+    float error = 0.0;
+    if (BAKED_NOISE)
+    {
+        // same fade as baked_fbm(), the shape volume is always fetched in full
+        float detailFade = clamp(2.0 - 4.0 * noiseFootprint / BAKED_DETAIL_CELL, 0.0, 1.0);
+        error = 0.5 * 0.25 * (1.0 - detailFade) * BAKED_NOISE_SCALE;
+    }
+    else
+    {
+        // same octaves and fades as fbm()
+        float amp = 0.8;
+        float freq = 1.5;
+        float scale = 0.8;
+        for (int i = 0; i < FBM_OCTAVES; i++)
+        {
+            float fade = clamp(2.0 - 4.0 * noiseFootprint * scale, 0.0, 1.0);
+            if (fade <= 0.0)
+            {
+                error += 0.5 * amp * 2.0 * (1.0 - exp2(float(i - FBM_OCTAVES)));
+                break;
+            }
+            error += 0.5 * amp * (1.0 - fade);
+            amp *= 0.5;
+            freq *= 1.05;
+            scale *= freq;
+        }
+    }
+    return error * abs(cloudDensityNoiseScalar);
+}
+
+float get_light_transmittance(vec3 rayOrigin, vec3 rayDirection, int cloudSampleCount, int lightSampleCount, float lightSampleMaxZ, float footprint)
+{
+    float lightTransmittance = 1.0;
+    float absorption = 100.0;
+    float stepSize = lightSampleMaxZ / float(lightSampleCount);
+    // step from the point along a ray casted towards the light
+    vec3 lightPoint = rayOrigin;
+    for (int i = 0; i < lightSampleCount; i++)
+    {
+        marchSteps[STEP_COUNTER_LIGHT]++;
+        float densityLight = cloudDensitySample(lightPoint, footprint);
+        // If densityLight is over 0.0, the ray is in an object.
+        if (densityLight > 0.0)
+        {
+            float tmpl = densityLight / float(cloudSampleCount);
+            lightTransmittance *= 1.0 - (tmpl * absorption);
+        }
+        if (lightTransmittance <= 0.01)
+        {
+            break;
+        }
+        lightPoint += rayDirection * stepSize;
+    }
+    return lightTransmittance;
+}
+
+// world space box the light grid covers. Fits the cloud blob at (0,10,0) with the default density params
+#define LIGHT_GRID_CENTER vec3(0.0, 10.0, 0.0)
+#define LIGHT_GRID_HALF_EXTENT 24.0
+
+vec3 light_grid_uvw(vec3 worldPos)
+{
+    return (worldPos - LIGHT_GRID_CENTER) / (2.0 * LIGHT_GRID_HALF_EXTENT) + 0.5;
+}
+vec3 light_grid_texel_pos(ivec3 texel, ivec3 size)
+{
+    vec3 uvw = (vec3(texel) + 0.5) / vec3(size);
+    return LIGHT_GRID_CENTER + (uvw - 0.5) * (2.0 * LIGHT_GRID_HALF_EXTENT);
+}
+
+// OCCUPANCY_LEVELS in vulkan_main.h
+#define OCCUPANCY_LEVELS 4
+
+// distance along the ray until it leaves the biggest empty occupancy cell around point, 0 if the finest cell there may hold cloud.
+// Walks down from the coarsest level, so big empty stretches are crossed in one go
+float occupancy_skip(vec3 point, vec3 rayDirection)
+{
+    vec3 uvw = light_grid_uvw(point);
+    vec3 safeDirection = mix(vec3(1e-6), rayDirection, greaterThan(abs(rayDirection), vec3(1e-6)));
+    for (int level = OCCUPANCY_LEVELS - 1; level >= 0; level--)
+    {
+        ivec3 size = textureSize(occupancy, level);
+        ivec3 cell = clamp(ivec3(uvw * vec3(size)), ivec3(0), size - 1);
+        if (texelFetch(occupancy, cell, level).g > 0.0)
+        {
+            continue; // something in here, look closer
+        }
+        // ray exit out of the cell's box: the nearest of the far faces along each axis
+        vec3 cellSize = vec3(2.0 * LIGHT_GRID_HALF_EXTENT) / vec3(size);
+        vec3 cellMin = LIGHT_GRID_CENTER - LIGHT_GRID_HALF_EXTENT + vec3(cell) * cellSize;
+        vec3 farFace = cellMin + step(0.0, rayDirection) * cellSize;
+        vec3 tFar = (farFace - point) / safeDirection;
+        return max(min(tFar.x, min(tFar.y, tFar.z)), 0.0);
+    }
+    return 0.0;
+}
+
+// where the ray is inside the light grid box. Clouds only exist in there. False if it misses
+bool light_grid_box_range(vec3 rayOrigin, vec3 rayDirection, out float tEnter, out float tExit)
+{
+    vec3 safeDirection = mix(vec3(1e-6), rayDirection, greaterThan(abs(rayDirection), vec3(1e-6)));
+    vec3 t0 = (LIGHT_GRID_CENTER - LIGHT_GRID_HALF_EXTENT - rayOrigin) / safeDirection;
+    vec3 t1 = (LIGHT_GRID_CENTER + LIGHT_GRID_HALF_EXTENT - rayOrigin) / safeDirection;
+    vec3 tMin = min(t0, t1);
+    vec3 tMax = max(t0, t1);
+    tEnter = max(max(tMin.x, tMin.y), max(tMin.z, 0.0));
+    tExit = min(tMax.x, min(tMax.y, tMax.z));
+    return tExit > tEnter;
+}
+
+// cloud march step growth: steps get this much longer per world unit away from the camera
+#define STEP_DISTANCE_GROWTH 0.015
+// a step that landed outside the clouds makes the next one this much longer
+#define EMPTY_STEP_SCALE 2.0
+
+// jitter (0..1) offsets the first sample (and the first after every skip) by that fraction of a step, so frames with different jitter
+// sample between each other's steps.
+// cloudDist is the opacity weighted distance along the ray the light came from, or sceneDepth (clamped) if there are no clouds
+vec4 cloud_march(vec3 rayOrigin, vec3 rayDirection, float sceneDepth, vec3 lightDir, float jitter, out float cloudDist)
+{
+    float time = gettime();
+    float transmittance = 1.0;
+    float absorption = 100.0;
+
+    const int cloudSampleCount = CLOUD_SAMPLE_COUNT;
+    // dividing the max distance our ray can go into discrete MAX_STEPS number of steps
+    // baseStep is how far each of those steps is right at the camera. Further out they grow (STEP_DISTANCE_GROWTH)
+    float baseStep = MAX_DIST / float(cloudSampleCount);
+    float pixelSize = ubo.resolution.z; // the cloud pass runs at 1/downsample res
+
+    vec4 color = vec4(0,0,0,1);
+    float distSum = 0.0;
+    float weightSum = 0.0;
+    float tEnter, tExit;
+    bool hitsBox = light_grid_box_range(rayOrigin, rayDirection, tEnter, tExit);
+    float tEnd = hitsBox ? min(tExit, sceneDepth) : 0.0;
+    float t = tEnter + jitter * baseStep * (1.0 + tEnter * STEP_DISTANCE_GROWTH);
+    // skips count against the budget too. Growing steps mean the samples rarely run out before tEnd
+    for (int i = 0; i < cloudSampleCount * 2; i++)
+    {
+        if (t >= tEnd) break; // depth test, or out the back of the cloud volume
+        marchSteps[STEP_COUNTER_CLOUDS]++;
+        vec3 point = rayOrigin + rayDirection * t;
+        float stepSize = baseStep * (1.0 + t * STEP_DISTANCE_GROWTH);
+        float skip = occupancy_skip(point, rayDirection);
+        if (skip > 0.0)
+        {
+            t += skip + jitter * stepSize;
+            continue;
+        }
+        float densitySample = cloudDensitySample(point, pixel_footprint(t, pixelSize));
+        // outside the clouds, so take a longer step to the next sample
+        if (densitySample <= 0.0)
+        {
+            t += stepSize * EMPTY_STEP_SCALE;
+            continue;
+        }
+        // we are in the volume & have some density here. The sample stands for the stretch of ray up to the next one (stepSize).
+        // tmp is the fraction of light a base step through this density absorbs (/ absorption).
+        // Longer steps compound it (Beer-Lambert), so the result doesn't depend on how the ray was cut up
+        float tmp = densitySample / float(cloudSampleCount);
+        float stepTransmittance = pow(max(1.0 - tmp * absorption, 0.0), stepSize / baseStep);
+        transmittance *= stepTransmittance;
+        // what this step actually absorbed, the same as tmp for a base step. Scattering is proportional to it
+        float stepAbsorbed = (1.0 - stepTransmittance) / absorption;
+        if (transmittance <= 0.01)
+        {
+            // ray has been absorbed by the cloud
+            break;
+        }
+
+        float opacity = 50.0;
+        float k = opacity * stepAbsorbed * transmittance;
+        vec3 cloudColor = mix(vec3(1), vec3(0.5), densitySample);
+        vec3 cloudBase = cloudColor * k;
+        //vec4 cloudBase = vec4(cloudColor, densitySample);
+        vec4 cloudColorIQ = vec4( mix( vec3(1.0,0.93,0.84), vec3(0.25,0.3,0.4), densitySample ), densitySample );
+
+        vec3 cloudLightColor = vec3(0);
+        if (USE_LIGHT) // constant, so the light grid fetch gets compiled out when it's off
+        {
+            // this step along the ray contributes to our final cloud color.
+            // light_grid.comp already marched towards the sun (lightDir) from every grid texel
+            float lightTransmittance = textureLod(lightGridTransmittance, light_grid_uvw(point), 0.0).r;
+            float opacityLight = 80.0;
+            float kl = opacityLight * stepAbsorbed * transmittance * lightTransmittance;
+            vec3 lightColor = vec3(1.0, 0.7, 0.4);
+            cloudLightColor = lightColor * kl;
+        }
+
+        color.rgb += cloudBase.rgb + cloudLightColor;
+        distSum += k * t;
+        weightSum += k;
+        t += stepSize;
+    }
+    color.a = transmittance; // rgb is light scattered towards the camera, a is how much of what's behind still shows through
+    cloudDist = weightSum > 0.0 ? distSum / weightSum : min(sceneDepth, MAX_DIST);
+    return color;
+}
+
+// courtesey of IQ
+// idea is to cast a ray from a point on a surface toward the light dir
+// and take steps through the scene to see if we intersect anything
+// if we do intersect, we are in shadow.
+// Sees the objects and the baked static geometry
+float softShadows(vec3 ro, vec3 rd, float mint, float maxt, float k) 
+{
+    float resultingShadowColor = 1.0;
+    float t = mint;
+    for (int i = 0; i < MAX_STEPS && t < maxt; i++) 
+    {
+        marchSteps[STEP_COUNTER_SHADOWS]++;
+        vec3 p = ro + rd*t;
+        float h = min(scene(p).w, scene_static(p));
+        if(h < SURF_EPSILON)
+        {
+            return 0.0;
+        }
+        resultingShadowColor = min(resultingShadowColor, k*h/t );
+        t += h;
+    }
+    return resultingShadowColor;
+}
+
+vec3 getNormal(in vec3 p) 
+{
+    vec2 e = vec2(.01, 0);
+    vec3 n = scene(p).w - vec3(
+        scene(p-e.xyy).w,
+        scene(p-e.yxy).w,
+        scene(p-e.yyx).w);
+    return normalize(n);
+}
+
+// rgb = color of the surface hit, w = distance to it (> MAX_DIST if nothing was). Sphere traces the objects and the baked
+// static sdf together, then the heightfield trace pins the ground down exactly, starting from wherever the sphere trace
+// got to. Usually that's right at the ground, leaving a few cells of the min/max walk.
+// tStart is how far along the ray is known to be empty (see scene_cone.comp), 0 if nothing is known.
+// With RELAXED_TRACING each step goes RELAXATION times the safe distance. That's only safe as long as the unbounding spheres
+// of consecutive points overlap, if they don't the step may have jumped over something and is redone as a plain one
+vec4 raymarch(vec3 rayOrigin, vec3 rayDirection, float tStart, out bool terrainHit)
+{
+    vec4 objHit = vec4(vec3(0.0), MAX_DIST + 1.0);
+    float t = tStart;
+    float tGround = tStart; // the ground can't be any closer than this
+    float omega = RELAXED_TRACING ? RELAXATION : 1.0;
+    float prevRadius = 0.0;
+    float stepLength = 0.0;
+    for (int i = 0; i < MAX_STEPS; i++)
+    {
+        marchSteps[STEP_COUNTER_RAYMARCH]++;
+        vec3 point = rayOrigin + rayDirection * t;
+        vec4 distanceToSurface = scene(point);
+        float staticDist = scene_static(point);
+        float radius = min(distanceToSurface.w, staticDist);
+        if (omega > 1.0 && radius + prevRadius < stepLength)
+        { // overshot, go back to where a plain step would've landed and stop relaxing
+            t += prevRadius - stepLength;
+            stepLength = prevRadius;
+            omega = 1.0;
+            continue;
+        }
+        float epsilon = hit_epsilon(t);
+        if (distanceToSurface.w < epsilon)
+        { // hit a surface
+            objHit = vec4(distanceToSurface.rgb, t);
+            break;
+        }
+        if (staticDist < epsilon)
+        { // at the ground, give or take the volume's filtering
+            break;
+        }
+        tGround = t;
+        prevRadius = radius;
+        stepLength = radius * omega;
+        t += stepLength;
+        if (t > MAX_DIST)
+        { // gone too far
+            break;
+        }
+    }
+    float terrainDist = terrain_trace(rayOrigin, rayDirection, tGround, min(objHit.w, MAX_DIST + 1.0));
+    terrainHit = terrainDist < objHit.w;
+    if (!terrainHit)
+    {
+        return objHit;
+    }
+    vec2 xz = rayOrigin.xz + rayDirection.xz * terrainDist;
+    return vec4(terrain_color(textureLod(terrainMap, terrain_uv(xz), 0.0).a), terrainDist);
+}
+
+
+// lookAt
+mat3 camera(vec3 rayOrigin, vec3 target)
+{
+    vec3 cw = normalize(rayOrigin - target);
+    vec3 cp = vec3(0.0, 1.0, 0.0);
+    vec3 cu = cross(cw, cp);
+    vec3 cv = cross(cu, cw);
+    return mat3(cu, cv, cw);
+}
+
+#define CAMERA_TARGET vec3(0,1,0)
+
+// ray through a framebuffer pixel (top left origin, in full res pixels)
+void camera_ray(vec2 fragCoord, out vec3 rayOrigin, out vec3 rayDirection)
+{
+    vec2 resolution = ubo.resolution.xy;
+    vec2 uv = fragCoord / resolution;
+    uv.y = 1.0 - uv.y; // vulkan doesn't flip - opengl does. pretending to be opengl rn
+    uv -= 0.5;
+    uv.x *= resolution.x / resolution.y;
+    // raymarching setup
+    rayOrigin = camera_origin(ubo.cloud.cameraOffset.xyz);
+    // rays in every direction on the screen along the negative z axis
+    mat3 cam = camera(rayOrigin, CAMERA_TARGET);
+    rayDirection = normalize(cam * normalize(vec3(uv, -1.0)));
+}
+
+// inverse of camera_ray for a camera at cameraOffset. False if the point is behind it
+bool camera_project(vec3 worldPos, vec3 cameraOffset, out vec2 fragCoord)
+{
+    vec3 rayOrigin = camera_origin(cameraOffset);
+    vec3 local = inverse(camera(rayOrigin, CAMERA_TARGET)) * (worldPos - rayOrigin);
+    fragCoord = vec2(0);
+    if (local.z >= 0.0)
+    {
+        return false;
+    }
+    vec2 resolution = ubo.resolution.xy;
+    vec2 uv = local.xy / -local.z;
+    uv.x /= resolution.x / resolution.y;
+    uv += 0.5;
+    uv.y = 1.0 - uv.y;
+    fragCoord = uv * resolution;
+    return true;
+}
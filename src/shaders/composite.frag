@@ -0,0 +1,70 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// composite pass: upsamples the low res clouds over the full res scene.
+// Bilinear weights, scaled down for low res texels whose depth doesn't match this pixel's,
+// so clouds behind an sdf edge don't bleed over it (and vice versa)
+#include "common.glsl"
+
+layout(set = 1, binding = 0) uniform sampler2D sceneColor;
+layout(set = 1, binding = 1) uniform sampler2D sceneDepth;
+layout(set = 1, binding = 2) uniform sampler2D cloudColor;
+layout(set = 1, binding = 3) uniform sampler2D cloudDepth;
+
+layout(location = 0) out vec4 outColor;
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragUV;
+
+// relative depth difference at which a low res texel's weight drops to ~37%
+#define UPSAMPLE_DEPTH_SHARPNESS 0.05
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 scene = texelFetch(sceneColor, pixel, 0);
+    float depth = texelFetch(sceneDepth, pixel, 0).r;
+
+    float downsample = ubo.resolution.z;
+    ivec2 lowResMax = textureSize(cloudColor, 0) - 1;
+    // step heatmaps: the scene pass already wrote its own, the cloud one is shown unfiltered so every texel's count is visible
+    int heatmap = step_heatmap_mode();
+    if (heatmap == STEP_HEATMAP_SCENE)
+    {
+        outColor = vec4(scene.rgb, 1.0);
+        return;
+    }
+    if (heatmap == STEP_HEATMAP_CLOUDS)
+    {
+        ivec2 lowResTexel = min(ivec2(gl_FragCoord.xy / downsample), lowResMax);
+        outColor = vec4(step_heatmap(texelFetch(cloudDepth, lowResTexel, 0).b), 1.0);
+        return;
+    }
+    // position in low res texel space, texel centers on integers
+    vec2 lowResPos = gl_FragCoord.xy / downsample - 0.5;
+    ivec2 base = ivec2(floor(lowResPos));
+    vec2 f = lowResPos - vec2(base);
+
+    vec4 cloud = vec4(0);
+    float weightSum = 0.0;
+    float bestDepthDiff = 1e30;
+    vec4 bestCloud = vec4(0,0,0,1);
+    for (int i = 0; i < 4; i++)
+    {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 texel = clamp(base + offset, ivec2(0), lowResMax);
+        vec2 bilinear = mix(1.0 - f, f, vec2(offset));
+        vec4 tap = texelFetch(cloudColor, texel, 0);
+        float depthDiff = abs(texelFetch(cloudDepth, texel, 0).r - depth) / max(depth, SURF_EPSILON);
+        float weight = bilinear.x * bilinear.y * exp(-depthDiff / UPSAMPLE_DEPTH_SHARPNESS);
+        cloud += tap * weight;
+        weightSum += weight;
+        if (depthDiff < bestDepthDiff)
+        {
+            bestDepthDiff = depthDiff;
+            bestCloud = tap;
+        }
+    }
+    // every tap is on the other side of an edge. Take whichever's closest in depth instead of amplifying noise
+    cloud = weightSum > 1e-4 ? cloud / weightSum : bestCloud;
+    outColor = vec4(scene.rgb + cloud.rgb, 1.0);
+}
@@ -0,0 +1,117 @@
+#include "step_stats.h"
+#include "tiny/tiny_log.h"
+#include "tiny/tiny_mem.h"
+
+#include "imgui.h"
+
+#include <stdlib.h>
+
+const char* step_counter_names[STEP_COUNTER_COUNT] =
+{
+    "Raymarch",
+    "Soft shadows",
+    "Cloud march",
+    "Light march",
+};
+
+const char* step_heatmap_names[STEP_HEATMAP_COUNT] =
+{
+    "Off",
+    "Scene",
+    "Clouds",
+};
+
+void step_stats_init(StepStats* stats, Arena* arena, GpuAllocator* allocator, u32 num_slots)
+{
+    stats->num_slots = num_slots;
+    stats->pending_frame_indices = arena_alloc_type(arena, u64, num_slots);
+    for (u32 i = 0; i < num_slots; i++)
+    {
+        stats->pending_frame_indices[i] = UINT64_MAX;
+    }
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = sizeof(StepStatsData) * num_slots;
+    buffer_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vkCreateBuffer(allocator->logical_device, &buffer_info, nullptr, &stats->buffer) != VK_SUCCESS)
+    {
+        LOG_FATAL("Failed to create the step stats buffer");
+        exit(EXIT_FAILURE);
+    }
+    // host visible and coherent, the shaders' atomics go straight into it
+    stats->mem = gpu_alloc_buffer(allocator, stats->buffer, GPU_MEMORY_GPU_TO_CPU);
+    TINY_ASSERT(stats->mem.mapped != nullptr);
+    TMEMSET(stats->mem.mapped, 0, sizeof(StepStatsData) * num_slots);
+}
+
+void step_stats_destroy(StepStats* stats, GpuAllocator* allocator)
+{
+    vkDestroyBuffer(allocator->logical_device, stats->buffer, nullptr);
+    gpu_free(allocator, stats->mem);
+    stats->buffer = VK_NULL_HANDLE;
+}
+
+void step_stats_record_readback(StepStats* stats, VkCommandBuffer cmd_buffer)
+{
+    if (stats->heatmap == STEP_HEATMAP_OFF) return;
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = stats->buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 
+                         0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+void step_stats_frame_submitted(StepStats* stats, u32 slot, u64 frame_index)
+{
+    if (stats->heatmap == STEP_HEATMAP_OFF) return;
+    stats->pending_frame_indices[slot] = frame_index;
+}
+
+bool step_stats_resolve(StepStats* stats, u32 slot)
+{
+    u64& frame_index = stats->pending_frame_indices[slot];
+    if (frame_index == UINT64_MAX)
+    {
+        return false;
+    }
+    StepStatsData* data = (StepStatsData*)stats->mem.mapped + slot;
+    TMEMCPY(&stats->last, data, sizeof(StepStatsData));
+    // the next frame in this slot adds onto it
+    TMEMSET(data, 0, sizeof(StepStatsData));
+    stats->last_frame_index = frame_index;
+    frame_index = UINT64_MAX;
+    return true;
+}
+
+void step_stats_imgui(const StepStats* stats)
+{
+    if (stats->heatmap == STEP_HEATMAP_OFF || stats->last_frame_index == UINT64_MAX)
+    {
+        return;
+    }
+    const StepStatsData& last = stats->last;
+    ImGui::Text("Frame %llu", (unsigned long long)stats->last_frame_index);
+    for (u32 counter = 0; counter < STEP_COUNTER_COUNT; counter++)
+    {
+        u32 invocations = last.invocations[counter];
+        ImGui::Text("%-12s %10u steps, %8u rays, %6.2f avg / %u", step_counter_names[counter], last.steps[counter], invocations, 
+            invocations > 0 ? (f64)last.steps[counter] / invocations : 0.0, last.max_steps[counter]);
+        if (invocations == 0) continue; // nothing marched this frame (e.g. no light grid update)
+        f32 bins[STEP_HISTOGRAM_BINS] = {};
+        for (u32 bin = 0; bin < STEP_HISTOGRAM_BINS; bin++)
+        {
+            bins[bin] = (f32)last.histogram[counter][bin] / invocations;
+        }
+        ImGui::PushID(counter);
+        // fraction of rays per bin, bins split 0..max steps evenly
+        ImGui::PlotHistogram("", bins, STEP_HISTOGRAM_BINS, 0, nullptr, 0.0f, 1.0f, ImVec2(0, 40));
+        ImGui::PopID();
+    }
+}
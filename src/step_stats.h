@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "defines.h"
+#include "tiny/tiny_arena.h"
+#include "gpu_allocator.h"
+
+// march step counters, for tuning the raymarchers. The shaders count loop iterations in raymarch(), softShadows(),
+// cloud_march() and get_light_transmittance(). While a heatmap is on they also add every ray's count into this frame slot's
+// StepStatsData (common.glsl), which is read back once the slot's fence has signaled, like the gpu profiler's queries.
+// Off, nothing's written and the counting is just a few register increments
+enum StepCounter
+{
+    STEP_COUNTER_RAYMARCH = 0, // scene sphere trace, per pixel
+    STEP_COUNTER_SHADOWS, // soft shadow march, per pixel that hit something
+    STEP_COUNTER_CLOUDS, // cloud march, per cloud texel marched this frame
+    STEP_COUNTER_LIGHT, // march towards the sun, per light grid texel updated this frame
+
+    STEP_COUNTER_COUNT,
+};
+
+// what the screen shows instead of the final image
+enum StepHeatmap
+{
+    STEP_HEATMAP_OFF = 0,
+    STEP_HEATMAP_SCENE, // raymarch + soft shadow steps per pixel
+    STEP_HEATMAP_CLOUDS, // cloud march steps per cloud texel, as of the last frame it was marched
+
+    STEP_HEATMAP_COUNT,
+};
+
+// matches common.glsl
+constexpr u32 STEP_HISTOGRAM_BINS = 16;
+
+// one frame slot's counters. std430 layout of the struct in common.glsl
+struct StepStatsData
+{
+    u32 max_steps[STEP_COUNTER_COUNT]; // loop bound, the histogram spans 0..max_steps. Written by the shaders
+    u32 invocations[STEP_COUNTER_COUNT]; // rays that ran the loop
+    u32 steps[STEP_COUNTER_COUNT]; // total iterations
+    u32 histogram[STEP_COUNTER_COUNT][STEP_HISTOGRAM_BINS];
+};
+
+struct StepStats
+{
+    VkBuffer buffer = VK_NULL_HANDLE; // a StepStatsData per slot, persistently mapped
+    GpuAllocation mem = {};
+    u32 num_slots = 0;
+    StepHeatmap heatmap = STEP_HEATMAP_OFF;
+    u64* pending_frame_indices = nullptr; // which frame counted into each slot. UINT64_MAX if none
+    // the last frame read back, MAX_FRAMES_IN_FLIGHT frames late
+    StepStatsData last = {};
+    u64 last_frame_index = UINT64_MAX;
+};
+
+extern const char* step_counter_names[STEP_COUNTER_COUNT];
+extern const char* step_heatmap_names[STEP_HEATMAP_COUNT];
+
+void step_stats_init(StepStats* stats, Arena* arena, GpuAllocator* allocator, u32 num_slots);
+void step_stats_destroy(StepStats* stats, GpuAllocator* allocator);
+
+// makes the shaders' atomics visible to the host. Record at the end of the frame's command buffer
+void step_stats_record_readback(StepStats* stats, VkCommandBuffer cmd_buffer);
+// only frames recorded with a heatmap on counted anything
+void step_stats_frame_submitted(StepStats* stats, u32 slot, u64 frame_index);
+// copies out what the last frame in this slot counted and zeroes it for the next one. Never waits - only call once the slot's fence
+// has signaled. Returns false if there was nothing pending
+bool step_stats_resolve(StepStats* stats, u32 slot);
+
+// draws into whatever imgui window is currently open
+void step_stats_imgui(const StepStats* stats);
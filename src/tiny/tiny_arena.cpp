@@ -2,18 +2,82 @@
 #include "tiny_arena.h"
 #include "tiny_log.h"
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
 #define MAX_ARENA_NAME_LEN 30
 
+// address space only, no pages behind it yet
+static void* os_reserve(size_t size) {
+#ifdef _WIN32
+    return VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+    void* mem = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return mem == MAP_FAILED ? nullptr : mem;
+#endif
+}
+
+static bool os_commit(void* mem, size_t size) {
+#ifdef _WIN32
+    return VirtualAlloc(mem, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+    return mprotect(mem, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+static void os_release(void* mem, size_t size) {
+#ifdef _WIN32
+    VirtualFree(mem, 0, MEM_RELEASE);
+#else
+    munmap(mem, size);
+#endif
+}
+
+// makes sure everything up to end is usable. Only virtual arenas can grow
+static bool arena_ensure_committed(Arena* arena, size_t end) {
+    if (end <= arena->committed) {
+        return true;
+    }
+    if (!arena->is_virtual || end > arena->backing_mem_size) {
+        return false;
+    }
+    size_t new_committed = (end + ARENA_COMMIT_GRANULARITY - 1) / ARENA_COMMIT_GRANULARITY * ARENA_COMMIT_GRANULARITY;
+    new_committed = new_committed < arena->backing_mem_size ? new_committed : arena->backing_mem_size;
+    if (!os_commit(arena->backing_mem + arena->committed, new_committed - arena->committed)) {
+        return false;
+    }
+    arena->committed = new_committed;
+    return true;
+}
+
 Arena arena_init(void* backing_buffer, size_t arena_size) {
     Arena a;
     a.backing_mem = (unsigned char*)backing_buffer;
     a.backing_mem_size = arena_size;
+    a.committed = arena_size;
     a.offset = 0;
     a.prev_offset = 0;
     //TMEMSET(backing_buffer, 0, arena_size);
     return a;
 }
 
+Arena arena_init_virtual(size_t reserve_size, const char* name) {
+    reserve_size = (reserve_size + ARENA_COMMIT_GRANULARITY - 1) / ARENA_COMMIT_GRANULARITY * ARENA_COMMIT_GRANULARITY;
+    Arena a;
+    a.backing_mem = (unsigned char*)os_reserve(reserve_size);
+    TINY_ASSERT(a.backing_mem != nullptr && "Failed to reserve arena address space");
+    a.backing_mem_size = reserve_size;
+    a.is_virtual = true;
+    // the name lives at the start, like in fixed arenas
+    char* name_mem = (char*)arena_alloc(&a, MAX_ARENA_NAME_LEN);
+    strncpy(name_mem, name, MAX_ARENA_NAME_LEN - 1);
+    return a;
+}
+
 Arena arena_init(void* backing_buffer, size_t arena_size, const char* name) {
     Arena a = arena_init(backing_buffer, arena_size);
     char* name_mem = (char*)arena_alloc(&a, MAX_ARENA_NAME_LEN); 
@@ -32,19 +96,25 @@ const char* arena_get_name(Arena* arena) {
 }
 
 void* arena_alloc(Arena* arena, size_t alloc_size) {
-    size_t& offset = arena->offset;
-    bool is_out_of_mem = offset + alloc_size > arena->backing_mem_size;
+    return arena_alloc_aligned(arena, alloc_size, ARENA_DEFAULT_ALIGNMENT);
+}
+
+void* arena_alloc_aligned(Arena* arena, size_t alloc_size, size_t alignment) {
+    TINY_ASSERT(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    alignment = alignment > ARENA_DEFAULT_ALIGNMENT ? alignment : ARENA_DEFAULT_ALIGNMENT;
+    // align the address, not the offset. The backing buffer itself may not be aligned
+    uintptr_t base = (uintptr_t)arena->backing_mem;
+    uintptr_t aligned = (base + arena->offset + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    size_t start = (size_t)(aligned - base);
+    bool is_out_of_mem = start + alloc_size > arena->backing_mem_size || !arena_ensure_committed(arena, start + alloc_size);
     if (is_out_of_mem) 
     {
         LOG_FATAL("Out of memory in arena %s\n", arena_get_name(arena));
-        // maybe we automatically resize here?
         return nullptr;
     }
-    // TODO: enforce alignment    
-    void* new_alloc = arena->backing_mem + offset;
-    arena->prev_offset = offset;
-    offset += alloc_size;
-    return new_alloc;
+    arena->prev_offset = start;
+    arena->offset = start + alloc_size;
+    return arena->backing_mem + start;
 }
 
 void* arena_resize(Arena* arena, void* old_mem, size_t old_size, size_t new_size) {
@@ -55,7 +125,9 @@ void* arena_resize(Arena* arena, void* old_mem, size_t old_size, size_t new_size
     bool is_old_mem_in_range = old_mem_addr >= backing_mem_addr && old_mem_addr < backing_mem_addr + arena->offset;
     if (is_old_mem_in_range) {
         bool is_most_recent_alloc = old_mem_addr == backing_mem_addr + arena->prev_offset;
-        if (is_most_recent_alloc) {
+        // grows in place as long as there's room (or a virtual arena can commit more)
+        bool fits = arena->prev_offset + new_size <= arena->backing_mem_size && arena_ensure_committed(arena, arena->prev_offset + new_size);
+        if (is_most_recent_alloc && fits) {
             arena->offset = arena->prev_offset + new_size;
             return old_mem;
         }
@@ -80,15 +152,23 @@ void arena_clear(Arena* arena) {
 void arena_clear_null(Arena* arena) {
     arena->offset = 0;
     arena->prev_offset = 0;
-    TMEMSET(arena->backing_mem, 0, arena->backing_mem_size);
+    // only what's committed, past that virtual arenas aren't backed by anything
+    TMEMSET(arena->backing_mem, 0, arena->committed);
 }
 
 
 void arena_free_all(Arena* arena)
 {
     arena_clear(arena);
+    if (arena->is_virtual) {
+        os_release(arena->backing_mem, arena->backing_mem_size);
+        arena->backing_mem = 0;
+    }
+    else {
+        TSYSFREE(arena->backing_mem);
+    }
     arena->backing_mem_size = 0;
-    TSYSFREE(arena->backing_mem);
+    arena->committed = 0;
 }
 
 ArenaTemp arena_temp_init(Arena* arena) {
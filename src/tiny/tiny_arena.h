@@ -8,19 +8,34 @@
 
 // ARENAS
 
+// every allocation is aligned to at least this. Enough for SSE types and anything malloc would hand out
+#define ARENA_DEFAULT_ALIGNMENT 16
+// virtual arenas commit pages in chunks of this many bytes. A multiple of the page size everywhere we run
+#define ARENA_COMMIT_GRANULARITY KILOBYTES_BYTES(64ull)
+
+// two kinds of backing memory:
+//  fixed - a buffer the caller owns (arena_init). Running out is fatal
+//  virtual - a big address range reserved up front (arena_init_virtual), pages get committed as the offset reaches them.
+//            Grows in place, so nothing ever moves and the reserve can be far bigger than anything will actually use
 struct Arena 
 {
     unsigned char* backing_mem = 0;
-    size_t backing_mem_size = 0;
+    size_t backing_mem_size = 0; // capacity. The reserved range for virtual arenas
+    size_t committed = 0; // bytes at the start of backing_mem that are usable. All of it for fixed arenas
     size_t offset = 0;
     size_t prev_offset = 0;
+    bool is_virtual = false;
 };
 
-#define arena_alloc_type(arena, type, num) ((type*)arena_alloc(arena, sizeof(type) * num))
+#define arena_alloc_type(arena, type, num) ((type*)arena_alloc_aligned(arena, sizeof(type) * (num), alignof(type)))
 
 TAPI Arena arena_init(void* backing_buffer, size_t arena_size);
 TAPI Arena arena_init(void* backing_buffer, size_t arena_size, const char* name);
+// reserves reserve_size bytes of address space, nothing's committed until it's allocated from. Free with arena_free_all
+TAPI Arena arena_init_virtual(size_t reserve_size, const char* name);
 TAPI void* arena_alloc(Arena* arena, size_t alloc_size);
+// alignment must be a power of two
+TAPI void* arena_alloc_aligned(Arena* arena, size_t alloc_size, size_t alignment);
 TAPI void* arena_resize(Arena* arena, void* old_mem, size_t old_size, size_t new_size);
 TAPI void arena_clear(Arena* arena);
 TAPI void arena_clear_null(Arena* arena);
@@ -38,6 +53,9 @@ inline void* arena_alloc(ArenaTemp* arena, size_t alloc_size) {
     // when using temp arenas, use the underlying arena
     return arena_alloc(arena->arena, alloc_size);
 }
+inline void* arena_alloc_aligned(ArenaTemp* arena, size_t alloc_size, size_t alignment) {
+    return arena_alloc_aligned(arena->arena, alloc_size, alignment);
+}
 inline void* arena_resize(ArenaTemp* arena, void* old_mem, size_t old_size, size_t new_size) {
     return arena_resize(arena->arena, old_mem, old_size, new_size);
 }
@@ -32,12 +32,12 @@ TAPI void SetLogLevel(LogLevel level, bool toggle);
 TAPI const char* TextFormat(const char *text, ...);
 TAPI void LogMessage(LogLevel level, const char* message, ...);
 
-#define LOG_FATAL(message, ...) LogMessage(LOG_LEVEL_FATAL, message, __VA_ARGS__)
-#define LOG_ERROR(message, ...) LogMessage(LOG_LEVEL_ERROR, message, __VA_ARGS__)
-#define LOG_WARN(message, ...) LogMessage(LOG_LEVEL_WARN, message, __VA_ARGS__)
-#define LOG_INFO(message, ...) LogMessage(LOG_LEVEL_INFO, message, __VA_ARGS__)
-#define LOG_DEBUG(message, ...) LogMessage(LOG_LEVEL_DEBUG, message, __VA_ARGS__)
-#define LOG_TRACE(message, ...) LogMessage(LOG_LEVEL_TRACE, message, __VA_ARGS__)
+#define LOG_FATAL(message, ...) LogMessage(LOG_LEVEL_FATAL, message, ##__VA_ARGS__)
+#define LOG_ERROR(message, ...) LogMessage(LOG_LEVEL_ERROR, message, ##__VA_ARGS__)
+#define LOG_WARN(message, ...) LogMessage(LOG_LEVEL_WARN, message, ##__VA_ARGS__)
+#define LOG_INFO(message, ...) LogMessage(LOG_LEVEL_INFO, message, ##__VA_ARGS__)
+#define LOG_DEBUG(message, ...) LogMessage(LOG_LEVEL_DEBUG, message, ##__VA_ARGS__)
+#define LOG_TRACE(message, ...) LogMessage(LOG_LEVEL_TRACE, message, ##__VA_ARGS__)
 
 
 #ifdef TINY_ASSERTIONS_ENABLED
@@ -2,6 +2,8 @@
 #define TINY_MEM_H
 
 #include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
 
 #define TSYSALLOC(size) malloc(size)
 #define TSYSFREE(ptr) { free(ptr); (ptr)=0; }
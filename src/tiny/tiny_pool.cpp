@@ -0,0 +1,86 @@
+#include "tiny_pool.h"
+#include "tiny_log.h"
+
+static inline unsigned char* pool_slot(Pool* pool, uint32_t index) {
+    return pool->slots + (size_t)index * pool->slot_size;
+}
+
+// skips 0 when it wraps, that's the null generation
+static inline uint32_t pool_next_generation(uint32_t generation) {
+    generation++;
+    return generation == 0 ? 1 : generation;
+}
+
+Pool pool_init(Arena* arena, size_t object_size, size_t alignment, uint32_t capacity) {
+    TINY_ASSERT(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    TINY_ASSERT(capacity < POOL_NULL_INDEX);
+    // a free slot has to hold the next free index
+    alignment = alignment > alignof(uint32_t) ? alignment : alignof(uint32_t);
+    size_t slot_size = object_size > sizeof(uint32_t) ? object_size : sizeof(uint32_t);
+    slot_size = (slot_size + alignment - 1) & ~(alignment - 1);
+    Pool pool;
+    pool.slot_size = slot_size;
+    pool.capacity = capacity;
+    pool.slots = (unsigned char*)arena_alloc_aligned(arena, slot_size * capacity, alignment);
+    // generations are filled in as slots get touched, so init costs the same for any capacity
+    pool.generations = arena_alloc_type(arena, uint32_t, capacity);
+    return pool;
+}
+
+PoolHandle pool_alloc(Pool* pool, void** object_out) {
+    PoolHandle handle = {};
+    uint32_t index = POOL_NULL_INDEX;
+    if (pool->first_free != POOL_NULL_INDEX) {
+        index = pool->first_free;
+        TMEMCPY(&pool->first_free, pool_slot(pool, index), sizeof(uint32_t));
+    }
+    else if (pool->num_touched < pool->capacity) {
+        index = pool->num_touched++;
+        pool->generations[index] = 1;
+    }
+    if (index == POOL_NULL_INDEX) {
+        if (object_out != nullptr) {
+            *object_out = nullptr;
+        }
+        return handle;
+    }
+    pool->num_used++;
+    handle.index = index;
+    handle.generation = pool->generations[index];
+    if (object_out != nullptr) {
+        *object_out = pool_slot(pool, index);
+    }
+    return handle;
+}
+
+void* pool_get(Pool* pool, PoolHandle handle) {
+    bool is_live = handle.generation != 0 && handle.index < pool->num_touched && pool->generations[handle.index] == handle.generation;
+    return is_live ? pool_slot(pool, handle.index) : nullptr;
+}
+
+bool pool_free(Pool* pool, PoolHandle handle) {
+    unsigned char* slot = (unsigned char*)pool_get(pool, handle);
+    if (slot == nullptr) {
+        return false;
+    }
+    pool->generations[handle.index] = pool_next_generation(handle.generation);
+    TMEMCPY(slot, &pool->first_free, sizeof(uint32_t));
+    pool->first_free = handle.index;
+    pool->num_used--;
+    return true;
+}
+
+void pool_clear(Pool* pool) {
+    // touched slots keep counting up from their generation, so handles from before the clear stay stale after slots are reused
+    for (uint32_t i = 0; i < pool->num_touched; i++) {
+        pool->generations[i] = pool_next_generation(pool->generations[i]);
+    }
+    // freed slots are threaded back through the free list so untouched ones still come off the bump index
+    pool->first_free = POOL_NULL_INDEX;
+    for (uint32_t i = pool->num_touched; i > 0; i--) {
+        uint32_t index = i - 1;
+        TMEMCPY(pool_slot(pool, index), &pool->first_free, sizeof(uint32_t));
+        pool->first_free = index;
+    }
+    pool->num_used = 0;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "tiny_arena.h"
+
+#include <new>
+
+#ifndef TAPI
+#define TAPI
+#endif
+
+// POOLS
+
+// fixed size slots for objects that come and go at runtime (resource records, upload jobs, bricks...),
+// which an arena can't free one at a time. All capacity slots are carved out of an arena up front.
+// Alloc and free are O(1): a free slot holds the index of the next free slot (an intrusive free list),
+// and slots that were never handed out are taken off a bump index so init doesn't touch them.
+//
+// Objects are referred to by handles, an index plus the slot's generation. The generation goes up every
+// time its slot is freed, so a handle kept around after its object was freed (even if the slot's been
+// reused since) stops resolving instead of quietly pointing at someone else's object.
+// Generation 0 is never handed out, so a zeroed handle is always null
+
+#define POOL_NULL_INDEX 0xFFFFFFFFu
+
+struct PoolHandle
+{
+    uint32_t index = 0;
+    uint32_t generation = 0;
+};
+
+struct Pool
+{
+    unsigned char* slots = 0;
+    uint32_t* generations = 0; // per slot, kept outside the slot so it survives the slot being on the free list
+    size_t slot_size = 0; // stride, object size rounded up to the alignment
+    uint32_t capacity = 0;
+    uint32_t num_used = 0;
+    uint32_t num_touched = 0; // slots below this have been handed out at least once, the rest are past the bump index
+    uint32_t first_free = POOL_NULL_INDEX;
+};
+
+// alignment must be a power of two. The pool lives as long as the arena's allocations do
+TAPI Pool pool_init(Arena* arena, size_t object_size, size_t alignment, uint32_t capacity);
+// null handle (and object_out null) when the pool is full
+TAPI PoolHandle pool_alloc(Pool* pool, void** object_out);
+// null for null, freed or out of range handles
+TAPI void* pool_get(Pool* pool, PoolHandle handle);
+// false for a handle that's already stale (double frees land here)
+TAPI bool pool_free(Pool* pool, PoolHandle handle);
+// frees everything at once. Every outstanding handle goes stale. Doesn't run destructors of typed objects
+TAPI void pool_clear(Pool* pool);
+
+inline bool pool_handle_is_null(PoolHandle handle) {
+    return handle.generation == 0;
+}
+
+// typed wrappers. Handle<A> and Handle<B> don't convert into each other, so a handle can't be looked up in the wrong pool's type
+
+template <typename T>
+struct Handle
+{
+    PoolHandle raw = {};
+    bool is_null() const { return pool_handle_is_null(raw); }
+    bool operator==(const Handle& other) const { return raw.index == other.raw.index && raw.generation == other.raw.generation; }
+    bool operator!=(const Handle& other) const { return !(*this == other); }
+};
+
+template <typename T>
+struct TypedPool
+{
+    Pool pool = {};
+};
+
+template <typename T>
+inline TypedPool<T> pool_init_typed(Arena* arena, uint32_t capacity) {
+    TypedPool<T> typed;
+    typed.pool = pool_init(arena, sizeof(T), alignof(T), capacity);
+    return typed;
+}
+
+// value initialized T. Null handle when the pool is full
+template <typename T>
+inline Handle<T> pool_create(TypedPool<T>* typed, T** object_out = nullptr) {
+    Handle<T> handle;
+    void* mem = nullptr;
+    handle.raw = pool_alloc(&typed->pool, &mem);
+    T* object = mem != nullptr ? new (mem) T() : nullptr;
+    if (object_out != nullptr) {
+        *object_out = object;
+    }
+    return handle;
+}
+
+template <typename T>
+inline T* pool_get(TypedPool<T>* typed, Handle<T> handle) {
+    return (T*)pool_get(&typed->pool, handle.raw);
+}
+
+template <typename T>
+inline bool pool_destroy(TypedPool<T>* typed, Handle<T> handle) {
+    T* object = pool_get(typed, handle);
+    if (object == nullptr) {
+        return false;
+    }
+    object->~T();
+    return pool_free(&typed->pool, handle.raw);
+}
@@ -0,0 +1,174 @@
+#include "tiny_profile.h"
+#include "tiny_log.h"
+#include "tiny_mem.h"
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#ifdef TINY_PROFILE_ENABLED
+
+#if defined(_M_X64) || defined(__x86_64__)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define TINY_PROFILE_USE_TSC 1
+#endif
+
+// power of two so wrapping is a mask. ~16k zones per thread covers plenty of frames of history
+#define TINY_PROFILE_RING_SIZE (1 << 14)
+#define TINY_PROFILE_MAX_THREAD_NAME 32
+
+struct TinyProfileEvent
+{
+    const char* name;
+    unsigned long long start;
+    unsigned long long end;
+};
+
+struct TinyProfileThread
+{
+    unsigned int id = 0;
+    char name[TINY_PROFILE_MAX_THREAD_NAME] = {};
+    // only ever written by the owning thread. Total number of zones recorded, so head & mask is the next slot
+    std::atomic<unsigned long long> head = {0};
+    TinyProfileEvent events[TINY_PROFILE_RING_SIZE];
+};
+
+static std::mutex profile_threads_mutex;
+static std::vector<TinyProfileThread*> profile_threads;
+static thread_local TinyProfileThread* profile_this_thread = nullptr;
+
+// clock origin, and a matching steady clock reading to work out the tsc frequency at dump time
+static unsigned long long profile_origin_ticks = 0;
+static std::chrono::steady_clock::time_point profile_origin_time;
+
+static inline unsigned long long profile_now()
+{
+#ifdef TINY_PROFILE_USE_TSC
+    return __rdtsc();
+#else
+    return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static TinyProfileThread* profile_get_thread()
+{
+    if (profile_this_thread == nullptr)
+    {
+        // first zone on this thread. Buffers live until shutdown so a dump can still see threads that already exited
+        TinyProfileThread* thread = new TinyProfileThread();
+        std::lock_guard<std::mutex> lock(profile_threads_mutex);
+        thread->id = (unsigned int)profile_threads.size();
+        snprintf(thread->name, TINY_PROFILE_MAX_THREAD_NAME, "Thread %u", thread->id);
+        profile_threads.push_back(thread);
+        profile_this_thread = thread;
+    }
+    return profile_this_thread;
+}
+
+TinyProfileZone::TinyProfileZone(const char* zone_name)
+{
+    name = zone_name;
+    start = profile_now();
+}
+
+TinyProfileZone::~TinyProfileZone()
+{
+    unsigned long long end = profile_now();
+    TinyProfileThread* thread = profile_get_thread();
+    unsigned long long head = thread->head.load(std::memory_order_relaxed);
+    thread->events[head & (TINY_PROFILE_RING_SIZE - 1)] = {name, start, end};
+    thread->head.store(head + 1, std::memory_order_release);
+}
+
+void tiny_profile_init()
+{
+    profile_origin_time = std::chrono::steady_clock::now();
+    profile_origin_ticks = profile_now();
+}
+
+// only at exit, once no other thread will record zones again
+void tiny_profile_shutdown()
+{
+    std::lock_guard<std::mutex> lock(profile_threads_mutex);
+    for (TinyProfileThread* thread : profile_threads)
+    {
+        delete thread;
+    }
+    profile_threads.clear();
+    profile_this_thread = nullptr;
+}
+
+void tiny_profile_set_thread_name(const char* name)
+{
+    TinyProfileThread* thread = profile_get_thread();
+    std::lock_guard<std::mutex> lock(profile_threads_mutex);
+    snprintf(thread->name, TINY_PROFILE_MAX_THREAD_NAME, "%s", name);
+}
+
+bool tiny_profile_dump_chrome_trace(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (file == nullptr)
+    {
+        LOG_ERROR("Failed to open %s for writing", path);
+        return false;
+    }
+    // ticks -> microseconds, which is what trace_event wants
+#ifdef TINY_PROFILE_USE_TSC
+    double elapsed_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - profile_origin_time).count();
+    double elapsed_ticks = (double)(profile_now() - profile_origin_ticks);
+    double us_per_tick = elapsed_ticks > 0.0 ? elapsed_us / elapsed_ticks : 0.0;
+#else
+    double us_per_tick = 0.001;
+#endif
+
+    std::lock_guard<std::mutex> lock(profile_threads_mutex);
+    unsigned long long num_events = 0;
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (TinyProfileThread* thread : profile_threads)
+    {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+            first ? "" : ",\n", thread->id, thread->name);
+        first = false;
+        unsigned long long head = thread->head.load(std::memory_order_acquire);
+        unsigned long long begin = head > TINY_PROFILE_RING_SIZE ? head - TINY_PROFILE_RING_SIZE : 0;
+        for (unsigned long long i = begin; i < head; i++)
+        {
+            TinyProfileEvent event = thread->events[i & (TINY_PROFILE_RING_SIZE - 1)];
+            // the owning thread may have lapped us while we were copying. Once it's (about to be) writing zone i + RING_SIZE, slot i is junk
+            unsigned long long current_head = thread->head.load(std::memory_order_acquire);
+            if (i + TINY_PROFILE_RING_SIZE <= current_head)
+            {
+                continue;
+            }
+            double ts = (double)(event.start - profile_origin_ticks) * us_per_tick;
+            double dur = (double)(event.end - event.start) * us_per_tick;
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", event.name, thread->id, ts, dur);
+            num_events++;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    LOG_INFO("Wrote %llu profile zones from %u threads to %s", num_events, (unsigned int)profile_threads.size(), path);
+    return true;
+}
+
+#else
+
+void tiny_profile_init() {}
+void tiny_profile_shutdown() {}
+void tiny_profile_set_thread_name(const char*) {}
+bool tiny_profile_dump_chrome_trace(const char* path)
+{
+    LOG_WARN("Can't write %s, profile zones are compiled out (build with TINY_PROFILE_ENABLED)", path);
+    return false;
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef TINY_PROFILE_H
+#define TINY_PROFILE_H
+
+#ifndef TAPI
+#define TAPI
+#endif
+
+// CPU profiling zones.
+// TINY_PROFILE_SCOPE("name") times everything until the end of the enclosing scope and records it into
+// a per thread ring buffer (no locks, no allocation after a thread's first zone).
+// tiny_profile_dump_chrome_trace writes everything still in the rings as chrome trace_event json,
+// open it in chrome://tracing or https://ui.perfetto.dev
+//
+// zones only exist when TINY_PROFILE_ENABLED is defined. Otherwise the macros expand to nothing
+// and the functions below are empty stubs
+// NOTE: zone names are stored as pointers, so they must be string literals (or otherwise outlive the dump)
+
+#ifdef TINY_PROFILE_ENABLED
+
+struct TinyProfileZone
+{
+    const char* name;
+    unsigned long long start;
+    TinyProfileZone(const char* zone_name);
+    ~TinyProfileZone();
+};
+
+#define TINY_PROFILE_CONCAT_INNER(a, b) a##b
+#define TINY_PROFILE_CONCAT(a, b) TINY_PROFILE_CONCAT_INNER(a, b)
+#define TINY_PROFILE_SCOPE(name) TinyProfileZone TINY_PROFILE_CONCAT(tiny_profile_zone_, __LINE__)(name)
+#define TINY_PROFILE_FUNCTION() TINY_PROFILE_SCOPE(__FUNCTION__)
+
+#else
+
+#define TINY_PROFILE_SCOPE(name)
+#define TINY_PROFILE_FUNCTION()
+
+#endif
+
+// call once at startup, before any zones. Pins the clock origin so timestamps start near 0
+TAPI void tiny_profile_init();
+TAPI void tiny_profile_shutdown();
+// shows up as the track name in the trace viewer. name is copied
+TAPI void tiny_profile_set_thread_name(const char* name);
+// safe to call while other threads are recording, though their newest zones may or may not make it in
+TAPI bool tiny_profile_dump_chrome_trace(const char* path);
+
+#endif
@@ -0,0 +1,49 @@
+#include "tiny_scratch.h"
+#include "tiny_log.h"
+
+#include <stdio.h>
+
+struct ScratchThread
+{
+    Arena arenas[SCRATCH_ARENAS_PER_THREAD] = {};
+    bool initialized = false;
+
+    ~ScratchThread() {
+        if (!initialized) {
+            return;
+        }
+        for (int i = 0; i < SCRATCH_ARENAS_PER_THREAD; i++) {
+            arena_free_all(&arenas[i]);
+        }
+    }
+};
+
+// destroyed on thread exit, which hands the address space back
+static thread_local ScratchThread scratch_this_thread;
+
+Arena* scratch_get_arena(Arena* const* conflicts, size_t num_conflicts) {
+    ScratchThread& thread = scratch_this_thread;
+    if (!thread.initialized) {
+        for (int i = 0; i < SCRATCH_ARENAS_PER_THREAD; i++) {
+            char name[32];
+            snprintf(name, sizeof(name), "Scratch%d", i);
+            thread.arenas[i] = arena_init_virtual(SCRATCH_ARENA_RESERVE, name);
+        }
+        thread.initialized = true;
+    }
+    for (int i = 0; i < SCRATCH_ARENAS_PER_THREAD; i++) {
+        Arena* candidate = &thread.arenas[i];
+        bool is_conflict = false;
+        for (size_t k = 0; k < num_conflicts; k++) {
+            if (conflicts[k] == candidate) {
+                is_conflict = true;
+                break;
+            }
+        }
+        if (!is_conflict) {
+            return candidate;
+        }
+    }
+    TINY_ASSERT(false && "Every scratch arena conflicts, bump SCRATCH_ARENAS_PER_THREAD");
+    return nullptr;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "tiny_arena.h"
+
+#ifndef TAPI
+#define TAPI
+#endif
+
+// SCRATCH ARENAS
+
+// every thread gets its own set of virtual scratch arenas for temporaries that don't outlive a function.
+// They're reserved on the thread's first scratch_begin and released when the thread exits, no locks anywhere.
+//
+// scratch_begin(conflicts...) hands out a scratch arena that isn't any of the arenas passed in. A function that
+// allocates its results into an arena from its caller passes that arena along, so if the caller's arena is itself
+// a scratch arena the function's temporaries land in the other one and never clobber the results.
+// Everything allocated from the scratch is thrown away when the returned Scratch goes out of scope:
+//
+//  Foo* load_foos(Arena* arena, u32* num_out) {
+//      Scratch scratch = scratch_begin(arena);
+//      u8* file = read_whole_file(scratch.arena);   // gone at the end of the function
+//      Foo* foos = arena_alloc_type(arena, Foo, n); // survives, belongs to the caller
+//      ...
+//  }
+
+// nesting with one conflict needs two. More only matters for functions that take several output arenas
+#define SCRATCH_ARENAS_PER_THREAD 2
+// address space only, pages get committed as they're used (and stay committed for the next scratch)
+#define SCRATCH_ARENA_RESERVE GIGABYTES_BYTES(1ull)
+
+// rewinds the scratch arena to where it was at scratch_begin when it goes out of scope
+struct Scratch
+{
+    Arena* arena;
+    ArenaTemp temp;
+
+    explicit Scratch(Arena* scratch_arena) : arena(scratch_arena), temp(arena_temp_init(scratch_arena)) {}
+    ~Scratch() { arena_temp_end(temp); }
+    Scratch(const Scratch&) = delete;
+    Scratch& operator=(const Scratch&) = delete;
+};
+
+// this thread's first scratch arena that isn't in conflicts. Null entries are skipped.
+// Asserts if every scratch arena conflicts (bump SCRATCH_ARENAS_PER_THREAD)
+TAPI Arena* scratch_get_arena(Arena* const* conflicts, size_t num_conflicts);
+
+inline Scratch scratch_begin() {
+    return Scratch(scratch_get_arena(nullptr, 0));
+}
+
+template <typename... Arenas>
+inline Scratch scratch_begin(Arenas*... conflicts) {
+    Arena* conflict_list[] = {conflicts...};
+    return Scratch(scratch_get_arena(conflict_list, sizeof...(conflicts)));
+}
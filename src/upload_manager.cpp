@@ -0,0 +1,400 @@
+#include "upload_manager.h"
+#include "tiny/tiny_log.h"
+#include "tiny/tiny_mem.h"
+#include "tiny/tiny_profile.h"
+
+#include <stdlib.h>
+#include <vector>
+
+// keeps every copy source nicely aligned. Also covers the texel block / 4 byte rules for buffer->image copies
+constexpr VkDeviceSize UPLOAD_ALIGNMENT = 16;
+
+static u64 align_up(u64 value, u64 alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static VkSemaphore create_semaphore(VkDevice logical_device)
+{
+    VkSemaphoreCreateInfo semaphore_info = {};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    vkCreateSemaphore(logical_device, &semaphore_info, nullptr, &semaphore);
+    return semaphore;
+}
+
+void upload_manager_init(
+    UploadManager* uploads,
+    GpuAllocator* allocator,
+    VkPhysicalDevice physical_device,
+    VkQueue transfer_queue,
+    u32 transfer_family,
+    u32 graphics_family,
+    VkDeviceSize ring_size)
+{
+    VkDevice logical_device = allocator->logical_device;
+    uploads->logical_device = logical_device;
+    uploads->transfer_queue = transfer_queue;
+    uploads->transfer_family = transfer_family;
+    uploads->graphics_family = graphics_family;
+    // graphics and compute families are always (1,1,1), dedicated copy engines can be coarser
+    u32 queue_family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, nullptr);
+    std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, queue_families.data());
+    uploads->image_granularity = queue_families[transfer_family].minImageTransferGranularity;
+
+    VkCommandPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    pool_info.queueFamilyIndex = transfer_family;
+    vkCreateCommandPool(logical_device, &pool_info, nullptr, &uploads->cmd_pool);
+
+    VkCommandBufferAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.commandPool = uploads->cmd_pool;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = 1;
+    VkFenceCreateInfo fence_info = {};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    for (u32 i = 0; i < UPLOAD_MAX_BATCHES; i++)
+    {
+        UploadBatch& batch = uploads->batches[i];
+        vkAllocateCommandBuffers(logical_device, &alloc_info, &batch.cmd_buffer);
+        vkCreateFence(logical_device, &fence_info, nullptr, &batch.fence);
+        batch.done_semaphore = create_semaphore(logical_device);
+    }
+
+    uploads->ring_size = ring_size;
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = ring_size;
+    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE; // only ever read by the transfer queue
+    vkCreateBuffer(logical_device, &buffer_info, nullptr, &uploads->ring_buffer);
+    uploads->ring_mem = gpu_alloc_buffer(allocator, uploads->ring_buffer, GPU_MEMORY_CPU_ONLY);
+    LOG_INFO("Upload manager: %llu MB staging ring on queue family %u (graphics is %u)",
+        (unsigned long long)(ring_size / (1024 * 1024)), transfer_family, graphics_family);
+}
+
+// oldest submitted batch is done -> its ring space and batch slot can be reused
+static void retire_oldest(UploadManager* uploads)
+{
+    UploadBatch& batch = uploads->batches[uploads->retired_ticket % UPLOAD_MAX_BATCHES];
+    vkResetFences(uploads->logical_device, 1, &batch.fence);
+    vkResetCommandBuffer(batch.cmd_buffer, 0);
+    if (batch.semaphore_needs_wait)
+    {
+        // a binary semaphore can't be signaled again until something waits on it.
+        // Nothing did (no frame was rendered since), but its signal is done so it's safe to just replace it
+        vkDestroySemaphore(uploads->logical_device, batch.done_semaphore, nullptr);
+        batch.done_semaphore = create_semaphore(uploads->logical_device);
+        batch.semaphore_needs_wait = false;
+    }
+    uploads->ring_tail = batch.ring_end;
+    uploads->retired_ticket++;
+}
+
+static void retire_completed(UploadManager* uploads)
+{
+    while (uploads->retired_ticket < uploads->next_ticket)
+    {
+        UploadBatch& batch = uploads->batches[uploads->retired_ticket % UPLOAD_MAX_BATCHES];
+        if (vkGetFenceStatus(uploads->logical_device, batch.fence) != VK_SUCCESS)
+        {
+            break; // batches complete in submission order, so nothing newer is done either
+        }
+        retire_oldest(uploads);
+    }
+}
+
+static void wait_oldest(UploadManager* uploads)
+{
+    TINY_PROFILE_SCOPE("upload_stall");
+    UploadBatch& batch = uploads->batches[uploads->retired_ticket % UPLOAD_MAX_BATCHES];
+    vkWaitForFences(uploads->logical_device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+    retire_oldest(uploads);
+    uploads->num_stalls++;
+}
+
+static UploadBatch& begin_batch(UploadManager* uploads)
+{
+    UploadBatch& batch = uploads->batches[uploads->next_ticket % UPLOAD_MAX_BATCHES];
+    if (!batch.recording)
+    {
+        // the slot is still in use by a batch from UPLOAD_MAX_BATCHES submits ago
+        retire_completed(uploads);
+        while (uploads->next_ticket - uploads->retired_ticket >= UPLOAD_MAX_BATCHES)
+        {
+            wait_oldest(uploads);
+        }
+        if (batch.consumer_fence != VK_NULL_HANDLE)
+        {
+            // the frame that waited on this slot's semaphore has to have run that wait before we signal it again.
+            // Only still set if that frame hasn't been retired yet, which is rare by the time a slot comes back around
+            vkWaitForFences(uploads->logical_device, 1, &batch.consumer_fence, VK_TRUE, UINT64_MAX);
+            batch.consumer_fence = VK_NULL_HANDLE;
+        }
+        VkCommandBufferBeginInfo begin_info = {};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(batch.cmd_buffer, &begin_info);
+        batch.recording = true;
+        batch.num_copies = 0;
+    }
+    return batch;
+}
+
+// reserves size bytes of ring space, waiting on old batches if the ring is full. Returns the offset into the ring buffer
+static VkDeviceSize ring_alloc(UploadManager* uploads, VkDeviceSize size)
+{
+    TINY_ASSERT(size <= uploads->ring_size);
+    while (true)
+    {
+        u64 start = align_up(uploads->ring_head, UPLOAD_ALIGNMENT);
+        // allocations never straddle the end of the ring, skip ahead to the start instead
+        if (start % uploads->ring_size + size > uploads->ring_size)
+        {
+            start = align_up(start, uploads->ring_size);
+        }
+        if (start + size - uploads->ring_tail <= uploads->ring_size)
+        {
+            uploads->ring_head = start + size;
+            return start % uploads->ring_size;
+        }
+        retire_completed(uploads);
+        if (start + size - uploads->ring_tail <= uploads->ring_size)
+        {
+            continue;
+        }
+        if (uploads->retired_ticket == uploads->next_ticket)
+        {
+            // all the space is taken by the batch we're still recording. Submit it so it can be waited on
+            upload_flush(uploads);
+        }
+        wait_oldest(uploads);
+    }
+}
+
+u64 upload_buffer(UploadManager* uploads, VkBuffer dst, VkDeviceSize dst_offset, const void* data, VkDeviceSize size)
+{
+    TINY_PROFILE_SCOPE("upload_buffer");
+    // anything bigger than half the ring goes in chunks, so a single upload can never deadlock on its own batch
+    const VkDeviceSize max_chunk = uploads->ring_size / 2;
+    VkDeviceSize done = 0;
+    while (done < size)
+    {
+        VkDeviceSize chunk = size - done < max_chunk ? size - done : max_chunk;
+        VkDeviceSize ring_offset = ring_alloc(uploads, chunk);
+        // begin after reserving, ring_alloc may have flushed the batch we were recording
+        UploadBatch& batch = begin_batch(uploads);
+        TMEMCPY((u8*)uploads->ring_mem.mapped + ring_offset, (const u8*)data + done, chunk);
+        VkBufferCopy region = {};
+        region.srcOffset = ring_offset;
+        region.dstOffset = dst_offset + done;
+        region.size = chunk;
+        vkCmdCopyBuffer(batch.cmd_buffer, uploads->ring_buffer, dst, 1, &region);
+        batch.num_copies++;
+        done += chunk;
+    }
+    uploads->total_bytes_uploaded += size;
+    return uploads->next_ticket;
+}
+
+static void image_layout_barrier(
+    VkCommandBuffer cmd_buffer,
+    VkImage image,
+    VkImageLayout old_layout,
+    VkImageLayout new_layout,
+    VkAccessFlags src_access,
+    VkAccessFlags dst_access,
+    VkPipelineStageFlags src_stage,
+    VkPipelineStageFlags dst_stage)
+{
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = src_access;
+    barrier.dstAccessMask = dst_access;
+    barrier.oldLayout = old_layout;
+    barrier.newLayout = new_layout;
+    // images uploaded here are concurrent between the transfer and graphics families, no ownership transfer
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    vkCmdPipelineBarrier(cmd_buffer, src_stage, dst_stage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+u64 upload_image(UploadManager* uploads, VkImage dst, VkExtent3D extent, u32 texel_size, const void* data)
+{
+    TINY_PROFILE_SCOPE("upload_image");
+    // same half-the-ring limit per chunk as buffers. Chunks are as many whole slices as fit,
+    // and when a slice is bigger than that on its own, as many whole rows as fit.
+    // Chunk boundaries also have to land on multiples of the transfer queue's granularity (or the image's edge)
+    const VkDeviceSize row_size = (VkDeviceSize)extent.width * texel_size;
+    const VkDeviceSize slice_size = row_size * extent.height;
+    const VkDeviceSize max_chunk = uploads->ring_size / 2;
+    const VkExtent3D granularity = uploads->image_granularity;
+    u32 slices_per_chunk = 0;
+    u32 rows_per_chunk = 0;
+    if (granularity.width == 0 || granularity.height == 0 || granularity.depth == 0)
+    {
+        // whole image copies only. find_queue_families avoids families like this, so it's not expected to happen
+        slices_per_chunk = extent.depth;
+        rows_per_chunk = extent.height;
+    }
+    else if (slice_size * granularity.depth <= max_chunk)
+    {
+        slices_per_chunk = (u32)(max_chunk / slice_size) / granularity.depth * granularity.depth;
+        rows_per_chunk = extent.height;
+    }
+    else
+    {
+        slices_per_chunk = granularity.depth < extent.depth ? granularity.depth : extent.depth;
+        rows_per_chunk = (u32)(max_chunk / (row_size * slices_per_chunk)) / granularity.height * granularity.height;
+    }
+    if (rows_per_chunk == 0 || row_size * rows_per_chunk * slices_per_chunk > max_chunk)
+    {
+        LOG_FATAL("Image of %ux%ux%u (%u byte texels) can't be split to fit the upload ring (%llu bytes) at transfer granularity %ux%ux%u",
+            extent.width, extent.height, extent.depth, texel_size, (unsigned long long)uploads->ring_size,
+            granularity.width, granularity.height, granularity.depth);
+        exit(EXIT_FAILURE);
+    }
+    bool first = true;
+    for (u32 z = 0; z < extent.depth; z += slices_per_chunk)
+    {
+        for (u32 y = 0; y < extent.height; y += rows_per_chunk)
+        {
+            u32 num_slices = extent.depth - z < slices_per_chunk ? extent.depth - z : slices_per_chunk;
+            u32 num_rows = extent.height - y < rows_per_chunk ? extent.height - y : rows_per_chunk;
+            VkDeviceSize chunk = row_size * num_rows * num_slices;
+            VkDeviceSize ring_offset = ring_alloc(uploads, chunk);
+            UploadBatch& batch = begin_batch(uploads);
+            if (first)
+            {
+                image_layout_barrier(batch.cmd_buffer, dst, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                    0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+                first = false;
+            }
+            TMEMCPY((u8*)uploads->ring_mem.mapped + ring_offset, (const u8*)data + slice_size * z + row_size * y, chunk);
+            VkBufferImageCopy region = {};
+            region.bufferOffset = ring_offset;
+            region.bufferRowLength = 0; // tightly packed
+            region.bufferImageHeight = 0;
+            region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+            region.imageOffset = VkOffset3D{0, (s32)y, (s32)z};
+            region.imageExtent = VkExtent3D{extent.width, num_rows, num_slices};
+            vkCmdCopyBufferToImage(batch.cmd_buffer, uploads->ring_buffer, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+            batch.num_copies++;
+        }
+    }
+    // copies that went into earlier batches are earlier in this queue's submission order, so this covers them too.
+    // The graphics queue's wait on the batch semaphore makes the result visible to its shaders
+    UploadBatch& batch = begin_batch(uploads);
+    image_layout_barrier(batch.cmd_buffer, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_ACCESS_TRANSFER_WRITE_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+    uploads->total_bytes_uploaded += slice_size * extent.depth;
+    return uploads->next_ticket;
+}
+
+u64 upload_flush(UploadManager* uploads)
+{
+    UploadBatch& batch = uploads->batches[uploads->next_ticket % UPLOAD_MAX_BATCHES];
+    if (!batch.recording)
+    {
+        // nothing recorded. The last submitted batch is the newest thing there is to wait on
+        return uploads->next_ticket > 0 ? uploads->next_ticket - 1 : 0;
+    }
+    TINY_PROFILE_SCOPE("upload_flush");
+    vkEndCommandBuffer(batch.cmd_buffer);
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &batch.cmd_buffer;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = &batch.done_semaphore;
+    VkResult result = vkQueueSubmit(uploads->transfer_queue, 1, &submit_info, batch.fence);
+    if (result != VK_SUCCESS)
+    {
+        LOG_ERROR("Upload batch submit failed (%i)", result);
+    }
+    batch.recording = false;
+    batch.semaphore_needs_wait = true;
+    batch.ring_end = uploads->ring_head;
+    return uploads->next_ticket++;
+}
+
+bool upload_is_complete(UploadManager* uploads, u64 ticket)
+{
+    retire_completed(uploads);
+    return ticket < uploads->retired_ticket;
+}
+
+void upload_wait(UploadManager* uploads, u64 ticket)
+{
+    if (ticket >= uploads->next_ticket)
+    {
+        upload_flush(uploads);
+    }
+    while (uploads->retired_ticket <= ticket && uploads->retired_ticket < uploads->next_ticket)
+    {
+        wait_oldest(uploads);
+    }
+}
+
+u32 upload_take_wait_semaphores(UploadManager* uploads, VkSemaphore* semaphores_out, VkFence consumer_fence)
+{
+    upload_flush(uploads);
+    u32 count = 0;
+    for (u64 ticket = uploads->retired_ticket; ticket < uploads->next_ticket; ticket++)
+    {
+        UploadBatch& batch = uploads->batches[ticket % UPLOAD_MAX_BATCHES];
+        if (batch.semaphore_needs_wait)
+        {
+            semaphores_out[count++] = batch.done_semaphore;
+            batch.semaphore_needs_wait = false;
+            batch.consumer_fence = consumer_fence;
+        }
+    }
+    return count;
+}
+
+void upload_consumer_fence_signaled(UploadManager* uploads, VkFence consumer_fence)
+{
+    for (u32 i = 0; i < UPLOAD_MAX_BATCHES; i++)
+    {
+        if (uploads->batches[i].consumer_fence == consumer_fence)
+        {
+            uploads->batches[i].consumer_fence = VK_NULL_HANDLE;
+        }
+    }
+}
+
+u32 upload_sharing_families(const UploadManager* uploads, u32 families_out[2])
+{
+    families_out[0] = uploads->graphics_family;
+    if (uploads->transfer_family == uploads->graphics_family)
+    {
+        return 1;
+    }
+    families_out[1] = uploads->transfer_family;
+    return 2;
+}
+
+void upload_manager_destroy(UploadManager* uploads, GpuAllocator* allocator)
+{
+    upload_flush(uploads);
+    while (uploads->retired_ticket < uploads->next_ticket)
+    {
+        wait_oldest(uploads);
+    }
+    LOG_INFO("Upload manager: %.2f MB uploaded, %u stalls", uploads->total_bytes_uploaded / (1024.0 * 1024.0), uploads->num_stalls);
+    for (u32 i = 0; i < UPLOAD_MAX_BATCHES; i++)
+    {
+        vkDestroyFence(uploads->logical_device, uploads->batches[i].fence, nullptr);
+        vkDestroySemaphore(uploads->logical_device, uploads->batches[i].done_semaphore, nullptr);
+    }
+    vkDestroyCommandPool(uploads->logical_device, uploads->cmd_pool, nullptr);
+    vkDestroyBuffer(uploads->logical_device, uploads->ring_buffer, nullptr);
+    gpu_free(allocator, uploads->ring_mem);
+}
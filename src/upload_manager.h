@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "defines.h"
+#include "gpu_allocator.h"
+
+// batched, asynchronous uploads through one persistently mapped staging ring.
+// upload_* calls memcpy into the ring and record copies into the batch currently being recorded.
+// upload_flush submits that batch to the transfer queue with a fence (so the cpu can tell when its ring space is free)
+// and a semaphore that the next graphics submit waits on (so the gpu never reads half uploaded data).
+// Nothing here ever waits on a queue unless the ring or the batch list is full.
+//
+// Every upload returns the ticket of the batch it went into. Tickets only go up, so
+// "is ticket N done" is just a compare against the oldest unretired batch
+
+constexpr u32 UPLOAD_MAX_BATCHES = 4;
+constexpr VkDeviceSize UPLOAD_DEFAULT_RING_SIZE = 16 * 1024 * 1024;
+
+struct UploadBatch
+{
+    VkCommandBuffer cmd_buffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    VkSemaphore done_semaphore = VK_NULL_HANDLE; // signaled on submit, handed to the next graphics submit
+    bool semaphore_needs_wait = false; // signaled but nobody's waited on it yet
+    VkFence consumer_fence = VK_NULL_HANDLE; // fence of the graphics submit that waits on done_semaphore
+    bool recording = false;
+    u64 ring_end = 0; // ring head when this batch was submitted. Everything before it is free once the batch retires
+    u32 num_copies = 0;
+};
+
+struct UploadManager
+{
+    VkDevice logical_device = VK_NULL_HANDLE;
+    VkQueue transfer_queue = VK_NULL_HANDLE;
+    u32 transfer_family = 0;
+    // minImageTransferGranularity of transfer_family. Image copies are split on multiples of it. (0,0,0) = whole images only
+    VkExtent3D image_granularity = {1, 1, 1};
+    u32 graphics_family = 0;
+    VkCommandPool cmd_pool = VK_NULL_HANDLE;
+    UploadBatch batches[UPLOAD_MAX_BATCHES] = {};
+    u64 next_ticket = 0; // the batch being recorded. Batch for ticket t is batches[t % UPLOAD_MAX_BATCHES]
+    u64 retired_ticket = 0; // every ticket below this is done
+    // staging ring. head/tail are monotonic byte counters, position in the buffer is counter % ring_size
+    VkBuffer ring_buffer = VK_NULL_HANDLE;
+    GpuAllocation ring_mem = {};
+    VkDeviceSize ring_size = 0;
+    u64 ring_head = 0;
+    u64 ring_tail = 0;
+    // stats
+    u64 total_bytes_uploaded = 0;
+    u32 num_stalls = 0; // times an upload had to wait on the gpu for ring/batch space
+};
+
+void upload_manager_init(
+    UploadManager* uploads,
+    GpuAllocator* allocator,
+    VkPhysicalDevice physical_device,
+    VkQueue transfer_queue,
+    u32 transfer_family,
+    u32 graphics_family,
+    VkDeviceSize ring_size);
+// waits for everything in flight
+void upload_manager_destroy(UploadManager* uploads, GpuAllocator* allocator);
+
+// queue families a resource that's uploaded here and then used for rendering has to be shared between.
+// Resources are created VK_SHARING_MODE_CONCURRENT across these when there's a dedicated transfer family,
+// so no queue family ownership transfers are needed. Returns how many were written (1 or 2)
+u32 upload_sharing_families(const UploadManager* uploads, u32 families_out[2]);
+
+u64 upload_buffer(UploadManager* uploads, VkBuffer dst, VkDeviceSize dst_offset, const void* data, VkDeviceSize size);
+// whole mip 0 of a 2D or 3D image, tightly packed rows of texel_size bytes. Takes the image from UNDEFINED
+// (old contents are dropped) and leaves it in SHADER_READ_ONLY_OPTIMAL once the batch has executed
+u64 upload_image(UploadManager* uploads, VkImage dst, VkExtent3D extent, u32 texel_size, const void* data);
+// submits whatever's been recorded since the last flush. Returns the ticket that was submitted
+u64 upload_flush(UploadManager* uploads);
+// retires finished batches, never waits
+bool upload_is_complete(UploadManager* uploads, u64 ticket);
+// cpu side wait. Flushes first if the ticket is still recording
+void upload_wait(UploadManager* uploads, u64 ticket);
+
+// flushes, then writes out the semaphores of every submitted batch the graphics queue hasn't waited on yet
+// (at most UPLOAD_MAX_BATCHES). The caller must wait on all of them in its next submit, which signals consumer_fence.
+// That fence tells us when the semaphore's wait has executed and it can be signaled again
+u32 upload_take_wait_semaphores(UploadManager* uploads, VkSemaphore* semaphores_out, VkFence consumer_fence);
+// call once a consumer fence has been waited on, before it's reset. Otherwise a later upload could end up waiting on a reset fence
+void upload_consumer_fence_signaled(UploadManager* uploads, VkFence consumer_fence);
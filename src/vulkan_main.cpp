@@ -3,6 +3,8 @@
 #include "tiny/tiny_log.h"
 #include "tiny/tiny_mem.h"
 #include "tiny/tiny_arena.h"
+#include "tiny/tiny_scratch.h"
+#include "tiny/tiny_profile.h"
 
 
 #define IMGUI_IMPLEMENTATION
@@ -12,6 +14,7 @@
 
 #include <set>
 #include <string.h>
+#include <stdlib.h>
 #include <fstream>
 
 
@@ -31,6 +34,11 @@ struct uniform_buffer_object
     glm::mat4 proj;
     glm::vec4 resolution;
     alignas(16) CloudData cloud = {};
+    glm::vec4 prev_camera_offset; // camera the cloud history was rendered with
+    glm::vec4 temporal; // x = frame index, y = 1 if the cloud history can be reprojected
+    glm::vec4 light_grid; // x = first z slice light_grid.comp updates this frame, y = stride between updated slices
+    glm::vec4 lod; // x = fbm LOD bias in octaves
+    glm::vec4 debug; // x = StepHeatmap, y = frame slot the step counters go to
 };
 
 namespace vertex_data_test
@@ -68,6 +76,64 @@ const char* required_device_extension_names[] =
     VK_KHR_SWAPCHAIN_EXTENSION_NAME
 };
 constexpr bool validation_layers_enabled = true;
+// relative to the working directory (bin/), shaders are compiled from here at startup and on hot reload
+const char* shader_source_dir = "../src/shaders/";
+const char* shader_cache_dir = "shader_cache";
+// indexed by MainShader
+const ShaderWatch main_shader_watches[MAIN_SHADER_COUNT] = 
+{
+    {"main.vert", SHADER_STAGE_VERTEX},
+    {"main.frag", SHADER_STAGE_FRAGMENT},
+    {"clouds.comp", SHADER_STAGE_COMPUTE},
+    {"composite.frag", SHADER_STAGE_FRAGMENT},
+    {"light_grid.comp", SHADER_STAGE_COMPUTE},
+    {"occupancy.comp", SHADER_STAGE_COMPUTE},
+    {"occupancy_mip.comp", SHADER_STAGE_COMPUTE},
+    {"terrain_bake.comp", SHADER_STAGE_COMPUTE},
+    {"terrain_minmax.comp", SHADER_STAGE_COMPUTE},
+    {"terrain_horizon.comp", SHADER_STAGE_COMPUTE},
+    {"sdf_bricks.comp", SHADER_STAGE_COMPUTE},
+    {"sdf_bake.comp", SHADER_STAGE_COMPUTE},
+    {"scene_cone.comp", SHADER_STAGE_COMPUTE},
+};
+// not compiled on their own, but editing them means recompiling everything above
+const char* main_shader_includes[] = {"common.glsl"};
+// fragment shaders can only write storage buffers with fragmentStoresAndAtomics. Without it they're built with this,
+// which leaves the step counter writes out of them (common.glsl)
+const ShaderDefine no_fragment_stores_define = {"NO_FRAGMENT_STORES", nullptr};
+const char* bake_cache_dir = "bake_cache";
+
+// max_steps, cloud_sample_count, light_sample_count, use_light, fbm_octaves
+const ShaderQuality quality_presets[QUALITY_PRESET_COUNT] = 
+{
+    {20, 24, 1, VK_FALSE, 5},
+    {24, 40, 2, VK_TRUE, 8},
+    {30, 64, 3, VK_TRUE, 12},
+    {48, 128, 6, VK_TRUE, 12},
+};
+const char* quality_preset_names[QUALITY_PRESET_COUNT] = {"low", "medium", "high", "ultra"};
+
+// the preset plus the toggles that aren't part of it
+ShaderQuality get_shader_quality(const RuntimeData& runtime)
+{
+    ShaderQuality quality = quality_presets[runtime.quality];
+    quality.baked_noise = runtime.procedural_noise ? VK_FALSE : VK_TRUE;
+    quality.relaxed_tracing = runtime.relaxed_tracing ? VK_TRUE : VK_FALSE;
+    quality.cone_prepass = runtime.cone_prepass ? VK_TRUE : VK_FALSE;
+    return quality;
+}
+
+QualityPreset quality_preset_from_string(const char* str)
+{
+    for (u32 i = 0; i < QUALITY_PRESET_COUNT; i++)
+    {
+        if (strcmp(str, quality_preset_names[i]) == 0)
+        {
+            return (QualityPreset)i;
+        }
+    }
+    return QUALITY_PRESET_COUNT;
+}
 
 // reads in a (binary) file into the given arena
 u8* read_file_bin(
@@ -182,12 +248,16 @@ void setup_debug_messenger(const VkInstance& instance, VkDebugUtilsMessengerEXT&
 }
 
 // returns all the vk extensions this program needs
-// including glfw required extensions
-const char** get_required_instance_extensions(Arena* arena, u32& num_required_extensions)
+// including glfw required extensions (none when headless, since we never make a surface)
+const char** get_required_instance_extensions(Arena* arena, bool headless, u32& num_required_extensions)
 {
     u32 glfw_extension_count = 0;
-    const char** glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
-    TINY_ASSERT(glfw_extensions != nullptr && "Vulkan not available on this machine!");
+    const char** glfw_extensions = nullptr;
+    if (!headless)
+    {
+        glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
+        TINY_ASSERT(glfw_extensions != nullptr && "Vulkan not available on this machine!");
+    }
     u32 num_extra_extensions = validation_layers_enabled ? 1 : 0;
     const char** extension_names = (const char**)arena_alloc(arena, sizeof(char*) * (glfw_extension_count + num_extra_extensions));
     for (u32 i = 0; i < glfw_extension_count; i++)
@@ -249,7 +319,7 @@ void init_imgui(RuntimeData& runtime)
     init_info.Device = runtime.logical_device;
     init_info.QueueFamily = runtime.indices.graphics_family.value();
     init_info.Queue = runtime.graphics_queue;
-    init_info.PipelineCache = VK_NULL_HANDLE;
+    init_info.PipelineCache = runtime.pipeline_cache.cache; // imgui's pipeline gets cached along with ours
     init_info.DescriptorPool = imguiPool;
     init_info.RenderPass = runtime.render_pass;
     init_info.Subpass = 0;
@@ -261,6 +331,7 @@ void init_imgui(RuntimeData& runtime)
 
 void imgui_tick(RuntimeData& runtime)
 {
+    TINY_PROFILE_SCOPE("imgui_tick");
     ImGui_ImplVulkan_NewFrame();
 	ImGui_ImplGlfw_NewFrame();
 	ImGui::NewFrame();
@@ -271,6 +342,31 @@ void imgui_tick(RuntimeData& runtime)
     ImGui::DragFloat("Cloud density noise scalar", &runtime.cloud.cloudDensityParams.y, 0.01f);
     ImGui::DragFloat("Cloud density noise freq", &runtime.cloud.cloudDensityParams.z, 0.01f);
     ImGui::DragFloat("Cloud density point length freq", &runtime.cloud.cloudDensityParams.w, 0.01f);
+    s32 quality = (s32)runtime.quality;
+    if (ImGui::Combo("Quality", &quality, quality_preset_names, QUALITY_PRESET_COUNT))
+    {
+        runtime.quality = (QualityPreset)quality;
+    }
+    const char* cloud_res_names[] = {"Full", "Half", "Quarter"};
+    s32 cloud_res = runtime.cloud_downsample == 1 ? 0 : runtime.cloud_downsample == 2 ? 1 : 2;
+    if (ImGui::Combo("Cloud resolution", &cloud_res, cloud_res_names, ARRAY_SIZE(cloud_res_names)))
+    {
+        runtime.cloud_downsample = 1u << cloud_res;
+    }
+    ImGui::Checkbox("Procedural cloud noise (reference)", &runtime.procedural_noise);
+    // compare the Cone + Scene gpu timings below with these on and off
+    ImGui::Checkbox("Over-relaxed sphere tracing", &runtime.relaxed_tracing);
+    ImGui::Checkbox("Cone march prepass", &runtime.cone_prepass);
+    // compare the Clouds gpu timing below at different biases
+    ImGui::SliderFloat("Noise LOD bias (octaves)", &runtime.lod_bias, -2.0f, 4.0f);
+    s32 heatmap = (s32)runtime.step_stats.heatmap;
+    if (ImGui::Combo("Step heatmap", &heatmap, step_heatmap_names, STEP_HEATMAP_COUNT))
+    {
+        runtime.step_stats.heatmap = (StepHeatmap)heatmap;
+    }
+    step_stats_imgui(&runtime.step_stats);
+    gpu_profiler_imgui(&runtime.gpu_profiler, runtime.swapchain_info.extent.width * runtime.swapchain_info.extent.height);
+    gpu_allocator_imgui(&runtime.gpu_allocator);
     // ---------------------
     ImGui::Render();
 }
@@ -306,7 +402,7 @@ bool checkValidationLayerSupport(Arena* arena)
 }
 
 
-VkInstance createInstance(Arena* arena)
+VkInstance createInstance(Arena* arena, bool headless)
 {
     VkApplicationInfo appInfo = {};
     appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
@@ -335,7 +431,7 @@ VkInstance createInstance(Arena* arena)
     createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
     createInfo.pApplicationInfo = &appInfo;
     u32 num_required_extensions = 0;
-    const char** required_instance_extensions = get_required_instance_extensions(arena, num_required_extensions);
+    const char** required_instance_extensions = get_required_instance_extensions(arena, headless, num_required_extensions);
     createInfo.enabledExtensionCount = num_required_extensions;
     createInfo.ppEnabledExtensionNames = required_instance_extensions;
     createInfo.enabledLayerCount = enabledLayerCount;
@@ -390,20 +486,43 @@ QueueFamilyIndices find_queue_families(
     for (u32 i = 0; i < queue_family_count; i++)
     {
         VkQueueFamilyProperties& queue_family = queue_family_properties[i];
-        if (queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+        if (queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT && !indices.graphics_family.has_value())
         {
             indices.graphics_family = i;
         }
-        VkBool32 present_support = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &present_support);
-        if (present_support)
+        // a transfer-only family is usually the dedicated copy engine, which runs alongside graphics work
+        // one that can only copy whole images is no use for uploading volumes in chunks, graphics does it instead
+        const VkExtent3D& granularity = queue_family.minImageTransferGranularity;
+        bool transfer_only = (queue_family.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+            !(queue_family.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) &&
+            granularity.width != 0 && granularity.height != 0 && granularity.depth != 0;
+        if (transfer_only && !indices.transfer_family.has_value())
+        {
+            indices.transfer_family = i;
+        }
+        if (surface == VK_NULL_HANDLE)
         {
-            indices.present_family = i;
+            // headless - nothing is ever presented, so the "present" queue just aliases the graphics queue
+            indices.present_family = indices.graphics_family;
         }
-        // FUTURE: might want to check for compute/transfer queues too?
+        else
+        {
+            VkBool32 present_support = false;
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &present_support);
+            if (present_support)
+            {
+                indices.present_family = i;
+            }
+        }
+        // FUTURE: might want to check for compute queues too?
 
         // once we find all the queues we want, early out
-        if (indices.is_complete()) break;
+        if (indices.is_complete() && indices.transfer_family.has_value()) break;
+    }
+    if (!indices.transfer_family.has_value())
+    {
+        // no dedicated copy queue, graphics queues can always do transfers
+        indices.transfer_family = indices.graphics_family;
     }
     arena_temp_end(arena_temp);
     return indices;
@@ -412,13 +531,14 @@ QueueFamilyIndices find_queue_families(
 struct SwapchainSupportDetails
 {
     VkSurfaceCapabilitiesKHR capabilities;
-    std::vector<VkSurfaceFormatKHR> formats;
-    std::vector<VkPresentModeKHR> present_modes;
+    BufferView<VkSurfaceFormatKHR> formats;
+    BufferView<VkPresentModeKHR> present_modes;
 };
 
-SwapchainSupportDetails query_swapchain_support(VkPhysicalDevice physical_device, VkSurfaceKHR surface)
+// the format and present mode lists go into arena, usually a scratch arena since they're only needed while picking
+SwapchainSupportDetails query_swapchain_support(Arena* arena, VkPhysicalDevice physical_device, VkSurfaceKHR surface)
 {
-    SwapchainSupportDetails details;
+    SwapchainSupportDetails details = {};
     VkResult result = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, surface, &details.capabilities);
     VK_CHECK(result);
     // formats
@@ -426,15 +546,15 @@ SwapchainSupportDetails query_swapchain_support(VkPhysicalDevice physical_device
     vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, surface, &format_count, nullptr);
     if (format_count != 0)
     {
-        details.formats.resize(format_count);
-        vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, surface, &format_count, details.formats.data());
+        details.formats = BufferView<VkSurfaceFormatKHR>::init_from_arena(arena, format_count);
+        vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, surface, &format_count, details.formats.data);
     }
     // present modes
     u32 present_mode_count;
     vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &present_mode_count, nullptr);
     if (present_mode_count != 0) {
-        details.present_modes.resize(present_mode_count);
-        vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &present_mode_count, details.present_modes.data());
+        details.present_modes = BufferView<VkPresentModeKHR>::init_from_arena(arena, present_mode_count);
+        vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &present_mode_count, details.present_modes.data);
     }
     return details;
 }
@@ -504,9 +624,11 @@ SwapchainInfo create_swapchain(
     VkPhysicalDevice physical_device,
     VkSurfaceKHR surface)
 {
-    SwapchainSupportDetails swapchain_support = query_swapchain_support(physical_device, surface);
-    VkSurfaceFormatKHR surface_format = choose_swapchain_surface_format(swapchain_support.formats.data(), swapchain_support.formats.size());
-    VkPresentModeKHR present_mode = choose_swap_present_mode(swapchain_support.present_modes.data(), swapchain_support.present_modes.size());
+    // arena is where the swapchain images go, the support lists are only needed until we've picked
+    Scratch scratch = scratch_begin(arena);
+    SwapchainSupportDetails swapchain_support = query_swapchain_support(scratch.arena, physical_device, surface);
+    VkSurfaceFormatKHR surface_format = choose_swapchain_surface_format(swapchain_support.formats.data, swapchain_support.formats.size);
+    VkPresentModeKHR present_mode = choose_swap_present_mode(swapchain_support.present_modes.data, swapchain_support.present_modes.size);
     VkExtent2D extent = choose_swap_extent(swapchain_support.capabilities);
     // how many images in the swapchain
     // using min + 1 means we never have to wait on the driver before we can aquire another image to render to
@@ -575,11 +697,18 @@ SwapchainInfo create_swapchain(
     return swapchain_info;
 }
 
+// the only device extension we need right now is the swapchain, which headless runs never touch
+u32 get_num_required_device_extensions(bool headless)
+{
+    return headless ? 0 : ARRAY_SIZE(required_device_extension_names);
+}
+
 bool does_physical_device_have_required_extensions(
     Arena* arena,
-    VkPhysicalDevice physical_device)
+    VkPhysicalDevice physical_device,
+    bool headless)
 {
-    u32 num_required_extensions = ARRAY_SIZE(required_device_extension_names);
+    u32 num_required_extensions = get_num_required_device_extensions(headless);
     u32 device_extension_count;
     vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &device_extension_count, nullptr);
     ArenaTemp arena_temp = arena_temp_init(arena);
@@ -612,8 +741,16 @@ bool does_physical_device_have_required_extensions(
     return has_all_extensions;
 }
 
+bool is_dedicated_gpu(const VkPhysicalDevice& device)
+{
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(device, &deviceProperties);
+    return deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU;
+}
+
 bool is_physical_device_suitable(Arena* arena, const VkPhysicalDevice& device, VkSurfaceKHR surface)
 {
+    bool headless = surface == VK_NULL_HANDLE;
     QueueFamilyIndices indices = find_queue_families(arena, device, surface);
     // some programs create a "rating" system. If there's multiple gpus
     // you give them each a score, big points for being a dedicated gpu,
@@ -623,19 +760,22 @@ bool is_physical_device_suitable(Arena* arena, const VkPhysicalDevice& device, V
     VkPhysicalDeviceFeatures deviceFeatures;
     vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
     // device must have all the extensions we use
-    bool device_has_required_extensions = does_physical_device_have_required_extensions(arena, device);
-    bool swapchain_adequate = false;
+    bool device_has_required_extensions = does_physical_device_have_required_extensions(arena, device, headless);
+    // headless never creates a swapchain, so there's nothing to be inadequate
+    bool swapchain_adequate = headless;
     // if we have all extensions, that means we have swapchain support... lets test if its good enough
-    if (device_has_required_extensions)
+    if (device_has_required_extensions && !headless)
     {
-        SwapchainSupportDetails swapchain_support = query_swapchain_support(device, surface);
-        swapchain_adequate = !swapchain_support.formats.empty() && !swapchain_support.present_modes.empty();
+        Scratch scratch = scratch_begin(arena);
+        SwapchainSupportDetails swapchain_support = query_swapchain_support(scratch.arena, device, surface);
+        swapchain_adequate = swapchain_support.formats.size != 0 && swapchain_support.present_modes.size != 0;
     }
-    // only use dedicated gpus
-    bool is_dedicated_gpu = deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU;
+    // only use dedicated gpus when windowed.
+    // headless render nodes and CI boxes may only have an integrated gpu or a software ICD (lavapipe/swiftshader)
+    bool is_dedicated = is_dedicated_gpu(device);
    
     return 
-        is_dedicated_gpu && 
+        (is_dedicated || headless) && 
         indices.is_complete() && 
         device_has_required_extensions && 
         swapchain_adequate;
@@ -662,7 +802,8 @@ VkPhysicalDevice find_physical_device(
         if (is_physical_device_suitable(arena, device, surface))
         {
             chosen_physical_device = device;
-            break;
+            // headless may settle for a non-dedicated device, but keep looking in case there's a dedicated one
+            if (is_dedicated_gpu(device)) break;
         }
     }
     if (chosen_physical_device == VK_NULL_HANDLE)
@@ -682,7 +823,7 @@ u32 get_queue_create_infos(
 {
     QueueFamilyIndices indices = find_queue_families(arena, physical_device, surface);
     // ensure no duplicates since graphics/present/etc might share a queue family
-    std::set<u32> unique_queue_families = {indices.graphics_family.value(), indices.present_family.value()};
+    std::set<u32> unique_queue_families = {indices.graphics_family.value(), indices.present_family.value(), indices.transfer_family.value()};
     u32 num_unique_queue_families = unique_queue_families.size();
     VkDeviceQueueCreateInfo* q_create_infos = (VkDeviceQueueCreateInfo*)arena_alloc(arena, sizeof(VkDeviceQueueCreateInfo) * num_unique_queue_families);
     f32 queue_priority = 1.0f;
@@ -712,9 +853,18 @@ VkDevice create_logical_device(
     TINY_ASSERT(queue_create_infos != nullptr);
 
     VkPhysicalDeviceFeatures device_features = {};
-    // leaving everything false for now... one would query for features if needed
+    // leaving (almost) everything false for now... one would query for features if needed
     // features include things like geometry shaders, tesselation shaders, multi draw indirect, etc....
-    //vkGetPhysicalDeviceFeatures(device, device_features);
+    VkPhysicalDeviceFeatures supported_features = {};
+    vkGetPhysicalDeviceFeatures(physical_device, &supported_features);
+    // lets the gpu profiler count fragment invocations. Optional
+    device_features.pipelineStatisticsQuery = supported_features.pipelineStatisticsQuery;
+    // main.frag adds into the step counters (StepStats). Every desktop gpu has it
+    device_features.fragmentStoresAndAtomics = supported_features.fragmentStoresAndAtomics;
+    if (!supported_features.fragmentStoresAndAtomics)
+    {
+        LOG_WARN("fragmentStoresAndAtomics not supported, the scene pass's step counters are compiled out (its heatmap still works)");
+    }
 
     VkDeviceCreateInfo create_info = {};
     create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -722,7 +872,7 @@ VkDevice create_logical_device(
     create_info.queueCreateInfoCount = num_queues;
     create_info.pEnabledFeatures = &device_features;
     create_info.ppEnabledExtensionNames = required_device_extension_names;
-    create_info.enabledExtensionCount = ARRAY_SIZE(required_device_extension_names);
+    create_info.enabledExtensionCount = get_num_required_device_extensions(surface == VK_NULL_HANDLE);
     // in past implementations of vulkan, device and instance validation layers
     // were seperate - and needed to be set like this in both the instance *and* logical device
     // this isn't the case nowadays, but setting them here helps be compatible with older versions
@@ -806,7 +956,8 @@ VkShaderModule create_shader_module(
 VkRenderPass create_render_pass(
     Arena* arena,
     VkDevice logical_device,
-    const SwapchainInfo& swapchain)
+    const SwapchainInfo& swapchain,
+    bool headless)
 {
     // attachment description
     VkAttachmentDescription color_attachment = {};
@@ -820,7 +971,8 @@ VkRenderPass create_render_pass(
     // VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL: Images used as color attachment | VK_IMAGE_LAYOUT_PRESENT_SRC_KHR: Images to be presented in the swap chain | VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL: Images to be used as destination for a memory copy operation
     // don't care about previous image layout (since we clear it when loading (loadOp)), but image should be ready for presentation after rendering
     color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    // headless images are never presented, only ever copied out of
+    color_attachment.finalLayout = headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     // subpasses
     VkAttachmentReference color_attachment_ref = {};
@@ -832,13 +984,22 @@ VkRenderPass create_render_pass(
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &color_attachment_ref;
 
-    VkSubpassDependency dependency = {};
+    VkSubpassDependency dependencies[2] = {};
+    VkSubpassDependency& dependency = dependencies[0];
     dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
     dependency.dstSubpass = 0;
     dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
     dependency.srcAccessMask = 0;
     dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
     dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    // headless frames get copied out of right after the render pass, so color writes must land before the transfer reads them
+    VkSubpassDependency& readback_dependency = dependencies[1];
+    readback_dependency.srcSubpass = 0;
+    readback_dependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+    readback_dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    readback_dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    readback_dependency.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    readback_dependency.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
 
     VkRenderPassCreateInfo render_pass_info = {};
     render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -846,27 +1007,66 @@ VkRenderPass create_render_pass(
     render_pass_info.pAttachments = &color_attachment;
     render_pass_info.subpassCount = 1;
     render_pass_info.pSubpasses = &subpass;
-    render_pass_info.dependencyCount = 1;
-    render_pass_info.pDependencies = &dependency;
+    render_pass_info.dependencyCount = headless ? 2 : 1;
+    render_pass_info.pDependencies = dependencies;
 
     VkRenderPass render_pass = {};  
     VkResult result = vkCreateRenderPass(logical_device, &render_pass_info, nullptr, &render_pass);
     return render_pass;
 }
 
+VkPipelineLayout create_pipeline_layout(
+    VkDevice logical_device,
+    const VkDescriptorSetLayout* descriptor_set_layouts,
+    u32 num_descriptor_set_layouts)
+{
+    VkPipelineLayoutCreateInfo pipline_layout_info = {};
+    pipline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipline_layout_info.setLayoutCount = num_descriptor_set_layouts;
+    pipline_layout_info.pSetLayouts = descriptor_set_layouts;
+    pipline_layout_info.pushConstantRangeCount = 0;
+    pipline_layout_info.pPushConstantRanges = nullptr;
+    VkPipelineLayout pipeline_layout = {};
+    VkResult result = vkCreatePipelineLayout(logical_device, &pipline_layout_info, nullptr, &pipeline_layout);
+    VK_CHECK(result);
+    return pipeline_layout;
+}
+
+// quality tiers. Every field of ShaderQuality is a 4 byte constant, constant_id = field index
+constexpr u32 NUM_QUALITY_CONSTANTS = sizeof(ShaderQuality) / sizeof(u32);
+VkSpecializationInfo get_quality_specialization(
+    const ShaderQuality& quality,
+    VkSpecializationMapEntry (&entries_out)[NUM_QUALITY_CONSTANTS])
+{
+    for (u32 i = 0; i < NUM_QUALITY_CONSTANTS; i++)
+    {
+        entries_out[i].constantID = i;
+        entries_out[i].offset = i * sizeof(u32);
+        entries_out[i].size = sizeof(u32);
+    }
+    VkSpecializationInfo info = {};
+    info.mapEntryCount = NUM_QUALITY_CONSTANTS;
+    info.pMapEntries = entries_out;
+    info.dataSize = sizeof(ShaderQuality);
+    info.pData = &quality;
+    return info;
+}
+
+// the layout outlives the pipeline, so hot reloaded shaders only need a new pipeline
 VkPipeline create_graphics_pipeline(
-    Arena* arena,
     VkDevice logical_device,
-    VkDescriptorSetLayout descriptor_set_layout,
+    VkPipelineCache pipeline_cache,
+    VkPipelineLayout pipeline_layout,
     const SwapchainInfo& swapchain,
     VkRenderPass render_pass,
-    VkPipelineLayout& pipeline_layout_out)
+    u32 num_color_attachments,
+    bool alpha_blend,
+    const std::vector<u32>& vert_spirv,
+    const std::vector<u32>& frag_spirv,
+    const ShaderQuality& quality)
 {
-    size_t vert_binary_size, frag_binary_size;
-    u8* vert_binary = read_file_bin(arena, "../src/shaders/built/vert.spv", &vert_binary_size);
-    u8* frag_binary = read_file_bin(arena, "../src/shaders/built/frag.spv", &frag_binary_size);
-    VkShaderModule vert_shader_module = create_shader_module(logical_device, vert_binary, vert_binary_size);
-    VkShaderModule frag_shader_module = create_shader_module(logical_device, frag_binary, frag_binary_size);
+    VkShaderModule vert_shader_module = create_shader_module(logical_device, (u8*)vert_spirv.data(), vert_spirv.size() * sizeof(u32));
+    VkShaderModule frag_shader_module = create_shader_module(logical_device, (u8*)frag_spirv.data(), frag_spirv.size() * sizeof(u32));
 
     // shader stage creation - need to assign each shader binary to different stages of the graphics pipeline
     // vert
@@ -879,12 +1079,15 @@ VkPipeline create_graphics_pipeline(
     // lets us use a single shader module with different constants to specify behavior at pipeline creation
     vert_stage_info.pSpecializationInfo = nullptr; 
 
+    VkSpecializationMapEntry quality_entries[NUM_QUALITY_CONSTANTS] = {};
+    VkSpecializationInfo quality_info = get_quality_specialization(quality, quality_entries);
+
     VkPipelineShaderStageCreateInfo fragshader_stage_info = {};
     fragshader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     fragshader_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
     fragshader_stage_info.module = frag_shader_module;
     fragshader_stage_info.pName = "main";
-    fragshader_stage_info.pSpecializationInfo = nullptr; 
+    fragshader_stage_info.pSpecializationInfo = &quality_info; 
     
     VkPipelineShaderStageCreateInfo shader_stages[] = {vert_stage_info, fragshader_stage_info};
 
@@ -972,38 +1175,35 @@ VkPipeline create_graphics_pipeline(
     // Color blending
     // VkPipelineColorBlendAttachmentState - color blend config per framebuffer
     // VkPipelineColorBlendStateCreateInfo - global color blending config
-    VkPipelineColorBlendAttachmentState color_blend_attachment{};
-    color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    color_blend_attachment.blendEnable = VK_TRUE;
-    // alpha blending
-    color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-    color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-    color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
-    color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-    color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-    color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
  
+    // same state for every attachment. Blending is off for the scene pass, its R32F depth target usually can't blend anyway
+    VkPipelineColorBlendAttachmentState color_blend_attachments[2] = {};
+    TINY_ASSERT(num_color_attachments <= ARRAY_SIZE(color_blend_attachments));
+    for (u32 i = 0; i < num_color_attachments; i++)
+    {
+        VkPipelineColorBlendAttachmentState& color_blend_attachment = color_blend_attachments[i];
+        color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        color_blend_attachment.blendEnable = alpha_blend ? VK_TRUE : VK_FALSE;
+        // alpha blending
+        color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+        color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+        color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+        color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+    }
+
     VkPipelineColorBlendStateCreateInfo color_blending = {};
     color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
     color_blending.logicOpEnable = VK_FALSE; // blending with bitwise operation specified in logicOp
     color_blending.logicOp = VK_LOGIC_OP_COPY; // Optional
-    color_blending.attachmentCount = 1;
-    color_blending.pAttachments = &color_blend_attachment;
+    color_blending.attachmentCount = num_color_attachments;
+    color_blending.pAttachments = color_blend_attachments;
     color_blending.blendConstants[0] = 0.0f; // Optional
     color_blending.blendConstants[1] = 0.0f; // Optional
     color_blending.blendConstants[2] = 0.0f; // Optional
     color_blending.blendConstants[3] = 0.0f; // Optional
 
-    // Pipeline layout
-    VkPipelineLayoutCreateInfo pipline_layout_info = {};
-    pipline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipline_layout_info.setLayoutCount = 1;
-    pipline_layout_info.pSetLayouts = &descriptor_set_layout;
-    pipline_layout_info.pushConstantRangeCount = 0;
-    pipline_layout_info.pPushConstantRanges = nullptr;
-    VkResult result = vkCreatePipelineLayout(logical_device, &pipline_layout_info, nullptr, &pipeline_layout_out);
-    VK_CHECK(result);
-
     VkGraphicsPipelineCreateInfo pipeline_info = {};
     pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
     pipeline_info.stageCount = 2;
@@ -1016,7 +1216,7 @@ VkPipeline create_graphics_pipeline(
     pipeline_info.pDepthStencilState = nullptr; // Optional
     pipeline_info.pColorBlendState = &color_blending;
     pipeline_info.pDynamicState = &dynamic_state;
-    pipeline_info.layout = pipeline_layout_out;
+    pipeline_info.layout = pipeline_layout;
     pipeline_info.renderPass = render_pass;
     pipeline_info.subpass = 0;
     // for allowing you to create new pipelines deriving from existing ones
@@ -1024,7 +1224,7 @@ VkPipeline create_graphics_pipeline(
     pipeline_info.basePipelineHandle = VK_NULL_HANDLE; // optional
     pipeline_info.basePipelineIndex = -1; // optional
     VkPipeline pipeline = {};
-    result = vkCreateGraphicsPipelines(logical_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline);
+    VkResult result = vkCreateGraphicsPipelines(logical_device, pipeline_cache, 1, &pipeline_info, nullptr, &pipeline);
     VK_CHECK(result);
 
     vkDestroyShaderModule(logical_device, frag_shader_module, nullptr);
@@ -1033,6 +1233,65 @@ VkPipeline create_graphics_pipeline(
     return pipeline;
 }
 
+VkPipeline create_compute_pipeline(
+    VkDevice logical_device,
+    VkPipelineCache pipeline_cache,
+    VkPipelineLayout pipeline_layout,
+    const std::vector<u32>& comp_spirv,
+    const ShaderQuality& quality)
+{
+    VkShaderModule comp_shader_module = create_shader_module(logical_device, (u8*)comp_spirv.data(), comp_spirv.size() * sizeof(u32));
+    VkSpecializationMapEntry quality_entries[NUM_QUALITY_CONSTANTS] = {};
+    VkSpecializationInfo quality_info = get_quality_specialization(quality, quality_entries);
+    VkComputePipelineCreateInfo pipeline_info = {};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = comp_shader_module;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.stage.pSpecializationInfo = &quality_info;
+    pipeline_info.layout = pipeline_layout;
+    pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+    pipeline_info.basePipelineIndex = -1;
+    VkPipeline pipeline = {};
+    VkResult result = vkCreateComputePipelines(logical_device, pipeline_cache, 1, &pipeline_info, nullptr, &pipeline);
+    VK_CHECK(result);
+    vkDestroyShaderModule(logical_device, comp_shader_module, nullptr);
+    return pipeline;
+}
+
+// main_shader_watches plus whatever defines this device needs
+void get_main_shader_watches(VkPhysicalDevice physical_device, ShaderWatch* watches_out)
+{
+    VkPhysicalDeviceFeatures supported_features = {};
+    vkGetPhysicalDeviceFeatures(physical_device, &supported_features);
+    for (u32 i = 0; i < MAIN_SHADER_COUNT; i++)
+    {
+        watches_out[i] = main_shader_watches[i];
+        if (!supported_features.fragmentStoresAndAtomics && watches_out[i].stage == SHADER_STAGE_FRAGMENT)
+        {
+            watches_out[i].defines = &no_fragment_stores_define;
+            watches_out[i].num_defines = 1;
+        }
+    }
+}
+
+// compiles through shaderc (or pulls from its spirv cache)
+void load_main_shaders(ShaderCompiler* compiler, const ShaderWatch* watches, std::vector<u32>* spirv_out)
+{
+    TINY_PROFILE_FUNCTION();
+    for (u32 i = 0; i < MAIN_SHADER_COUNT; i++)
+    {
+        const ShaderWatch& shader = watches[i];
+        if (compiler == nullptr || !shader_compile(compiler, shader.filename, shader.stage, shader.defines, shader.num_defines, spirv_out[i]))
+        {
+            // nothing to fall back to, every pass needs its shader
+            LOG_FATAL("Couldn't compile %s%s", shader_source_dir, shader.filename);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
 BufferView<VkFramebuffer> create_framebuffers(
     Arena* arena,
     BufferView<VkImageView> swapchain_image_views,
@@ -1101,13 +1360,24 @@ void record_cmd_buffer(
     VkRenderPass render_pass,
     const SwapchainInfo& swapchain_info,
     BufferView<VkFramebuffer> swapchain_framebuffers,
-    VkPipeline graphics_pipeline,
+    const PipelineVariant& variant,
+    const FramePasses& passes,
+    const TerrainMap& terrain,
+    const SdfVolume& sdf,
+    const LightGrid& light_grid,
+    const OccupancyGrid& occupancy,
     VkBuffer vertex_buffer,
     VkBuffer index_buffer,
     VkPipelineLayout pipeline_layout,
-    BufferView<VkDescriptorSet> descriptor_sets,
-    u32 current_frame)
+    VkDescriptorSet descriptor_set,
+    u32 ubo_offset,
+    u32 current_frame,
+    bool draw_imgui,
+    VkBuffer readback_buffer,
+    GpuProfiler* profiler,
+    StepStats* step_stats)
 {
+    TINY_PROFILE_SCOPE("record_cmd_buffer");
     VkCommandBufferBeginInfo begin_info = {};
     begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     // VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT: The command buffer will be rerecorded right after executing it once.
@@ -1118,18 +1388,148 @@ void record_cmd_buffer(
     VkResult result = vkBeginCommandBuffer(cmd_buffer, &begin_info);
     VK_CHECK(result);
 
-    VkRenderPassBeginInfo render_pass_info = {};
-    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    render_pass_info.renderPass = render_pass;
-    TINY_ASSERT(image_index < swapchain_framebuffers.size);
-    render_pass_info.framebuffer = swapchain_framebuffers.data[image_index];
-    render_pass_info.renderArea.offset = {0, 0};
-    render_pass_info.renderArea.extent = swapchain_info.extent;
-    VkClearValue clear_color = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-    render_pass_info.clearValueCount = 1;
-    render_pass_info.pClearValues = &clear_color;
-    vkCmdBeginRenderPass(cmd_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
-    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline);
+    gpu_profiler_begin_frame(profiler, cmd_buffer, current_frame);
+    gpu_profiler_begin_scope(profiler, cmd_buffer, current_frame, GPU_SCOPE_FRAME);
+
+    VkBuffer vertexBuffers[] = {vertex_buffer};
+    VkDeviceSize offsets[] = {0};
+    vkCmdBindVertexBuffers(cmd_buffer, 0, 1, vertexBuffers, offsets);
+    vkCmdBindIndexBuffer(cmd_buffer, index_buffer, 0, VK_INDEX_TYPE_UINT32);
+
+    // 0. terrain: bake the heightfield, its min/max pyramid, the horizon map and the static sdf volume from them,
+    // when they're due (see TerrainMap)
+    if (terrain.bake_pending)
+    {
+        gpu_profiler_begin_scope(profiler, cmd_buffer, current_frame, GPU_SCOPE_TERRAIN);
+        // everything gets rewritten whole. Earlier frames' scene passes may still be reading the last bake
+        VkImageMemoryBarrier terrain_barriers[5] = {};
+        VkImage terrain_images[5] = {terrain.heightfield.image, terrain.minmax.image, terrain.horizon.image, sdf.bricks.image, sdf.volume.image};
+        u32 terrain_levels[5] = {1, TERRAIN_MINMAX_LEVELS, 1, 1, 1};
+        u32 terrain_layers[5] = {1, 1, TERRAIN_HORIZON_LAYERS, 1, 1};
+        for (u32 i = 0; i < ARRAY_SIZE(terrain_barriers); i++)
+        {
+            VkImageMemoryBarrier& barrier = terrain_barriers[i];
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = terrain_images[i];
+            barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, terrain_levels[i], 0, terrain_layers[i]};
+        }
+        vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+                             0, 0, nullptr, 0, nullptr, ARRAY_SIZE(terrain_barriers), terrain_barriers);
+
+        // each pass reads what the one before wrote, the scene pass reads all of it
+        VkImageMemoryBarrier written_barrier = terrain_barriers[0];
+        written_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        written_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        written_barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        constexpr VkPipelineStageFlags read_stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+        vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, terrain.bake_pipeline);
+        VkDescriptorSet bake_sets[] = {descriptor_set, terrain.bake_set};
+        vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, 
+                                terrain.layout, 0, ARRAY_SIZE(bake_sets), bake_sets, 1, &ubo_offset);
+        vkCmdDispatch(cmd_buffer, TERRAIN_SIZE / TERRAIN_GROUP_SIZE, TERRAIN_SIZE / TERRAIN_GROUP_SIZE, 1);
+        vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, read_stages, 
+                             0, 0, nullptr, 0, nullptr, 1, &written_barrier);
+
+        vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, terrain.minmax_pipeline);
+        written_barrier.image = terrain.minmax.image;
+        for (u32 level = 0; level < TERRAIN_MINMAX_LEVELS; level++)
+        {
+            VkDescriptorSet minmax_sets[] = {descriptor_set, terrain.minmax_sets[level]};
+            vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, 
+                                    terrain.layout, 0, ARRAY_SIZE(minmax_sets), minmax_sets, 1, &ubo_offset);
+            u32 num_groups = ((TERRAIN_SIZE >> level) + TERRAIN_GROUP_SIZE - 1) / TERRAIN_GROUP_SIZE;
+            vkCmdDispatch(cmd_buffer, num_groups, num_groups, 1);
+            written_barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+            vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, read_stages, 
+                                 0, 0, nullptr, 0, nullptr, 1, &written_barrier);
+        }
+
+        vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, terrain.horizon_pipeline);
+        VkDescriptorSet horizon_sets[] = {descriptor_set, terrain.horizon_set};
+        vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, 
+                                terrain.layout, 0, ARRAY_SIZE(horizon_sets), horizon_sets, 1, &ubo_offset);
+        vkCmdDispatch(cmd_buffer, TERRAIN_HORIZON_SIZE / TERRAIN_GROUP_SIZE, TERRAIN_HORIZON_SIZE / TERRAIN_GROUP_SIZE, 1);
+        written_barrier.image = terrain.horizon.image;
+        written_barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, TERRAIN_HORIZON_LAYERS};
+        vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 
+                             0, 0, nullptr, 0, nullptr, 1, &written_barrier);
+
+        // the sdf bakes from the heightfield and the min/max pyramid, which the barriers above already cover
+        VkDescriptorSet sdf_sets[] = {descriptor_set, sdf.set};
+        vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, 
+                                sdf.layout, 0, ARRAY_SIZE(sdf_sets), sdf_sets, 1, &ubo_offset);
+        vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, sdf.bricks_pipeline);
+        u32 num_brick_groups[3] = {};
+        u32 num_voxel_groups[3] = {};
+        u32 extent[3] = {sdf.extent.width, sdf.extent.height, sdf.extent.depth};
+        for (u32 axis = 0; axis < 3; axis++)
+        {
+            num_brick_groups[axis] = (extent[axis] / SDF_BRICK_SIZE + SDF_GROUP_SIZE - 1) / SDF_GROUP_SIZE;
+            num_voxel_groups[axis] = (extent[axis] + SDF_GROUP_SIZE - 1) / SDF_GROUP_SIZE;
+        }
+        vkCmdDispatch(cmd_buffer, num_brick_groups[0], num_brick_groups[1], num_brick_groups[2]);
+        written_barrier.image = sdf.bricks.image;
+        written_barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, read_stages, 
+                             0, 0, nullptr, 0, nullptr, 1, &written_barrier);
+        vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, sdf.bake_pipeline);
+        vkCmdDispatch(cmd_buffer, num_voxel_groups[0], num_voxel_groups[1], num_voxel_groups[2]);
+        written_barrier.image = sdf.volume.image;
+        vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 
+                             0, 0, nullptr, 0, nullptr, 1, &written_barrier);
+        gpu_profiler_end_scope(profiler, cmd_buffer, current_frame, GPU_SCOPE_TERRAIN);
+    }
+
+    // 1. cone prepass: march a cone per tile through the scene, so the scene pass can skip the empty space in front of it.
+    // The tile depths are rewritten whole, and the last frame's scene pass has to be done reading them.
+    // With the prepass off main.frag never reads them, but its descriptor still wants them in GENERAL
+    VkImageMemoryBarrier cone_barrier = {};
+    cone_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    cone_barrier.srcAccessMask = 0;
+    cone_barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    cone_barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    cone_barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    cone_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    cone_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    cone_barrier.image = passes.cone_depth.image;
+    cone_barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+                         0, 0, nullptr, 0, nullptr, 1, &cone_barrier);
+    if (variant.quality.cone_prepass)
+    {
+        gpu_profiler_begin_scope(profiler, cmd_buffer, current_frame, GPU_SCOPE_CONE);
+
+        vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, variant.cone);
+        VkDescriptorSet cone_sets[] = {descriptor_set, passes.cone_set};
+        vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, 
+                                passes.cone_layout, 0, ARRAY_SIZE(cone_sets), cone_sets, 1, &ubo_offset);
+        vkCmdDispatch(cmd_buffer, (passes.cone_extent.width + CONE_GROUP_SIZE - 1) / CONE_GROUP_SIZE, 
+                      (passes.cone_extent.height + CONE_GROUP_SIZE - 1) / CONE_GROUP_SIZE, 1);
+
+        cone_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        cone_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        cone_barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 
+                             0, 0, nullptr, 0, nullptr, 1, &cone_barrier);
+        gpu_profiler_end_scope(profiler, cmd_buffer, current_frame, GPU_SCOPE_CONE);
+    }
+
+    // 2. scene: sdf raymarch at full res into scene color + ray distance
+    VkRenderPassBeginInfo scene_pass_info = {};
+    scene_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    scene_pass_info.renderPass = passes.scene_render_pass;
+    scene_pass_info.framebuffer = passes.scene_framebuffer;
+    scene_pass_info.renderArea.offset = {0, 0};
+    scene_pass_info.renderArea.extent = passes.extent;
+    scene_pass_info.clearValueCount = 0;
+    vkCmdBeginRenderPass(cmd_buffer, &scene_pass_info, VK_SUBPASS_CONTENTS_INLINE);
 
     VkViewport viewport = {};
     viewport.x = 0.0f;
@@ -1145,20 +1545,199 @@ void record_cmd_buffer(
     scissor.extent = swapchain_info.extent;
     vkCmdSetScissor(cmd_buffer, 0, 1, &scissor);
 
-    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline);
-
-    VkBuffer vertexBuffers[] = {vertex_buffer};
-    VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(cmd_buffer, 0, 1, vertexBuffers, offsets);
-    vkCmdBindIndexBuffer(cmd_buffer, index_buffer, 0, VK_INDEX_TYPE_UINT32);
+    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, variant.scene);
+    // dynamic offset picks this draw's ubo out of the uniform ring. The cone depths are bound even when the prepass is off,
+    // main.frag just doesn't read them then
+    VkDescriptorSet scene_sets[] = {descriptor_set, passes.scene_set};
     vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 
-                            pipeline_layout, 0, 1, &descriptor_sets.data[current_frame], 0, nullptr);
+                            pipeline_layout, 0, ARRAY_SIZE(scene_sets), scene_sets, 1, &ubo_offset);
+
+    gpu_profiler_begin_scope(profiler, cmd_buffer, current_frame, GPU_SCOPE_SCENE);
+    gpu_profiler_begin_stats(profiler, cmd_buffer, current_frame);
+    vkCmdDrawIndexed(cmd_buffer, ARRAY_SIZE(vertex_data_test::indices), 1, 0, 0, 0);
+    gpu_profiler_end_stats(profiler, cmd_buffer, current_frame);
+    gpu_profiler_end_scope(profiler, cmd_buffer, current_frame, GPU_SCOPE_SCENE);
+    vkCmdEndRenderPass(cmd_buffer);
+
+    // 3. light grid: refresh whichever slices of the sun transmittance grid are due this frame (see light_grid_begin_frame),
+    // then rebuild the occupancy pyramid from its densities
+    if (light_grid.slice_stride > 0)
+    {
+        gpu_profiler_begin_scope(profiler, cmd_buffer, current_frame, GPU_SCOPE_LIGHT_GRID);
+        // earlier frames' cloud passes sample the grid, they have to be done before it's overwritten
+        VkImageMemoryBarrier grid_barrier = {};
+        grid_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        grid_barrier.srcAccessMask = 0;
+        grid_barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        // a full rebuild overwrites every texel, so there's nothing worth keeping (and the first one has no layout yet)
+        grid_barrier.oldLayout = light_grid.slice_stride == 1 ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_GENERAL;
+        grid_barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        grid_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        grid_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        grid_barrier.image = light_grid.volume.image;
+        grid_barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+                             0, 0, nullptr, 0, nullptr, 1, &grid_barrier);
+
+        vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, variant.light_grid);
+        VkDescriptorSet grid_sets[] = {descriptor_set, light_grid.set};
+        vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, 
+                                light_grid.layout, 0, ARRAY_SIZE(grid_sets), grid_sets, 1, &ubo_offset);
+        u32 num_slices = (LIGHT_GRID_SIZE - light_grid.first_slice + light_grid.slice_stride - 1) / light_grid.slice_stride;
+        vkCmdDispatch(cmd_buffer, LIGHT_GRID_SIZE / LIGHT_GRID_GROUP_SIZE, LIGHT_GRID_SIZE / LIGHT_GRID_GROUP_SIZE, num_slices);
+
+        grid_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        grid_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        grid_barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+                             0, 0, nullptr, 0, nullptr, 1, &grid_barrier);
+        gpu_profiler_end_scope(profiler, cmd_buffer, current_frame, GPU_SCOPE_LIGHT_GRID);
+
+        gpu_profiler_begin_scope(profiler, cmd_buffer, current_frame, GPU_SCOPE_OCCUPANCY);
+        // every level is rewritten whole, and earlier frames' cloud passes have to be done reading it
+        VkImageMemoryBarrier occupancy_barrier = {};
+        occupancy_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        occupancy_barrier.srcAccessMask = 0;
+        occupancy_barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        occupancy_barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        occupancy_barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        occupancy_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        occupancy_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        occupancy_barrier.image = occupancy.volume.image;
+        occupancy_barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, OCCUPANCY_LEVELS, 0, 1};
+        vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+                             0, 0, nullptr, 0, nullptr, 1, &occupancy_barrier);
+        for (u32 level = 0; level < OCCUPANCY_LEVELS; level++)
+        {
+            vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, level == 0 ? occupancy.build_pipeline : occupancy.mip_pipeline);
+            VkDescriptorSet occupancy_sets[] = {descriptor_set, occupancy.sets[level]};
+            vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, 
+                                    occupancy.layout, 0, ARRAY_SIZE(occupancy_sets), occupancy_sets, 1, &ubo_offset);
+            u32 level_size = OCCUPANCY_SIZE >> level;
+            u32 num_groups = (level_size + OCCUPANCY_GROUP_SIZE - 1) / OCCUPANCY_GROUP_SIZE;
+            vkCmdDispatch(cmd_buffer, num_groups, num_groups, num_groups);
+            // the next level reads this one, the cloud pass reads them all
+            occupancy_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            occupancy_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            occupancy_barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+            occupancy_barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+            vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+                                 0, 0, nullptr, 0, nullptr, 1, &occupancy_barrier);
+        }
+        gpu_profiler_end_scope(profiler, cmd_buffer, current_frame, GPU_SCOPE_OCCUPANCY);
+    }
+
+    // 4. clouds: compute at 1/cloud_downsample res. The scene pass' outgoing dependency covers the depth read.
+    // Writes this slot's cloud images, reads the previous slot's as history
+    gpu_profiler_begin_scope(profiler, cmd_buffer, current_frame, GPU_SCOPE_CLOUDS);
+    u32 prev_frame = (current_frame + MAX_FRAMES_IN_FLIGHT - 1) % MAX_FRAMES_IN_FLIGHT;
+    VkImageMemoryBarrier cloud_barriers[4] = {};
+    VkImage cloud_images[4] = 
+    {
+        passes.cloud_color[current_frame].image, passes.cloud_depth[current_frame].image,
+        passes.cloud_color[prev_frame].image, passes.cloud_depth[prev_frame].image
+    };
+    // fresh images have never been written, the history ones still need a layout the descriptors agree with
+    u32 num_cloud_barriers = passes.history_frames == 0 ? 4 : 2;
+    for (u32 i = 0; i < num_cloud_barriers; i++)
+    {
+        // last frame's cloud pass (history read) and the composite before that have to be done reading. Old contents are thrown away
+        bool history = i >= 2;
+        cloud_barriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        cloud_barriers[i].srcAccessMask = 0;
+        cloud_barriers[i].dstAccessMask = history ? VK_ACCESS_SHADER_READ_BIT : VK_ACCESS_SHADER_WRITE_BIT;
+        cloud_barriers[i].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        cloud_barriers[i].newLayout = history ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+        cloud_barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        cloud_barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        cloud_barriers[i].image = cloud_images[i];
+        cloud_barriers[i].subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    }
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+                         0, 0, nullptr, 0, nullptr, num_cloud_barriers, cloud_barriers);
+
+    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, variant.clouds);
+    VkDescriptorSet clouds_sets[] = {descriptor_set, passes.clouds_sets[current_frame]};
+    vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, 
+                            passes.clouds_layout, 0, ARRAY_SIZE(clouds_sets), clouds_sets, 1, &ubo_offset);
+    vkCmdDispatch(cmd_buffer, 
+                  (passes.cloud_extent.width + CLOUD_GROUP_SIZE - 1) / CLOUD_GROUP_SIZE, 
+                  (passes.cloud_extent.height + CLOUD_GROUP_SIZE - 1) / CLOUD_GROUP_SIZE, 1);
+
+    // read by the composite below, and as history by the next frame's cloud pass
+    for (u32 i = 0; i < 2; i++)
+    {
+        cloud_barriers[i].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        cloud_barriers[i].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        cloud_barriers[i].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        cloud_barriers[i].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+                         0, 0, nullptr, 0, nullptr, 2, cloud_barriers);
+    gpu_profiler_end_scope(profiler, cmd_buffer, current_frame, GPU_SCOPE_CLOUDS);
+
+    // 4. composite: depth-aware upsample of the clouds over the scene, straight into the swapchain image
+    VkRenderPassBeginInfo render_pass_info = {};
+    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    render_pass_info.renderPass = render_pass;
+    TINY_ASSERT(image_index < swapchain_framebuffers.size);
+    render_pass_info.framebuffer = swapchain_framebuffers.data[image_index];
+    render_pass_info.renderArea.offset = {0, 0};
+    render_pass_info.renderArea.extent = swapchain_info.extent;
+    VkClearValue clear_color = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
+    render_pass_info.clearValueCount = 1;
+    render_pass_info.pClearValues = &clear_color;
+    vkCmdBeginRenderPass(cmd_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
 
+    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, passes.composite_pipeline);
+    VkDescriptorSet composite_sets[] = {descriptor_set, passes.composite_sets[current_frame]};
+    vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 
+                            passes.composite_layout, 0, ARRAY_SIZE(composite_sets), composite_sets, 1, &ubo_offset);
+    gpu_profiler_begin_scope(profiler, cmd_buffer, current_frame, GPU_SCOPE_COMPOSITE);
     vkCmdDrawIndexed(cmd_buffer, ARRAY_SIZE(vertex_data_test::indices), 1, 0, 0, 0);
+    gpu_profiler_end_scope(profiler, cmd_buffer, current_frame, GPU_SCOPE_COMPOSITE);
 
-    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd_buffer);
+    if (draw_imgui)
+    {
+        gpu_profiler_begin_scope(profiler, cmd_buffer, current_frame, GPU_SCOPE_IMGUI);
+        ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd_buffer);
+        gpu_profiler_end_scope(profiler, cmd_buffer, current_frame, GPU_SCOPE_IMGUI);
+    }
 
     vkCmdEndRenderPass(cmd_buffer);
+
+    if (readback_buffer != VK_NULL_HANDLE)
+    {
+        gpu_profiler_begin_scope(profiler, cmd_buffer, current_frame, GPU_SCOPE_READBACK);
+        // render pass already left the image in TRANSFER_SRC_OPTIMAL
+        VkBufferImageCopy region = {};
+        region.bufferOffset = 0;
+        region.bufferRowLength = 0; // tightly packed
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = {0, 0, 0};
+        region.imageExtent = {swapchain_info.extent.width, swapchain_info.extent.height, 1};
+        vkCmdCopyImageToBuffer(cmd_buffer, swapchain_info.swapchain_images.data[image_index], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback_buffer, 1, &region);
+        // make the copy visible to the host once the fence for this frame signals
+        VkBufferMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = readback_buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+        gpu_profiler_end_scope(profiler, cmd_buffer, current_frame, GPU_SCOPE_READBACK);
+    }
+
+    step_stats_record_readback(step_stats, cmd_buffer);
+    gpu_profiler_end_scope(profiler, cmd_buffer, current_frame, GPU_SCOPE_FRAME);
+
     result = vkEndCommandBuffer(cmd_buffer);
     VK_CHECK(result);
 
@@ -1194,189 +1773,120 @@ void create_sync_objects(
     }
 }
 
-// find memory type to allocate based on the device's properties, as well as desired properties/types
-u32 find_memory_type(
-    VkPhysicalDevice physical_device,
-    u32 type_filter, 
-    VkMemoryPropertyFlags properties)
-{
-    VkPhysicalDeviceMemoryProperties mem_props = {};
-    vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_props);
-    // find memory type suitable for the given type filter
-    for (u32 i = 0; i < mem_props.memoryTypeCount; i++)
-    {
-        // does this mem type support all the properties we need?
-        bool mem_properties_supported = (mem_props.memoryTypes[i].propertyFlags & properties) == properties;
-        if (type_filter & (1 << i) && mem_properties_supported)
-        {
-            return i;
-        }
-    }
-    return U32_INVALID_ID;
-}
-
-VkDeviceMemory alloc_mem(
-    VkDevice logical_device,
-    VkPhysicalDevice physical_device,
-    VkBuffer buffer)
-{
-    // what mem requirements does this particular buffer have?
-    VkMemoryRequirements mem_requirements = {};
-    vkGetBufferMemoryRequirements(logical_device, buffer, &mem_requirements);
-    // actually allocate
-    VkMemoryAllocateInfo alloc_info = {};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_requirements.size;
-    alloc_info.memoryTypeIndex = find_memory_type(physical_device, mem_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    VkDeviceMemory mem = {};
-    VkResult result = vkAllocateMemory(logical_device, &alloc_info, nullptr, &mem);
-    VK_CHECK(result);
-    result = vkBindBufferMemory(logical_device, buffer, mem, 0); // associate the allocated mem with the passed in buffer
-    VK_CHECK(result);
-    return mem;
-}
-
 void create_buffer(
-    VkDevice logical_device,
-    VkPhysicalDevice physical_device,
+    GpuAllocator* allocator,
     VkDeviceSize size, 
     VkBufferUsageFlags usage, 
-    VkMemoryPropertyFlags properties,
+    GpuMemoryUsage mem_usage,
     VkBuffer& buffer, 
-    VkDeviceMemory& buffer_mem)
+    GpuAllocation& buffer_mem,
+    const u32* sharing_families = nullptr,
+    u32 num_sharing_families = 0)
 {
+    VkDevice logical_device = allocator->logical_device;
     VkBufferCreateInfo buffer_info = {};
     buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     buffer_info.size = size;
     buffer_info.usage = usage;
-    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (num_sharing_families > 1)
+    {
+        // touched by more than one queue family (e.g. filled on the transfer queue, read on graphics)
+        buffer_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        buffer_info.queueFamilyIndexCount = num_sharing_families;
+        buffer_info.pQueueFamilyIndices = sharing_families;
+    }
+    else
+    {
+        buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
     VkResult result = vkCreateBuffer(logical_device, &buffer_info, nullptr, &buffer);
     VK_CHECK(result);
-    buffer_mem = alloc_mem(logical_device, physical_device, buffer);
+    // sub-allocated out of a shared block, with the memory type picked from mem_usage
+    buffer_mem = gpu_alloc_buffer(allocator, buffer, mem_usage);
 }
 
-void copy_buffer(
-    VkDevice logical_device,
-    VkCommandPool cmd_pool,
-    VkQueue graphics_queue,
-    VkBuffer src_buffer, 
-    VkBuffer dst_buffer, 
-    VkDeviceSize size)
+// headless stand-in for create_swapchain. 
+// Makes one device-owned color image per frame in flight, so the image index is always just the current frame
+// and there's nothing to aquire or present.
+SwapchainInfo create_offscreen_swapchain(
+    Arena* arena,
+    GpuAllocator* allocator,
+    VkExtent2D extent)
 {
-    VkCommandBufferAllocateInfo alloc_info = {};
-    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    alloc_info.commandPool = cmd_pool;
-    alloc_info.commandBufferCount = 1;
-
-    VkCommandBuffer cmd_buf = {};
-    VkResult result = vkAllocateCommandBuffers(logical_device, &alloc_info, &cmd_buf);
-    VK_CHECK(result);
-
-    VkCommandBufferBeginInfo begininfo = {};
-    begininfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    begininfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    vkBeginCommandBuffer(cmd_buf, &begininfo);
-
-    VkBufferCopy copyregion = {};
-    copyregion.srcOffset = 0; // optional
-    copyregion.dstOffset = 0; // optional
-    copyregion.size = size;
-    vkCmdCopyBuffer(cmd_buf, src_buffer, dst_buffer, 1, &copyregion);
-
-    vkEndCommandBuffer(cmd_buf);
+    VkDevice logical_device = allocator->logical_device;
+    SwapchainInfo swapchain_info = {};
+    swapchain_info.swapchain = VK_NULL_HANDLE;
+    swapchain_info.extent = extent;
+    // RGBA (not BGRA like the window surface) so frames can be written out without swizzling.
+    // SRGB so the stored bytes match what would have been shown on screen
+    swapchain_info.image_format = VK_FORMAT_R8G8B8A8_SRGB;
+    swapchain_info.image_count = MAX_FRAMES_IN_FLIGHT;
+    swapchain_info.swapchain_images = BufferView<VkImage>::init_from_arena(arena, MAX_FRAMES_IN_FLIGHT);
+    swapchain_info.offscreen_image_mems = BufferView<GpuAllocation>::init_from_arena(arena, MAX_FRAMES_IN_FLIGHT);
+    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        VkImageCreateInfo image_info = {};
+        image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_info.imageType = VK_IMAGE_TYPE_2D;
+        image_info.format = swapchain_info.image_format;
+        image_info.extent = {extent.width, extent.height, 1};
+        image_info.mipLevels = 1;
+        image_info.arrayLayers = 1;
+        image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        // rendered into, then copied out of for readback
+        image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkResult result = vkCreateImage(logical_device, &image_info, nullptr, &swapchain_info.swapchain_images.data[i]);
+        VK_CHECK(result);
+        swapchain_info.offscreen_image_mems.data[i] = gpu_alloc_image(allocator, swapchain_info.swapchain_images.data[i], GPU_MEMORY_GPU_ONLY);
+    }
+    return swapchain_info;
+}
 
-    VkSubmitInfo submit = {};
-    submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit.commandBufferCount = 1;
-    submit.pCommandBuffers = &cmd_buf;
-    vkQueueSubmit(graphics_queue, 1, &submit, VK_NULL_HANDLE);
-    // could use a fence so multiple transfers could happen simultaneously
-    // waiting for whole queue to become idle here
-    vkQueueWaitIdle(graphics_queue); 
-    vkFreeCommandBuffers(logical_device, cmd_pool, 1, &cmd_buf);
+// device local buffer filled through the upload manager. Shared with the transfer queue family (if it's a different one)
+// so the copy can happen there without ownership transfers. Returns the upload ticket
+u64 create_device_local_buffer(
+    GpuAllocator* allocator,
+    UploadManager* uploads,
+    const void* data,
+    VkDeviceSize size,
+    VkBufferUsageFlags usage,
+    VkBuffer& buffer_out,
+    GpuAllocation& mem_out)
+{
+    u32 sharing_families[2] = {};
+    u32 num_sharing_families = upload_sharing_families(uploads, sharing_families);
+    create_buffer(allocator, size, 
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, // destination of the staging copy
+                GPU_MEMORY_GPU_ONLY, // on the GPU
+                buffer_out, mem_out, sharing_families, num_sharing_families);
+    // staged through the upload ring and copied on the transfer queue. 
+    // The next graphics submit waits on the batch's semaphore, so nothing here blocks
+    return upload_buffer(uploads, buffer_out, 0, data, size);
 }
 
 void create_vertex_buffer(
-    VkDevice logical_device, 
-    VkPhysicalDevice physical_device,
-    VkCommandPool cmd_pool,
-    VkQueue graphics_queue,
+    GpuAllocator* allocator,
+    UploadManager* uploads,
     BufferView<Vertex> vertices,
     VkBuffer& vertex_buffer_out,
-    VkDeviceMemory& mem_out)
+    GpuAllocation& mem_out)
 {
     VkDeviceSize buffer_size = sizeof(vertices.data[0]) * vertices.size;
-    
-    // create a middleman buffer on the CPU to transfer vertex data to
-    // then we transfer into that buffer
-    // then we create a buffer local to the GPU for the final vertex data to reside in
-    VkBuffer staging_buffer;
-    VkDeviceMemory staging_buffer_mem;
-    create_buffer(logical_device, physical_device, buffer_size,
-                VK_BUFFER_USAGE_TRANSFER_SRC_BIT, // source buffer
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, // on CPU
-                staging_buffer, staging_buffer_mem);
-
-    // maps staging buffer to CPU memory so we can transfer our vertex data to it
-    void* data;
-    vkMapMemory(logical_device, staging_buffer_mem, 0, buffer_size, 0, &data);
-    // driver may not immediately copy the data into the buffer memory
-    // can deal with this by specifying memory heap with VK_MEMORY_PROPERTY_HOST_COHERENT_BIT (doing this rn)
-    // or call vkFlushMappedMemoryRanges after writing to mapped mem, and vkInvalidateMappedMemoryRanges before reading from it (ensures it's updated before reading/writing)
-    memcpy(data, vertices.data, (size_t)buffer_size);
-    vkUnmapMemory(logical_device, staging_buffer_mem);
-
-    create_buffer(logical_device, physical_device, buffer_size, 
-                VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, // destination, and is vert buff
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, // on the GPU
-                vertex_buffer_out, mem_out);
-
-    // TODO: actually transfer from staging buffer to gpu local buffer
-    copy_buffer(logical_device, cmd_pool, graphics_queue, staging_buffer, vertex_buffer_out, buffer_size);
-    vkDestroyBuffer(logical_device, staging_buffer, nullptr);
-    vkFreeMemory(logical_device, staging_buffer_mem, nullptr);
+    create_device_local_buffer(allocator, uploads, vertices.data, buffer_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertex_buffer_out, mem_out);
 }
 
 void create_index_buffer(
-    VkDevice logical_device, 
-    VkPhysicalDevice physical_device,
-    VkCommandPool cmd_pool,
-    VkQueue graphics_queue,
+    GpuAllocator* allocator,
+    UploadManager* uploads,
     BufferView<u32> indices,
     VkBuffer& index_buffer_out,
-    VkDeviceMemory& mem_out)
+    GpuAllocation& mem_out)
 {
     VkDeviceSize buffer_size = sizeof(indices.data[0]) * indices.size;
-    
-    // create a middleman buffer on the CPU to transfer vertex data to
-    // then we transfer into that buffer
-    // then we create a buffer local to the GPU for the final vertex data to reside in
-    VkBuffer staging_buffer;
-    VkDeviceMemory staging_buffer_mem;
-    create_buffer(logical_device, physical_device, buffer_size,
-                VK_BUFFER_USAGE_TRANSFER_SRC_BIT, // source buffer
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, // on CPU
-                staging_buffer, staging_buffer_mem);
-
-    // maps staging buffer to CPU memory so we can transfer our vertex data to it
-    void* data;
-    vkMapMemory(logical_device, staging_buffer_mem, 0, buffer_size, 0, &data);
-    // driver may not immediately copy the data into the buffer memory
-    // can deal with this by specifying memory heap with VK_MEMORY_PROPERTY_HOST_COHERENT_BIT (doing this rn)
-    // or call vkFlushMappedMemoryRanges after writing to mapped mem, and vkInvalidateMappedMemoryRanges before reading from it (ensures it's updated before reading/writing)
-    memcpy(data, indices.data, (size_t)buffer_size);
-    vkUnmapMemory(logical_device, staging_buffer_mem);
-
-    create_buffer(logical_device, physical_device, buffer_size, 
-                VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, // destination, and is vert buff
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, // on the GPU
-                index_buffer_out, mem_out);
-
-    // TODO: actually transfer from staging buffer to gpu local buffer
-    copy_buffer(logical_device, cmd_pool, graphics_queue, staging_buffer, index_buffer_out, buffer_size);
-    vkDestroyBuffer(logical_device, staging_buffer, nullptr);
-    vkFreeMemory(logical_device, staging_buffer_mem, nullptr);
+    create_device_local_buffer(allocator, uploads, indices.data, buffer_size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, index_buffer_out, mem_out);
 }
 
 VkDescriptorSetLayout create_descriptor_set_layout(
@@ -1384,173 +1894,1518 @@ VkDescriptorSetLayout create_descriptor_set_layout(
 {
     VkDescriptorSetLayoutBinding ubo_layout_bind = {};
     ubo_layout_bind.binding = 0; // in shader
-    ubo_layout_bind.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    ubo_layout_bind.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     ubo_layout_bind.descriptorCount = 1;
-    ubo_layout_bind.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT; // can also specify ALL_GRAPHICS to have it accessible everywhere
+    ubo_layout_bind.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT; // the cloud pass reads it too
     ubo_layout_bind.pImmutableSamplers = nullptr; // relevant for image sampling
+    // baked noise volumes (shape and detail), the light grid, the occupancy grid, the terrain maps (heightfield, min/max, horizon)
+    // and the static sdf (volume, bricks). Declared in common.glsl so every pass could sample them.
+    // Last is the step counter buffer every marcher adds into (StepStats)
+    VkDescriptorSetLayoutBinding bindings[11] = {ubo_layout_bind};
+    for (u32 i = 1; i < ARRAY_SIZE(bindings); i++)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = i == ARRAY_SIZE(bindings) - 1 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+    }
     VkDescriptorSetLayoutCreateInfo layout_info = {};
     layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layout_info.bindingCount = 1;
-    layout_info.pBindings = &ubo_layout_bind;
+    layout_info.bindingCount = ARRAY_SIZE(bindings);
+    layout_info.pBindings = bindings;
     VkDescriptorSetLayout layout;
     VkResult result = vkCreateDescriptorSetLayout(logical_device, &layout_info, nullptr, &layout);
     VK_CHECK(result);
     return layout;
 }
 
-void create_uniform_buffers(
-    Arena* arena,
-    VkDevice logical_device,
-    VkPhysicalDevice physical_device,
-    BufferView<VkBuffer>& uniform_buffers,
-    BufferView<VkDeviceMemory>& uniform_buffers_mem,
-    BufferView<void*>& uniform_buffers_mapped)
-{
-    VkDeviceSize buffer_size = sizeof(uniform_buffer_object);
-    uniform_buffers = BufferView<VkBuffer>::init_from_arena(arena, MAX_FRAMES_IN_FLIGHT);
-    uniform_buffers_mem = BufferView<VkDeviceMemory>::init_from_arena(arena, MAX_FRAMES_IN_FLIGHT);
-    uniform_buffers_mapped = BufferView<void*>::init_from_arena(arena, MAX_FRAMES_IN_FLIGHT);
-    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-    {
-        create_buffer(logical_device, physical_device, buffer_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                    uniform_buffers.data[i], uniform_buffers_mem.data[i]);
-        // persistent mapping. These mapped pointers are stored for the programs lifetime
-        vkMapMemory(logical_device, uniform_buffers_mem.data[i], 0, buffer_size, 0, &uniform_buffers_mapped.data[i]);
-    }
-}
-
-void update_uniform_buffer(
-    u32 current_img_idx,
-    VkExtent2D swapchain_extent,
-    BufferView<void*> uniform_buffers_mapped,
-    const RuntimeData& runtime)
+UniformRing create_uniform_ring(
+    GpuAllocator* allocator,
+    VkPhysicalDevice physical_device)
 {
-    static auto start_time = std::chrono::high_resolution_clock::now(); // start time of program
-    auto current_time = std::chrono::high_resolution_clock::now();
-    f32 time = std::chrono::duration<f32, std::chrono::seconds::period>(current_time - start_time).count();
-    uniform_buffer_object ubo = {};
-    // rotate around Z-axis w/time
-    ubo.model = glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    ubo.proj = glm::perspective(glm::radians(45.0f), swapchain_extent.width / (f32)swapchain_extent.height, 0.1f, 10.0f);
-    ubo.proj[1][1] *= -1; // glm designed for OpenGL where Y clip coords are inverted. Flip sign on scaling factor of Y axis for proper image
-    
-    s32 width, height;
-    glfwGetWindowSize(glob_glfw_window, &width, &height);
-    ubo.resolution = glm::vec4((f32)width, (f32)height, 0.0, 0.0);
-
-    CloudData cloud = runtime.cloud;
-    f32 scalar = sin(glfwGetTime()) * 0.001;
-    cloud.cloudDensityParams += scalar;
-    ubo.cloud = cloud;
-
-    memcpy(uniform_buffers_mapped.data[current_img_idx], &ubo, sizeof(ubo));
+    UniformRing ring = {};
+    VkPhysicalDeviceProperties properties = {};
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    ring.alignment = properties.limits.minUniformBufferOffsetAlignment;
+    // per frame vertices/indices/storage data can come out of it too, not just ubos
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | 
+                               VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    create_buffer(allocator, UNIFORM_RING_FRAME_SIZE * MAX_FRAMES_IN_FLIGHT, usage, GPU_MEMORY_CPU_TO_GPU,
+                ring.buffer, ring.mem);
+    // persistent mapping (owned by the allocator), stored for the programs lifetime
+    TINY_ASSERT(ring.mem.mapped != nullptr);
+    return ring;
 }
 
-VkDescriptorPool create_descriptor_pool(
-    VkDevice logical_device)
+// the gpu is done with this slot's region once its fence has signaled
+void uniform_ring_begin_frame(UniformRing& ring, u32 slot)
 {
-    VkDescriptorPoolSize poolsize = {};
-    poolsize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolsize.descriptorCount = MAX_FRAMES_IN_FLIGHT;
-    VkDescriptorPoolCreateInfo info = {};
-    info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    info.poolSizeCount = 1;
-    info.pPoolSizes = &poolsize;
-    info.maxSets = MAX_FRAMES_IN_FLIGHT;
-    info.flags = 0;
-    VkDescriptorPool pool = {};
-    VkResult result = vkCreateDescriptorPool(logical_device, &info, nullptr, &pool);
-    VK_CHECK(result);
-    return pool;
+    ring.frame_begin = slot * UNIFORM_RING_FRAME_SIZE;
+    ring.head = 0;
 }
 
-BufferView<VkDescriptorSet> create_descriptor_sets(
-    Arena* arena,
-    VkDevice logical_device,
-    VkDescriptorPool desc_pool,
-    VkDescriptorSetLayout layout,
-    const BufferView<VkBuffer>& uniform_buffers)
+// bump allocates size bytes out of the current frame's region. Returns where to write them, offset_out is where they are in ring.buffer.
+// Only valid until this slot's fence has been waited on again. Null when the region is full, everything handed out
+// before is still live (recorded commands reference it), so there's nowhere to put more until the next frame
+void* uniform_ring_alloc(UniformRing& ring, VkDeviceSize size, VkDeviceSize alignment, u32* offset_out)
 {
-    // allocate descriptor sets
-    BufferView<VkDescriptorSetLayout> desc_set_layouts = {arena_alloc_type(arena, VkDescriptorSetLayout, MAX_FRAMES_IN_FLIGHT), MAX_FRAMES_IN_FLIGHT};
-    for(u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-    { // populate desc_set_layouts with the specified layout (yes, these copies of the layout are necessary)
-        TMEMCPY(&desc_set_layouts.data[i], &layout, sizeof(layout));
+    VkDeviceSize offset = (ring.head + alignment - 1) / alignment * alignment;
+    if (offset + size > UNIFORM_RING_FRAME_SIZE)
+    {
+        return nullptr;
     }
-    BufferView<VkDescriptorSet> descriptor_sets = BufferView<VkDescriptorSet>::init_from_arena(arena, MAX_FRAMES_IN_FLIGHT);
-    VkDescriptorSetAllocateInfo alloc_info = {};
-    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    alloc_info.descriptorPool = desc_pool;
-    alloc_info.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
-    alloc_info.pSetLayouts = desc_set_layouts.data;
-    VkResult result = vkAllocateDescriptorSets(logical_device, &alloc_info, descriptor_sets.data);
-    VK_CHECK(result);
+    ring.head = offset + size;
+    *offset_out = (u32)(ring.frame_begin + offset);
+    return (u8*)ring.mem.mapped + ring.frame_begin + offset;
+}
 
-    // configure descriptor sets
-    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+// copies data into the current frame's region and returns the dynamic offset to bind it with
+u32 uniform_ring_push(UniformRing& ring, const void* data, VkDeviceSize size)
+{
+    u32 offset = 0;
+    void* dst = uniform_ring_alloc(ring, size, ring.alignment, &offset);
+    if (dst == nullptr)
     {
-        VkDescriptorBufferInfo bufinfo = {};
-        bufinfo.buffer = uniform_buffers.data[i];
-        bufinfo.offset = 0;
-        bufinfo.range = sizeof(uniform_buffer_object);
-        VkWriteDescriptorSet descriptor_write = {};
-        descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptor_write.dstSet = descriptor_sets.data[i];
-        descriptor_write.dstBinding = 0; // same as in shader
-        descriptor_write.dstArrayElement = 0;
-        descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptor_write.descriptorCount = 1;
-        descriptor_write.pBufferInfo = &bufinfo;
-        descriptor_write.pImageInfo = nullptr;
-        descriptor_write.pTexelBufferView = nullptr;
-        vkUpdateDescriptorSets(logical_device, 1, &descriptor_write, 0, nullptr);
+        // the draws can't go without their ubo. The per frame pushes are fixed, so this only happens if UNIFORM_RING_FRAME_SIZE is too small
+        LOG_FATAL("Uniform ring out of space (%llu bytes per frame)", (unsigned long long)UNIFORM_RING_FRAME_SIZE);
+        exit(EXIT_FAILURE);
     }
-
-    return descriptor_sets;
+    TMEMCPY(dst, data, size);
+    return offset;
 }
 
-RuntimeData initVulkan()
+// the frame that last used this slot is done (its fence has been waited on), so everything it allocated per frame is free again
+void frame_slot_begin(RuntimeData& runtime, u32 slot)
+{
+    uniform_ring_begin_frame(runtime.uniform_ring, slot);
+    arena_clear(&runtime.frame_arenas[slot]);
+}
+
+// per frame cpu scratch for the frame being recorded
+Arena* frame_arena(RuntimeData& runtime)
+{
+    return &runtime.frame_arenas[runtime.current_frame];
+}
+
+// semaphores (and their stages) this frame's graphics submit waits on: image_available if there is one (not headless),
+// plus anything uploaded since the last frame, which has to land before this frame reads it. The lists live in the frame arena
+u32 take_frame_wait_semaphores(
+    RuntimeData& runtime,
+    VkSemaphore image_available,
+    VkSemaphore** semaphores_out,
+    VkPipelineStageFlags** stages_out)
+{
+    Arena* arena = frame_arena(runtime);
+    VkSemaphore* semaphores = arena_alloc_type(arena, VkSemaphore, 1 + UPLOAD_MAX_BATCHES);
+    VkPipelineStageFlags* stages = arena_alloc_type(arena, VkPipelineStageFlags, 1 + UPLOAD_MAX_BATCHES);
+    u32 num_waits = 0;
+    if (image_available != VK_NULL_HANDLE)
+    {
+        semaphores[num_waits] = image_available;
+        stages[num_waits] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        num_waits++;
+    }
+    u32 num_upload_waits = upload_take_wait_semaphores(&runtime.uploads, &semaphores[num_waits], runtime.inflight_fences.data[runtime.current_frame]);
+    for (u32 i = 0; i < num_upload_waits; i++)
+    {
+        stages[num_waits + i] = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    }
+    *semaphores_out = semaphores;
+    *stages_out = stages;
+    return num_waits + num_upload_waits;
+}
+
+// ring of readback buffers, one per frame in flight.
+// Persistently mapped so handing a finished frame to the writer is just a memcpy
+void create_readback_buffers(
+    Arena* arena,
+    GpuAllocator* allocator,
+    VkExtent2D extent,
+    BufferView<VkBuffer>& readback_buffers,
+    BufferView<GpuAllocation>& readback_buffers_mem,
+    BufferView<void*>& readback_buffers_mapped,
+    BufferView<u64>& readback_frame_indices)
+{
+    VkDeviceSize buffer_size = (VkDeviceSize)extent.width * extent.height * 4; // RGBA8
+    readback_buffers = BufferView<VkBuffer>::init_from_arena(arena, MAX_FRAMES_IN_FLIGHT);
+    readback_buffers_mem = BufferView<GpuAllocation>::init_from_arena(arena, MAX_FRAMES_IN_FLIGHT);
+    readback_buffers_mapped = BufferView<void*>::init_from_arena(arena, MAX_FRAMES_IN_FLIGHT);
+    readback_frame_indices = BufferView<u64>::init_from_arena(arena, MAX_FRAMES_IN_FLIGHT);
+    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        create_buffer(allocator, buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, GPU_MEMORY_GPU_TO_CPU,
+                    readback_buffers.data[i], readback_buffers_mem.data[i]);
+        readback_buffers_mapped.data[i] = readback_buffers_mem.data[i].mapped;
+        readback_frame_indices.data[i] = UINT64_MAX;
+    }
+}
+
+// hands whatever finished frame is sitting in this slot's readback buffer to the frame writer.
+// Only call once the fence for this slot has signaled
+void flush_readback(RuntimeData& runtime, u32 slot)
+{
+    u64& frame_index = runtime.readback_frame_indices.data[slot];
+    if (runtime.frame_writer == nullptr || frame_index == UINT64_MAX)
+    {
+        return;
+    }
+    frame_writer_submit(runtime.frame_writer, runtime.readback_buffers_mapped.data[slot], frame_index);
+    frame_index = UINT64_MAX;
+}
+
+// everything that has to happen once the gpu is done with the frame that last used this slot
+void retire_frame_slot(RuntimeData& runtime, u32 slot)
+{
+    TINY_PROFILE_SCOPE("retire_frame_slot");
+    // any upload semaphores that frame waited on are free to be signaled again
+    upload_consumer_fence_signaled(&runtime.uploads, runtime.inflight_fences.data[slot]);
+    flush_readback(runtime, slot);
+    // timestamps/stats for this slot are done too. Resolving them here keeps the profiler MAX_FRAMES_IN_FLIGHT frames late but never stalls
+    u64 resolved_frame_index = 0;
+    if (gpu_profiler_resolve(&runtime.gpu_profiler, runtime.logical_device, slot, &resolved_frame_index))
+    {
+        bench_record_gpu(runtime.bench_results, resolved_frame_index, runtime.gpu_profiler.last_ms[GPU_SCOPE_FRAME]);
+    }
+    step_stats_resolve(&runtime.step_stats, slot);
+    // pipelines swapped out by a hot reload die once every slot that might have been using them is done
+    for (u32 i = 0; i < runtime.retired_pipelines.size();)
+    {
+        RetiredPipeline& retired = runtime.retired_pipelines[i];
+        retired.pending_slots &= ~(1u << slot);
+        if (retired.pending_slots == 0)
+        {
+            vkDestroyPipeline(runtime.logical_device, retired.pipeline, nullptr);
+            retired = runtime.retired_pipelines.back();
+            runtime.retired_pipelines.pop_back();
+            continue;
+        }
+        i++;
+    }
+}
+
+// finds or creates the pipeline for this set of specialization constants
+PipelineVariant get_pipeline_variant(RuntimeData& runtime, const ShaderQuality& quality)
+{
+    for (const PipelineVariant& variant : runtime.pipeline_variants)
+    {
+        if (memcmp(&variant.quality, &quality, sizeof(ShaderQuality)) == 0)
+        {
+            return variant;
+        }
+    }
+    TINY_PROFILE_FUNCTION();
+    auto start = std::chrono::steady_clock::now();
+    PipelineVariant variant = {};
+    variant.quality = quality;
+    variant.scene = create_graphics_pipeline(runtime.logical_device, runtime.pipeline_cache.cache, runtime.pipline_layout, 
+        runtime.swapchain_info, runtime.passes.scene_render_pass, 2, false, 
+        runtime.main_spirv[MAIN_SHADER_VERT], runtime.main_spirv[MAIN_SHADER_SCENE_FRAG], quality);
+    variant.clouds = create_compute_pipeline(runtime.logical_device, runtime.pipeline_cache.cache, runtime.passes.clouds_layout, 
+        runtime.main_spirv[MAIN_SHADER_CLOUDS_COMP], quality);
+    variant.light_grid = create_compute_pipeline(runtime.logical_device, runtime.pipeline_cache.cache, runtime.light_grid.layout, 
+        runtime.main_spirv[MAIN_SHADER_LIGHT_GRID_COMP], quality);
+    variant.cone = create_compute_pipeline(runtime.logical_device, runtime.pipeline_cache.cache, runtime.passes.cone_layout, 
+        runtime.main_spirv[MAIN_SHADER_SCENE_CONE_COMP], quality);
+    runtime.pipeline_variants.push_back(variant);
+    f64 ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("Created pipeline variant %u in %.2fms", (u32)runtime.pipeline_variants.size() - 1, ms);
+    return variant;
+}
+
+// the composite pass doesn't march anything, so it's built once with default constants
+void create_composite_pipeline(RuntimeData& runtime)
+{
+    runtime.passes.composite_pipeline = create_graphics_pipeline(runtime.logical_device, runtime.pipeline_cache.cache, 
+        runtime.passes.composite_layout, runtime.swapchain_info, runtime.render_pass, 1, true, 
+        runtime.main_spirv[MAIN_SHADER_VERT], runtime.main_spirv[MAIN_SHADER_COMPOSITE_FRAG], ShaderQuality{});
+}
+
+// both only read densities the light grid already evaluated, so they're built once with default constants
+void create_occupancy_pipelines(RuntimeData& runtime)
+{
+    OccupancyGrid& occupancy = runtime.occupancy;
+    occupancy.build_pipeline = create_compute_pipeline(runtime.logical_device, runtime.pipeline_cache.cache, occupancy.layout, 
+        runtime.main_spirv[MAIN_SHADER_OCCUPANCY_COMP], ShaderQuality{});
+    occupancy.mip_pipeline = create_compute_pipeline(runtime.logical_device, runtime.pipeline_cache.cache, occupancy.layout, 
+        runtime.main_spirv[MAIN_SHADER_OCCUPANCY_MIP_COMP], ShaderQuality{});
+}
+
+// the terrain is always baked at full detail, whatever the quality preset
+void create_terrain_pipelines(RuntimeData& runtime)
+{
+    TerrainMap& terrain = runtime.terrain;
+    terrain.bake_pipeline = create_compute_pipeline(runtime.logical_device, runtime.pipeline_cache.cache, terrain.layout, 
+        runtime.main_spirv[MAIN_SHADER_TERRAIN_BAKE_COMP], ShaderQuality{});
+    terrain.minmax_pipeline = create_compute_pipeline(runtime.logical_device, runtime.pipeline_cache.cache, terrain.layout, 
+        runtime.main_spirv[MAIN_SHADER_TERRAIN_MINMAX_COMP], ShaderQuality{});
+    terrain.horizon_pipeline = create_compute_pipeline(runtime.logical_device, runtime.pipeline_cache.cache, terrain.layout, 
+        runtime.main_spirv[MAIN_SHADER_TERRAIN_HORIZON_COMP], ShaderQuality{});
+}
+
+void create_sdf_pipelines(RuntimeData& runtime)
+{
+    SdfVolume& sdf = runtime.sdf;
+    sdf.bricks_pipeline = create_compute_pipeline(runtime.logical_device, runtime.pipeline_cache.cache, sdf.layout, 
+        runtime.main_spirv[MAIN_SHADER_SDF_BRICKS_COMP], ShaderQuality{});
+    sdf.bake_pipeline = create_compute_pipeline(runtime.logical_device, runtime.pipeline_cache.cache, sdf.layout, 
+        runtime.main_spirv[MAIN_SHADER_SDF_BAKE_COMP], ShaderQuality{});
+}
+
+void retire_pipeline(RuntimeData& runtime, VkPipeline pipeline)
+{
+    RetiredPipeline retired = {};
+    retired.pipeline = pipeline;
+    retired.pending_slots = (1u << MAX_FRAMES_IN_FLIGHT) - 1;
+    runtime.retired_pipelines.push_back(retired);
+}
+
+// swaps in freshly compiled shaders without waiting on the gpu. Every variant was built from the old spirv,
+// and they may still be used by frames in flight, so they're all retired instead of destroyed
+void hot_reload_shaders(RuntimeData& runtime)
+{
+    std::vector<u32> spirv[MAIN_SHADER_COUNT];
+    if (!shader_hot_reload_poll(runtime.shader_hot_reload, spirv))
+    {
+        return;
+    }
+    TINY_PROFILE_FUNCTION();
+    for (const PipelineVariant& variant : runtime.pipeline_variants)
+    {
+        retire_pipeline(runtime, variant.scene);
+        retire_pipeline(runtime, variant.clouds);
+        retire_pipeline(runtime, variant.light_grid);
+        retire_pipeline(runtime, variant.cone);
+    }
+    runtime.pipeline_variants.clear();
+    retire_pipeline(runtime, runtime.passes.composite_pipeline);
+    retire_pipeline(runtime, runtime.occupancy.build_pipeline);
+    retire_pipeline(runtime, runtime.occupancy.mip_pipeline);
+    retire_pipeline(runtime, runtime.terrain.bake_pipeline);
+    retire_pipeline(runtime, runtime.terrain.minmax_pipeline);
+    retire_pipeline(runtime, runtime.terrain.horizon_pipeline);
+    retire_pipeline(runtime, runtime.sdf.bricks_pipeline);
+    retire_pipeline(runtime, runtime.sdf.bake_pipeline);
+    runtime.light_grid.valid = false; // the new shaders may compute it differently
+    runtime.terrain.bake_pending = true;
+    for (u32 i = 0; i < MAIN_SHADER_COUNT; i++)
+    {
+        runtime.main_spirv[i] = std::move(spirv[i]);
+    }
+    create_composite_pipeline(runtime);
+    create_occupancy_pipelines(runtime);
+    create_terrain_pipelines(runtime);
+    create_sdf_pipelines(runtime);
+    runtime.active_variant = get_pipeline_variant(runtime, get_shader_quality(runtime));
+}
+
+// returns the dynamic offset of this frame's ubo
+u32 update_uniform_buffer(
+    VkExtent2D swapchain_extent,
+    UniformRing& uniform_ring,
+    const RuntimeData& runtime)
+{
+    static auto start_time = std::chrono::high_resolution_clock::now(); // start time of program
+    auto current_time = std::chrono::high_resolution_clock::now();
+    f32 time = std::chrono::duration<f32, std::chrono::seconds::period>(current_time - start_time).count();
+    uniform_buffer_object ubo = {};
+    // rotate around Z-axis w/time
+    ubo.model = glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    ubo.proj = glm::perspective(glm::radians(45.0f), swapchain_extent.width / (f32)swapchain_extent.height, 0.1f, 10.0f);
+    ubo.proj[1][1] *= -1; // glm designed for OpenGL where Y clip coords are inverted. Flip sign on scaling factor of Y axis for proper image
+    
+    // gl_FragCoord is in framebuffer pixels, which is the swapchain (or offscreen image) extent - not necessarily the window size
+    ubo.resolution = glm::vec4((f32)swapchain_extent.width, (f32)swapchain_extent.height, (f32)runtime.passes.cloud_downsample, 0.0);
+
+    CloudData cloud = runtime.cloud;
+    if (!runtime.options.bench) // bench runs pin the cloud params exactly
+    {
+        f32 scalar = sin(runtime.cloud.sun_dir_and_time.w) * 0.001;
+        cloud.cloudDensityParams += scalar;
+    }
+    ubo.cloud = cloud;
+    // the cloud pass reprojects last frame's output through last frame's camera
+    const FramePasses& passes = runtime.passes;
+    ubo.prev_camera_offset = passes.history_frames > 0 ? passes.history_camera_offset : cloud.cameraOffset;
+    ubo.temporal = glm::vec4((f32)(runtime.frame_index & 0xffff), passes.history_frames > 0 ? 1.0f : 0.0f, 0.0f, 0.0f);
+    ubo.light_grid = glm::vec4((f32)runtime.light_grid.first_slice, (f32)runtime.light_grid.slice_stride, 0.0f, 0.0f);
+    ubo.lod = glm::vec4(runtime.lod_bias, 0.0f, 0.0f, 0.0f);
+    ubo.debug = glm::vec4((f32)runtime.step_stats.heatmap, (f32)runtime.current_frame, 0.0f, 0.0f);
+
+    return uniform_ring_push(uniform_ring, &ubo, sizeof(ubo));
+}
+
+// call once a frame's commands are recorded. Its cloud output is what the next frame reprojects
+void advance_cloud_history(RuntimeData& runtime)
+{
+    runtime.passes.history_frames++;
+    runtime.passes.history_camera_offset = runtime.cloud.cameraOffset;
+}
+
+VkDescriptorPool create_descriptor_pool(
+    VkDevice logical_device)
+{
+    // the ubo + noise + light/occupancy grid + terrain + sdf + step counter set, the light grid's storage set, a set per occupancy level, 
+    // the terrain bake sets (bake, horizon, one per min/max level), the sdf bake set, the cone prepass and scene pass sets,
+    // plus a cloud and a composite pass set per frame slot
+    VkDescriptorPoolSize poolsizes[] = 
+    {
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 9 + 1 + 7 * MAX_FRAMES_IN_FLIGHT},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 + 2 * OCCUPANCY_LEVELS + 2 * (TERRAIN_MINMAX_LEVELS + 2) + 2 + 1 + 2 * MAX_FRAMES_IN_FLIGHT},
+    };
+    VkDescriptorPoolCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    info.poolSizeCount = ARRAY_SIZE(poolsizes);
+    info.pPoolSizes = poolsizes;
+    info.maxSets = 2 + OCCUPANCY_LEVELS + (TERRAIN_MINMAX_LEVELS + 2) + 1 + 2 + 2 * MAX_FRAMES_IN_FLIGHT;
+    info.flags = 0;
+    VkDescriptorPool pool = {};
+    VkResult result = vkCreateDescriptorPool(logical_device, &info, nullptr, &pool);
+    VK_CHECK(result);
+    return pool;
+}
+
+VkDescriptorSet create_descriptor_set(
+    VkDevice logical_device,
+    VkDescriptorPool desc_pool,
+    VkDescriptorSetLayout layout,
+    const UniformRing& uniform_ring,
+    const NoiseTextures& noise,
+    const LightGrid& light_grid,
+    const OccupancyGrid& occupancy,
+    const TerrainMap& terrain,
+    const SdfVolume& sdf,
+    const StepStats& step_stats)
+{
+    VkDescriptorSetAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = desc_pool;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &layout;
+    VkDescriptorSet descriptor_set = {};
+    VkResult result = vkAllocateDescriptorSets(logical_device, &alloc_info, &descriptor_set);
+    VK_CHECK(result);
+
+    // points at the start of the ring, the dynamic offset given at bind time picks the actual ubo.
+    // range is the size of one ubo, not the whole ring
+    VkDescriptorBufferInfo bufinfo = {};
+    bufinfo.buffer = uniform_ring.buffer;
+    bufinfo.offset = 0;
+    bufinfo.range = sizeof(uniform_buffer_object);
+    VkDescriptorImageInfo image_infos[9] = 
+    {
+        {noise.sampler, noise.shape.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+        {noise.sampler, noise.detail.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+        {light_grid.sampler, light_grid.volume.view, VK_IMAGE_LAYOUT_GENERAL},
+        {occupancy.sampler, occupancy.volume.view, VK_IMAGE_LAYOUT_GENERAL},
+        {terrain.sampler, terrain.heightfield.view, VK_IMAGE_LAYOUT_GENERAL},
+        {terrain.sampler, terrain.minmax.view, VK_IMAGE_LAYOUT_GENERAL},
+        {terrain.sampler, terrain.horizon.view, VK_IMAGE_LAYOUT_GENERAL},
+        {sdf.sampler, sdf.volume.view, VK_IMAGE_LAYOUT_GENERAL},
+        {sdf.sampler, sdf.bricks.view, VK_IMAGE_LAYOUT_GENERAL},
+    };
+    // every slot's counters, the shaders index them with ubo.debug.y
+    VkDescriptorBufferInfo step_stats_info = {};
+    step_stats_info.buffer = step_stats.buffer;
+    step_stats_info.offset = 0;
+    step_stats_info.range = VK_WHOLE_SIZE;
+    VkWriteDescriptorSet descriptor_writes[11] = {};
+    VkWriteDescriptorSet& descriptor_write = descriptor_writes[0];
+    descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptor_write.dstSet = descriptor_set;
+    descriptor_write.dstBinding = 0; // same as in shader
+    descriptor_write.dstArrayElement = 0;
+    descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    descriptor_write.descriptorCount = 1;
+    descriptor_write.pBufferInfo = &bufinfo;
+    descriptor_write.pImageInfo = nullptr;
+    descriptor_write.pTexelBufferView = nullptr;
+    for (u32 i = 0; i < ARRAY_SIZE(image_infos); i++)
+    {
+        VkWriteDescriptorSet& image_write = descriptor_writes[1 + i];
+        image_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        image_write.dstSet = descriptor_set;
+        image_write.dstBinding = 1 + i;
+        image_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        image_write.descriptorCount = 1;
+        image_write.pImageInfo = &image_infos[i];
+    }
+    VkWriteDescriptorSet& step_stats_write = descriptor_writes[1 + ARRAY_SIZE(image_infos)];
+    step_stats_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    step_stats_write.dstSet = descriptor_set;
+    step_stats_write.dstBinding = 1 + ARRAY_SIZE(image_infos);
+    step_stats_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    step_stats_write.descriptorCount = 1;
+    step_stats_write.pBufferInfo = &step_stats_info;
+    vkUpdateDescriptorSets(logical_device, ARRAY_SIZE(descriptor_writes), descriptor_writes, 0, nullptr);
+    return descriptor_set;
+}
+
+// ===== FRAME PASSES
+
+RenderImage create_render_image(
+    GpuAllocator* allocator,
+    VkExtent2D extent,
+    VkFormat format,
+    VkImageUsageFlags usage)
+{
+    VkDevice logical_device = allocator->logical_device;
+    RenderImage image = {};
+    VkImageCreateInfo image_info = {};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = format;
+    image_info.extent = {extent.width, extent.height, 1};
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = usage;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkResult result = vkCreateImage(logical_device, &image_info, nullptr, &image.image);
+    VK_CHECK(result);
+    image.mem = gpu_alloc_image(allocator, image.image, GPU_MEMORY_GPU_ONLY);
+    VkImageViewCreateInfo view_info = {};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = image.image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = format;
+    view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_info.subresourceRange.baseMipLevel = 0;
+    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.baseArrayLayer = 0;
+    view_info.subresourceRange.layerCount = 1;
+    result = vkCreateImageView(logical_device, &view_info, nullptr, &image.view);
+    VK_CHECK(result);
+    return image;
+}
+
+void destroy_render_image(GpuAllocator* allocator, RenderImage& image)
+{
+    vkDestroyImageView(allocator->logical_device, image.view, nullptr);
+    vkDestroyImage(allocator->logical_device, image.image, nullptr);
+    gpu_free(allocator, image.mem);
+    image = {};
+}
+
+// color + ray distance. Both are only ever read by later passes, so they end up in SHADER_READ_ONLY_OPTIMAL
+VkRenderPass create_scene_render_pass(VkDevice logical_device)
+{
+    VkAttachmentDescription attachments[2] = {};
+    VkFormat formats[2] = {SCENE_COLOR_FORMAT, SCENE_DEPTH_FORMAT};
+    VkAttachmentReference attachment_refs[2] = {};
+    for (u32 i = 0; i < ARRAY_SIZE(attachments); i++)
+    {
+        attachments[i].format = formats[i];
+        attachments[i].samples = VK_SAMPLE_COUNT_1_BIT;
+        attachments[i].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE; // the fullscreen quad writes every pixel
+        attachments[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        attachments[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachments[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachments[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        attachments[i].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        attachment_refs[i].attachment = i;
+        attachment_refs[i].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    }
+    VkSubpassDescription subpass = {};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = ARRAY_SIZE(attachment_refs);
+    subpass.pColorAttachments = attachment_refs;
+
+    VkSubpassDependency dependencies[2] = {};
+    // the previous frame's cloud/composite passes have to be done reading before we overwrite
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[0].srcAccessMask = 0;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    // and this frame's can't read until we're done writing
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    VkRenderPassCreateInfo render_pass_info = {};
+    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    render_pass_info.attachmentCount = ARRAY_SIZE(attachments);
+    render_pass_info.pAttachments = attachments;
+    render_pass_info.subpassCount = 1;
+    render_pass_info.pSubpasses = &subpass;
+    render_pass_info.dependencyCount = ARRAY_SIZE(dependencies);
+    render_pass_info.pDependencies = dependencies;
+    VkRenderPass render_pass = {};
+    VkResult result = vkCreateRenderPass(logical_device, &render_pass_info, nullptr, &render_pass);
+    VK_CHECK(result);
+    return render_pass;
+}
+
+// bindings 0..num_bindings-1, one descriptor each
+VkDescriptorSetLayout create_pass_set_layout(
+    VkDevice logical_device,
+    const VkDescriptorType* types,
+    u32 num_bindings,
+    VkShaderStageFlags stages)
+{
+    VkDescriptorSetLayoutBinding bindings[8] = {};
+    TINY_ASSERT(num_bindings <= ARRAY_SIZE(bindings));
+    for (u32 i = 0; i < num_bindings; i++)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = types[i];
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = stages;
+    }
+    VkDescriptorSetLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = num_bindings;
+    layout_info.pBindings = bindings;
+    VkDescriptorSetLayout layout = {};
+    VkResult result = vkCreateDescriptorSetLayout(logical_device, &layout_info, nullptr, &layout);
+    VK_CHECK(result);
+    return layout;
+}
+
+// everything that doesn't depend on the swapchain extent
+void create_frame_passes(RuntimeData& runtime)
+{
+    VkDevice logical_device = runtime.logical_device;
+    FramePasses& passes = runtime.passes;
+    passes.cloud_downsample = runtime.options.cloud_downsample;
+    passes.scene_render_pass = create_scene_render_pass(logical_device);
+
+    VkSamplerCreateInfo sampler_info = {};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = VK_FILTER_NEAREST;
+    sampler_info.minFilter = VK_FILTER_NEAREST;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.maxLod = 0.0f;
+    VkResult result = vkCreateSampler(logical_device, &sampler_info, nullptr, &passes.sampler);
+    VK_CHECK(result);
+
+    // clouds.comp: scene depth in, cloud color + depth out, last frame's cloud color + depth in
+    VkDescriptorType clouds_types[] = 
+    {
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 
+        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 
+        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+    };
+    passes.clouds_set_layout = create_pass_set_layout(logical_device, clouds_types, ARRAY_SIZE(clouds_types), VK_SHADER_STAGE_COMPUTE_BIT);
+    // composite.frag: scene color, scene depth, cloud color, cloud depth
+    VkDescriptorType composite_types[] = 
+    {
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+    };
+    passes.composite_set_layout = create_pass_set_layout(logical_device, composite_types, ARRAY_SIZE(composite_types), VK_SHADER_STAGE_FRAGMENT_BIT);
+    VkDescriptorSetLayout clouds_layouts[] = {runtime.descriptor_set_layout, passes.clouds_set_layout};
+    passes.clouds_layout = create_pipeline_layout(logical_device, clouds_layouts, ARRAY_SIZE(clouds_layouts));
+    VkDescriptorSetLayout composite_layouts[] = {runtime.descriptor_set_layout, passes.composite_set_layout};
+    passes.composite_layout = create_pipeline_layout(logical_device, composite_layouts, ARRAY_SIZE(composite_layouts));
+    // scene_cone.comp writes the tile depths, main.frag starts its rays from them
+    VkDescriptorType cone_types[] = {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE};
+    passes.cone_set_layout = create_pass_set_layout(logical_device, cone_types, ARRAY_SIZE(cone_types), VK_SHADER_STAGE_COMPUTE_BIT);
+    VkDescriptorType scene_types[] = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER};
+    passes.scene_set_layout = create_pass_set_layout(logical_device, scene_types, ARRAY_SIZE(scene_types), VK_SHADER_STAGE_FRAGMENT_BIT);
+    VkDescriptorSetLayout cone_layouts[] = {runtime.descriptor_set_layout, passes.cone_set_layout};
+    passes.cone_layout = create_pipeline_layout(logical_device, cone_layouts, ARRAY_SIZE(cone_layouts));
+}
+
+void allocate_frame_pass_sets(RuntimeData& runtime)
+{
+    FramePasses& passes = runtime.passes;
+    VkDescriptorSetLayout layouts[MAX_FRAMES_IN_FLIGHT * 2 + 2] = {};
+    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        layouts[i] = passes.clouds_set_layout;
+        layouts[MAX_FRAMES_IN_FLIGHT + i] = passes.composite_set_layout;
+    }
+    layouts[MAX_FRAMES_IN_FLIGHT * 2] = passes.cone_set_layout;
+    layouts[MAX_FRAMES_IN_FLIGHT * 2 + 1] = passes.scene_set_layout;
+    VkDescriptorSet sets[ARRAY_SIZE(layouts)] = {};
+    VkDescriptorSetAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = runtime.descriptor_pool;
+    alloc_info.descriptorSetCount = ARRAY_SIZE(layouts);
+    alloc_info.pSetLayouts = layouts;
+    VkResult result = vkAllocateDescriptorSets(runtime.logical_device, &alloc_info, sets);
+    VK_CHECK(result);
+    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        passes.clouds_sets[i] = sets[i];
+        passes.composite_sets[i] = sets[MAX_FRAMES_IN_FLIGHT + i];
+    }
+    passes.cone_set = sets[MAX_FRAMES_IN_FLIGHT * 2];
+    passes.scene_set = sets[MAX_FRAMES_IN_FLIGHT * 2 + 1];
+}
+
+// images + framebuffer for the current extent, and points the pass sets at them.
+// Only call while nothing in flight is using the old ones
+void create_frame_targets(RuntimeData& runtime, VkExtent2D extent)
+{
+    VkDevice logical_device = runtime.logical_device;
+    GpuAllocator* allocator = &runtime.gpu_allocator;
+    FramePasses& passes = runtime.passes;
+    u32 downsample = passes.cloud_downsample;
+    passes.extent = extent;
+    passes.cloud_extent = {(extent.width + downsample - 1) / downsample, (extent.height + downsample - 1) / downsample};
+    passes.scene_color = create_render_image(allocator, extent, SCENE_COLOR_FORMAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+    passes.scene_depth = create_render_image(allocator, extent, SCENE_DEPTH_FORMAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        passes.cloud_color[i] = create_render_image(allocator, passes.cloud_extent, CLOUD_COLOR_FORMAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+        passes.cloud_depth[i] = create_render_image(allocator, passes.cloud_extent, CLOUD_DEPTH_FORMAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+    }
+    passes.cone_extent = {(extent.width + CONE_TILE_SIZE - 1) / CONE_TILE_SIZE, (extent.height + CONE_TILE_SIZE - 1) / CONE_TILE_SIZE};
+    passes.cone_depth = create_render_image(allocator, passes.cone_extent, CONE_DEPTH_FORMAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+    passes.history_frames = 0;
+
+    VkImageView attachments[] = {passes.scene_color.view, passes.scene_depth.view};
+    VkFramebufferCreateInfo framebuffer_info = {};
+    framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebuffer_info.renderPass = passes.scene_render_pass;
+    framebuffer_info.attachmentCount = ARRAY_SIZE(attachments);
+    framebuffer_info.pAttachments = attachments;
+    framebuffer_info.width = extent.width;
+    framebuffer_info.height = extent.height;
+    framebuffer_info.layers = 1;
+    VkResult result = vkCreateFramebuffer(logical_device, &framebuffer_info, nullptr, &passes.scene_framebuffer);
+    VK_CHECK(result);
+
+    // storage images live in GENERAL while the cloud pass writes them, everything else is read in SHADER_READ_ONLY_OPTIMAL.
+    // Slot i writes its own cloud images and reads the previous slot's
+    constexpr u32 NUM_CLOUDS_BINDINGS = 5;
+    constexpr u32 NUM_COMPOSITE_BINDINGS = 4;
+    VkDescriptorImageInfo images[MAX_FRAMES_IN_FLIGHT][NUM_CLOUDS_BINDINGS + NUM_COMPOSITE_BINDINGS] = {};
+    VkWriteDescriptorSet writes[MAX_FRAMES_IN_FLIGHT * (NUM_CLOUDS_BINDINGS + NUM_COMPOSITE_BINDINGS) + 2] = {};
+    u32 num_writes = 0;
+    // the cone depths are only ever in GENERAL, the prepass writes them right before the scene pass reads them
+    VkDescriptorImageInfo cone_images[2] = 
+    {
+        {VK_NULL_HANDLE, passes.cone_depth.view, VK_IMAGE_LAYOUT_GENERAL},
+        {passes.sampler, passes.cone_depth.view, VK_IMAGE_LAYOUT_GENERAL},
+    };
+    VkDescriptorSet cone_sets[2] = {passes.cone_set, passes.scene_set};
+    for (u32 i = 0; i < ARRAY_SIZE(cone_images); i++)
+    {
+        VkWriteDescriptorSet& write = writes[num_writes++];
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = cone_sets[i];
+        write.dstBinding = 0;
+        write.descriptorCount = 1;
+        write.descriptorType = cone_images[i].sampler == VK_NULL_HANDLE ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.pImageInfo = &cone_images[i];
+    }
+    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        u32 prev = (i + MAX_FRAMES_IN_FLIGHT - 1) % MAX_FRAMES_IN_FLIGHT;
+        VkDescriptorImageInfo* clouds_images = images[i];
+        clouds_images[0] = {passes.sampler, passes.scene_depth.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        clouds_images[1] = {VK_NULL_HANDLE, passes.cloud_color[i].view, VK_IMAGE_LAYOUT_GENERAL};
+        clouds_images[2] = {VK_NULL_HANDLE, passes.cloud_depth[i].view, VK_IMAGE_LAYOUT_GENERAL};
+        clouds_images[3] = {passes.sampler, passes.cloud_color[prev].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        clouds_images[4] = {passes.sampler, passes.cloud_depth[prev].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        VkDescriptorImageInfo* composite_images = images[i] + NUM_CLOUDS_BINDINGS;
+        composite_images[0] = {passes.sampler, passes.scene_color.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        composite_images[1] = {passes.sampler, passes.scene_depth.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        composite_images[2] = {passes.sampler, passes.cloud_color[i].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        composite_images[3] = {passes.sampler, passes.cloud_depth[i].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        for (u32 binding = 0; binding < NUM_CLOUDS_BINDINGS; binding++)
+        {
+            VkWriteDescriptorSet& write = writes[num_writes++];
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = passes.clouds_sets[i];
+            write.dstBinding = binding;
+            write.descriptorCount = 1;
+            write.descriptorType = clouds_images[binding].sampler == VK_NULL_HANDLE ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write.pImageInfo = &clouds_images[binding];
+        }
+        for (u32 binding = 0; binding < NUM_COMPOSITE_BINDINGS; binding++)
+        {
+            VkWriteDescriptorSet& write = writes[num_writes++];
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = passes.composite_sets[i];
+            write.dstBinding = binding;
+            write.descriptorCount = 1;
+            write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write.pImageInfo = &composite_images[binding];
+        }
+    }
+    vkUpdateDescriptorSets(logical_device, num_writes, writes, 0, nullptr);
+}
+
+void destroy_frame_targets(RuntimeData& runtime)
+{
+    FramePasses& passes = runtime.passes;
+    vkDestroyFramebuffer(runtime.logical_device, passes.scene_framebuffer, nullptr);
+    passes.scene_framebuffer = VK_NULL_HANDLE;
+    destroy_render_image(&runtime.gpu_allocator, passes.scene_color);
+    destroy_render_image(&runtime.gpu_allocator, passes.scene_depth);
+    destroy_render_image(&runtime.gpu_allocator, passes.cone_depth);
+    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        destroy_render_image(&runtime.gpu_allocator, passes.cloud_color[i]);
+        destroy_render_image(&runtime.gpu_allocator, passes.cloud_depth[i]);
+    }
+}
+
+void destroy_frame_passes(RuntimeData& runtime)
+{
+    VkDevice logical_device = runtime.logical_device;
+    FramePasses& passes = runtime.passes;
+    vkDestroyPipeline(logical_device, passes.composite_pipeline, nullptr);
+    vkDestroyPipelineLayout(logical_device, passes.clouds_layout, nullptr);
+    vkDestroyPipelineLayout(logical_device, passes.composite_layout, nullptr);
+    vkDestroyPipelineLayout(logical_device, passes.cone_layout, nullptr);
+    vkDestroyDescriptorSetLayout(logical_device, passes.clouds_set_layout, nullptr);
+    vkDestroyDescriptorSetLayout(logical_device, passes.composite_set_layout, nullptr);
+    vkDestroyDescriptorSetLayout(logical_device, passes.cone_set_layout, nullptr);
+    vkDestroyDescriptorSetLayout(logical_device, passes.scene_set_layout, nullptr);
+    vkDestroySampler(logical_device, passes.sampler, nullptr);
+    vkDestroyRenderPass(logical_device, passes.scene_render_pass, nullptr);
+    passes = {};
+}
+
+// ===== END FRAME PASSES
+
+// ===== NOISE TEXTURES
+
+// tileable volume, filled through the upload ring. Shared between the transfer and graphics families like the other uploads
+RenderImage create_noise_volume(
+    GpuAllocator* allocator,
+    UploadManager* uploads,
+    u32 size,
+    VkFormat format,
+    const void* texels,
+    u32 texel_size)
+{
+    VkDevice logical_device = allocator->logical_device;
+    u32 sharing_families[2] = {};
+    u32 num_sharing_families = upload_sharing_families(uploads, sharing_families);
+    RenderImage volume = {};
+    VkImageCreateInfo image_info = {};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_3D;
+    image_info.format = format;
+    image_info.extent = {size, size, size};
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    image_info.sharingMode = num_sharing_families > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+    image_info.queueFamilyIndexCount = num_sharing_families > 1 ? num_sharing_families : 0;
+    image_info.pQueueFamilyIndices = num_sharing_families > 1 ? sharing_families : nullptr;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkResult result = vkCreateImage(logical_device, &image_info, nullptr, &volume.image);
+    VK_CHECK(result);
+    volume.mem = gpu_alloc_image(allocator, volume.image, GPU_MEMORY_GPU_ONLY);
+    VkImageViewCreateInfo view_info = {};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = volume.image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_3D;
+    view_info.format = format;
+    view_info.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    result = vkCreateImageView(logical_device, &view_info, nullptr, &volume.view);
+    VK_CHECK(result);
+    upload_image(uploads, volume.image, {size, size, size}, texel_size, texels);
+    return volume;
+}
+
+void create_noise_textures(RuntimeData& runtime)
+{
+    TINY_PROFILE_FUNCTION();
+    NoiseBakeDesc desc = runtime.options.noise;
+    VkFormat format = desc.format == NOISE_FORMAT_R16 ? VK_FORMAT_R16_UNORM : VK_FORMAT_R8_UNORM;
+    VkFormatProperties format_props = {};
+    vkGetPhysicalDeviceFormatProperties(runtime.physical_device, format, &format_props);
+    const VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    if ((format_props.optimalTilingFeatures & needed) != needed)
+    {
+        // r8 filtering is guaranteed, r16 isn't
+        LOG_WARN("Device can't filter r16 noise volumes, baking r8 instead");
+        desc.format = NOISE_FORMAT_R8;
+        format = VK_FORMAT_R8_UNORM;
+    }
+    NoiseVolumes volumes = noise_bake(desc, 0, bake_cache_dir);
+    NoiseTextures& noise = runtime.noise;
+    noise.format = format;
+    u32 texel_size = noise_format_bytes(desc.format);
+    noise.shape = create_noise_volume(&runtime.gpu_allocator, &runtime.uploads, desc.size, format, volumes.shape.data(), texel_size);
+    noise.detail = create_noise_volume(&runtime.gpu_allocator, &runtime.uploads, desc.size, format, volumes.detail.data(), texel_size);
+
+    VkSamplerCreateInfo sampler_info = {};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = VK_FILTER_LINEAR;
+    sampler_info.minFilter = VK_FILTER_LINEAR;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_info.maxLod = 0.0f;
+    VkResult result = vkCreateSampler(runtime.logical_device, &sampler_info, nullptr, &noise.sampler);
+    VK_CHECK(result);
+}
+
+void destroy_noise_textures(RuntimeData& runtime)
+{
+    NoiseTextures& noise = runtime.noise;
+    vkDestroySampler(runtime.logical_device, noise.sampler, nullptr);
+    destroy_render_image(&runtime.gpu_allocator, noise.shape);
+    destroy_render_image(&runtime.gpu_allocator, noise.detail);
+    noise = {};
+}
+
+// ===== END NOISE TEXTURES
+
+// ===== LIGHT GRID
+
+void create_light_grid(RuntimeData& runtime)
+{
+    VkDevice logical_device = runtime.logical_device;
+    LightGrid& grid = runtime.light_grid;
+    VkImageCreateInfo image_info = {};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_3D;
+    image_info.format = LIGHT_GRID_FORMAT;
+    image_info.extent = {LIGHT_GRID_SIZE, LIGHT_GRID_SIZE, LIGHT_GRID_SIZE};
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkResult result = vkCreateImage(logical_device, &image_info, nullptr, &grid.volume.image);
+    VK_CHECK(result);
+    grid.volume.mem = gpu_alloc_image(&runtime.gpu_allocator, grid.volume.image, GPU_MEMORY_GPU_ONLY);
+    VkImageViewCreateInfo view_info = {};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = grid.volume.image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_3D;
+    view_info.format = LIGHT_GRID_FORMAT;
+    view_info.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    result = vkCreateImageView(logical_device, &view_info, nullptr, &grid.volume.view);
+    VK_CHECK(result);
+
+    VkSamplerCreateInfo sampler_info = {};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = VK_FILTER_LINEAR;
+    sampler_info.minFilter = VK_FILTER_LINEAR;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+    sampler_info.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    sampler_info.maxLod = 0.0f;
+    result = vkCreateSampler(logical_device, &sampler_info, nullptr, &grid.sampler);
+    VK_CHECK(result);
+
+    // light_grid.comp: the grid as a storage image. Set 0 is the shared ubo set
+    VkDescriptorType grid_types[] = {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE};
+    grid.set_layout = create_pass_set_layout(logical_device, grid_types, ARRAY_SIZE(grid_types), VK_SHADER_STAGE_COMPUTE_BIT);
+    VkDescriptorSetLayout layouts[] = {runtime.descriptor_set_layout, grid.set_layout};
+    grid.layout = create_pipeline_layout(logical_device, layouts, ARRAY_SIZE(layouts));
+}
+
+void allocate_light_grid_set(RuntimeData& runtime)
+{
+    LightGrid& grid = runtime.light_grid;
+    VkDescriptorSetAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = runtime.descriptor_pool;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &grid.set_layout;
+    VkResult result = vkAllocateDescriptorSets(runtime.logical_device, &alloc_info, &grid.set);
+    VK_CHECK(result);
+    VkDescriptorImageInfo image_info = {VK_NULL_HANDLE, grid.volume.view, VK_IMAGE_LAYOUT_GENERAL};
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = grid.set;
+    write.dstBinding = 0;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    write.descriptorCount = 1;
+    write.pImageInfo = &image_info;
+    vkUpdateDescriptorSets(runtime.logical_device, 1, &write, 0, nullptr);
+}
+
+// decides which slices this frame's light grid update covers. Anything the grid depends on changing by hand
+// (sun, density params, LOD bias, quality) rebuilds all of it. Time moving alone (the density scrolls with it, and wobbles outside of bench runs)
+// only refreshes every LIGHT_GRID_SLICE_FRAMES'th slice, so it's spread over that many frames. Nothing changing skips the pass
+void light_grid_begin_frame(RuntimeData& runtime)
+{
+    LightGrid& grid = runtime.light_grid;
+    const CloudData& cloud = runtime.cloud;
+    glm::vec4 sun_dir = glm::vec4(glm::vec3(cloud.sun_dir_and_time), 0.0f);
+    const ShaderQuality& quality = runtime.active_variant.quality;
+    // imgui renormalizes the sun every frame, so compare loosely rather than rebuild on the last bit flipping
+    constexpr f32 epsilon = 1e-5f;
+    bool rebuild = !grid.valid || glm::length(sun_dir - grid.sun_dir) > epsilon || 
+        glm::length(cloud.cloudDensityParams - grid.density_params) > epsilon ||
+        runtime.lod_bias != grid.lod_bias || memcmp(&quality, &grid.quality, sizeof(ShaderQuality)) != 0;
+    if (rebuild)
+    {
+        grid.valid = true;
+        grid.sun_dir = sun_dir;
+        grid.density_params = cloud.cloudDensityParams;
+        grid.quality = quality;
+        grid.lod_bias = runtime.lod_bias;
+        grid.first_slice = 0;
+        grid.slice_stride = 1;
+    }
+    else if (cloud.sun_dir_and_time.w != grid.time)
+    {
+        grid.first_slice = grid.next_slice;
+        grid.slice_stride = LIGHT_GRID_SLICE_FRAMES;
+        grid.next_slice = (grid.next_slice + 1) % LIGHT_GRID_SLICE_FRAMES;
+    }
+    else
+    {
+        grid.slice_stride = 0;
+    }
+    grid.time = cloud.sun_dir_and_time.w;
+}
+
+void destroy_light_grid(RuntimeData& runtime)
+{
+    LightGrid& grid = runtime.light_grid;
+    vkDestroyPipelineLayout(runtime.logical_device, grid.layout, nullptr);
+    vkDestroyDescriptorSetLayout(runtime.logical_device, grid.set_layout, nullptr);
+    vkDestroySampler(runtime.logical_device, grid.sampler, nullptr);
+    destroy_render_image(&runtime.gpu_allocator, grid.volume);
+    grid = {};
+}
+
+// ===== END LIGHT GRID
+
+// ===== OCCUPANCY GRID
+
+void create_occupancy_grid(RuntimeData& runtime)
+{
+    VkDevice logical_device = runtime.logical_device;
+    OccupancyGrid& occupancy = runtime.occupancy;
+    VkImageCreateInfo image_info = {};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_3D;
+    image_info.format = OCCUPANCY_FORMAT;
+    image_info.extent = {OCCUPANCY_SIZE, OCCUPANCY_SIZE, OCCUPANCY_SIZE};
+    image_info.mipLevels = OCCUPANCY_LEVELS;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkResult result = vkCreateImage(logical_device, &image_info, nullptr, &occupancy.volume.image);
+    VK_CHECK(result);
+    occupancy.volume.mem = gpu_alloc_image(&runtime.gpu_allocator, occupancy.volume.image, GPU_MEMORY_GPU_ONLY);
+    VkImageViewCreateInfo view_info = {};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = occupancy.volume.image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_3D;
+    view_info.format = OCCUPANCY_FORMAT;
+    view_info.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, OCCUPANCY_LEVELS, 0, 1};
+    result = vkCreateImageView(logical_device, &view_info, nullptr, &occupancy.volume.view);
+    VK_CHECK(result);
+    for (u32 level = 0; level < OCCUPANCY_LEVELS; level++)
+    {
+        view_info.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+        result = vkCreateImageView(logical_device, &view_info, nullptr, &occupancy.level_views[level]);
+        VK_CHECK(result);
+    }
+
+    VkSamplerCreateInfo sampler_info = {};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = VK_FILTER_NEAREST;
+    sampler_info.minFilter = VK_FILTER_NEAREST;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.maxLod = (f32)(OCCUPANCY_LEVELS - 1);
+    result = vkCreateSampler(logical_device, &sampler_info, nullptr, &occupancy.sampler);
+    VK_CHECK(result);
+
+    // occupancy.comp / occupancy_mip.comp: the level below (or the light grid) in, this level out
+    VkDescriptorType occupancy_types[] = {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE};
+    occupancy.set_layout = create_pass_set_layout(logical_device, occupancy_types, ARRAY_SIZE(occupancy_types), VK_SHADER_STAGE_COMPUTE_BIT);
+    VkDescriptorSetLayout layouts[] = {runtime.descriptor_set_layout, occupancy.set_layout};
+    occupancy.layout = create_pipeline_layout(logical_device, layouts, ARRAY_SIZE(layouts));
+}
+
+void allocate_occupancy_sets(RuntimeData& runtime)
+{
+    OccupancyGrid& occupancy = runtime.occupancy;
+    VkDescriptorSetLayout layouts[OCCUPANCY_LEVELS] = {};
+    for (u32 level = 0; level < OCCUPANCY_LEVELS; level++)
+    {
+        layouts[level] = occupancy.set_layout;
+    }
+    VkDescriptorSetAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = runtime.descriptor_pool;
+    alloc_info.descriptorSetCount = OCCUPANCY_LEVELS;
+    alloc_info.pSetLayouts = layouts;
+    VkResult result = vkAllocateDescriptorSets(runtime.logical_device, &alloc_info, occupancy.sets);
+    VK_CHECK(result);
+    VkDescriptorImageInfo image_infos[OCCUPANCY_LEVELS][2] = {};
+    VkWriteDescriptorSet writes[OCCUPANCY_LEVELS][2] = {};
+    for (u32 level = 0; level < OCCUPANCY_LEVELS; level++)
+    {
+        VkImageView source = level == 0 ? runtime.light_grid.volume.view : occupancy.level_views[level - 1];
+        image_infos[level][0] = {VK_NULL_HANDLE, source, VK_IMAGE_LAYOUT_GENERAL};
+        image_infos[level][1] = {VK_NULL_HANDLE, occupancy.level_views[level], VK_IMAGE_LAYOUT_GENERAL};
+        for (u32 binding = 0; binding < 2; binding++)
+        {
+            VkWriteDescriptorSet& write = writes[level][binding];
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = occupancy.sets[level];
+            write.dstBinding = binding;
+            write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            write.descriptorCount = 1;
+            write.pImageInfo = &image_infos[level][binding];
+        }
+    }
+    vkUpdateDescriptorSets(runtime.logical_device, OCCUPANCY_LEVELS * 2, &writes[0][0], 0, nullptr);
+}
+
+void destroy_occupancy_grid(RuntimeData& runtime)
+{
+    VkDevice logical_device = runtime.logical_device;
+    OccupancyGrid& occupancy = runtime.occupancy;
+    vkDestroyPipeline(logical_device, occupancy.build_pipeline, nullptr);
+    vkDestroyPipeline(logical_device, occupancy.mip_pipeline, nullptr);
+    vkDestroyPipelineLayout(logical_device, occupancy.layout, nullptr);
+    vkDestroyDescriptorSetLayout(logical_device, occupancy.set_layout, nullptr);
+    vkDestroySampler(logical_device, occupancy.sampler, nullptr);
+    for (u32 level = 0; level < OCCUPANCY_LEVELS; level++)
+    {
+        vkDestroyImageView(logical_device, occupancy.level_views[level], nullptr);
+    }
+    destroy_render_image(&runtime.gpu_allocator, occupancy.volume);
+    occupancy = {};
+}
+
+// ===== END OCCUPANCY GRID
+
+// ===== TERRAIN
+
+// the heightfield is a plain 2d render image, the min/max pyramid and the horizon map need more than one subresource
+void create_terrain_map(RuntimeData& runtime)
+{
+    VkDevice logical_device = runtime.logical_device;
+    TerrainMap& terrain = runtime.terrain;
+    constexpr VkImageUsageFlags usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    terrain.heightfield = create_render_image(&runtime.gpu_allocator, {TERRAIN_SIZE, TERRAIN_SIZE}, TERRAIN_FORMAT, usage);
+
+    VkImageCreateInfo image_info = {};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = TERRAIN_FORMAT;
+    image_info.extent = {TERRAIN_SIZE, TERRAIN_SIZE, 1};
+    image_info.mipLevels = TERRAIN_MINMAX_LEVELS;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = usage;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkResult result = vkCreateImage(logical_device, &image_info, nullptr, &terrain.minmax.image);
+    VK_CHECK(result);
+    terrain.minmax.mem = gpu_alloc_image(&runtime.gpu_allocator, terrain.minmax.image, GPU_MEMORY_GPU_ONLY);
+    VkImageViewCreateInfo view_info = {};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = terrain.minmax.image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = TERRAIN_FORMAT;
+    view_info.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, TERRAIN_MINMAX_LEVELS, 0, 1};
+    result = vkCreateImageView(logical_device, &view_info, nullptr, &terrain.minmax.view);
+    VK_CHECK(result);
+    for (u32 level = 0; level < TERRAIN_MINMAX_LEVELS; level++)
+    {
+        view_info.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+        result = vkCreateImageView(logical_device, &view_info, nullptr, &terrain.minmax_level_views[level]);
+        VK_CHECK(result);
+    }
+
+    image_info.extent = {TERRAIN_HORIZON_SIZE, TERRAIN_HORIZON_SIZE, 1};
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = TERRAIN_HORIZON_LAYERS;
+    result = vkCreateImage(logical_device, &image_info, nullptr, &terrain.horizon.image);
+    VK_CHECK(result);
+    terrain.horizon.mem = gpu_alloc_image(&runtime.gpu_allocator, terrain.horizon.image, GPU_MEMORY_GPU_ONLY);
+    view_info.image = terrain.horizon.image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+    view_info.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, TERRAIN_HORIZON_LAYERS};
+    result = vkCreateImageView(logical_device, &view_info, nullptr, &terrain.horizon.view);
+    VK_CHECK(result);
+
+    VkSamplerCreateInfo sampler_info = {};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = VK_FILTER_LINEAR;
+    sampler_info.minFilter = VK_FILTER_LINEAR;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.maxLod = 0.0f;
+    result = vkCreateSampler(logical_device, &sampler_info, nullptr, &terrain.sampler);
+    VK_CHECK(result);
+
+    // every bake pass: what it reads in, what it writes out. Set 0 is the shared ubo set
+    VkDescriptorType terrain_types[] = {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE};
+    terrain.set_layout = create_pass_set_layout(logical_device, terrain_types, ARRAY_SIZE(terrain_types), VK_SHADER_STAGE_COMPUTE_BIT);
+    VkDescriptorSetLayout layouts[] = {runtime.descriptor_set_layout, terrain.set_layout};
+    terrain.layout = create_pipeline_layout(logical_device, layouts, ARRAY_SIZE(layouts));
+}
+
+void allocate_terrain_sets(RuntimeData& runtime)
+{
+    TerrainMap& terrain = runtime.terrain;
+    constexpr u32 num_sets = TERRAIN_MINMAX_LEVELS + 2;
+    VkDescriptorSetLayout layouts[num_sets] = {};
+    for (u32 i = 0; i < num_sets; i++)
+    {
+        layouts[i] = terrain.set_layout;
+    }
+    VkDescriptorSet sets[num_sets] = {};
+    VkDescriptorSetAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = runtime.descriptor_pool;
+    alloc_info.descriptorSetCount = num_sets;
+    alloc_info.pSetLayouts = layouts;
+    VkResult result = vkAllocateDescriptorSets(runtime.logical_device, &alloc_info, sets);
+    VK_CHECK(result);
+    terrain.bake_set = sets[0];
+    terrain.horizon_set = sets[1];
+    for (u32 level = 0; level < TERRAIN_MINMAX_LEVELS; level++)
+    {
+        terrain.minmax_sets[level] = sets[2 + level];
+    }
+
+    // (source, destination) per set. terrain_bake.comp only writes, its source is never read
+    VkImageView views[num_sets][2] = 
+    {
+        {terrain.heightfield.view, terrain.heightfield.view},
+        {terrain.heightfield.view, terrain.horizon.view},
+    };
+    for (u32 level = 0; level < TERRAIN_MINMAX_LEVELS; level++)
+    {
+        views[2 + level][0] = level == 0 ? terrain.heightfield.view : terrain.minmax_level_views[level - 1];
+        views[2 + level][1] = terrain.minmax_level_views[level];
+    }
+    VkDescriptorImageInfo image_infos[num_sets][2] = {};
+    VkWriteDescriptorSet writes[num_sets][2] = {};
+    for (u32 i = 0; i < num_sets; i++)
+    {
+        for (u32 binding = 0; binding < 2; binding++)
+        {
+            image_infos[i][binding] = {VK_NULL_HANDLE, views[i][binding], VK_IMAGE_LAYOUT_GENERAL};
+            VkWriteDescriptorSet& write = writes[i][binding];
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = sets[i];
+            write.dstBinding = binding;
+            write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            write.descriptorCount = 1;
+            write.pImageInfo = &image_infos[i][binding];
+        }
+    }
+    vkUpdateDescriptorSets(runtime.logical_device, num_sets * 2, &writes[0][0], 0, nullptr);
+}
+
+void destroy_terrain_map(RuntimeData& runtime)
+{
+    VkDevice logical_device = runtime.logical_device;
+    TerrainMap& terrain = runtime.terrain;
+    vkDestroyPipeline(logical_device, terrain.bake_pipeline, nullptr);
+    vkDestroyPipeline(logical_device, terrain.minmax_pipeline, nullptr);
+    vkDestroyPipeline(logical_device, terrain.horizon_pipeline, nullptr);
+    vkDestroyPipelineLayout(logical_device, terrain.layout, nullptr);
+    vkDestroyDescriptorSetLayout(logical_device, terrain.set_layout, nullptr);
+    vkDestroySampler(logical_device, terrain.sampler, nullptr);
+    for (u32 level = 0; level < TERRAIN_MINMAX_LEVELS; level++)
+    {
+        vkDestroyImageView(logical_device, terrain.minmax_level_views[level], nullptr);
+    }
+    destroy_render_image(&runtime.gpu_allocator, terrain.horizon);
+    destroy_render_image(&runtime.gpu_allocator, terrain.minmax);
+    destroy_render_image(&runtime.gpu_allocator, terrain.heightfield);
+    terrain = {};
+}
+
+// ===== END TERRAIN
+
+// ===== SDF VOLUME
+
+void create_sdf_volume(RuntimeData& runtime)
+{
+    VkDevice logical_device = runtime.logical_device;
+    SdfVolume& sdf = runtime.sdf;
+    u32 size = runtime.options.sdf_size;
+    sdf.extent = {size, size / 4, size};
+    VkExtent3D brick_extent = {sdf.extent.width / SDF_BRICK_SIZE, sdf.extent.height / SDF_BRICK_SIZE, sdf.extent.depth / SDF_BRICK_SIZE};
+    VkExtent3D extents[2] = {sdf.extent, brick_extent};
+    RenderImage* images[2] = {&sdf.volume, &sdf.bricks};
+    for (u32 i = 0; i < ARRAY_SIZE(images); i++)
+    {
+        RenderImage& image = *images[i];
+        VkImageCreateInfo image_info = {};
+        image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_info.imageType = VK_IMAGE_TYPE_3D;
+        image_info.format = SDF_FORMAT;
+        image_info.extent = extents[i];
+        image_info.mipLevels = 1;
+        image_info.arrayLayers = 1;
+        image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_info.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkResult result = vkCreateImage(logical_device, &image_info, nullptr, &image.image);
+        VK_CHECK(result);
+        image.mem = gpu_alloc_image(&runtime.gpu_allocator, image.image, GPU_MEMORY_GPU_ONLY);
+        VkImageViewCreateInfo view_info = {};
+        view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_info.image = image.image;
+        view_info.viewType = VK_IMAGE_VIEW_TYPE_3D;
+        view_info.format = SDF_FORMAT;
+        view_info.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        result = vkCreateImageView(logical_device, &view_info, nullptr, &image.view);
+        VK_CHECK(result);
+    }
+
+    // the bricks are only texelFetch'd, so one sampler does for both
+    VkSamplerCreateInfo sampler_info = {};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = VK_FILTER_LINEAR;
+    sampler_info.minFilter = VK_FILTER_LINEAR;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.maxLod = 0.0f;
+    VkResult result = vkCreateSampler(logical_device, &sampler_info, nullptr, &sdf.sampler);
+    VK_CHECK(result);
+
+    // sdf_bricks.comp writes the bricks, sdf_bake.comp reads them and writes the volume. Set 0 has the terrain maps they bake from
+    VkDescriptorType sdf_types[] = {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE};
+    sdf.set_layout = create_pass_set_layout(logical_device, sdf_types, ARRAY_SIZE(sdf_types), VK_SHADER_STAGE_COMPUTE_BIT);
+    VkDescriptorSetLayout layouts[] = {runtime.descriptor_set_layout, sdf.set_layout};
+    sdf.layout = create_pipeline_layout(logical_device, layouts, ARRAY_SIZE(layouts));
+    LOG_INFO("Static sdf volume %ux%ux%u, %ux%ux%u bricks", sdf.extent.width, sdf.extent.height, sdf.extent.depth, 
+        brick_extent.width, brick_extent.height, brick_extent.depth);
+}
+
+void allocate_sdf_set(RuntimeData& runtime)
+{
+    SdfVolume& sdf = runtime.sdf;
+    VkDescriptorSetAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = runtime.descriptor_pool;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &sdf.set_layout;
+    VkResult result = vkAllocateDescriptorSets(runtime.logical_device, &alloc_info, &sdf.set);
+    VK_CHECK(result);
+    VkDescriptorImageInfo image_infos[2] = 
+    {
+        {VK_NULL_HANDLE, sdf.bricks.view, VK_IMAGE_LAYOUT_GENERAL},
+        {VK_NULL_HANDLE, sdf.volume.view, VK_IMAGE_LAYOUT_GENERAL},
+    };
+    VkWriteDescriptorSet writes[2] = {};
+    for (u32 binding = 0; binding < 2; binding++)
+    {
+        VkWriteDescriptorSet& write = writes[binding];
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = sdf.set;
+        write.dstBinding = binding;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        write.descriptorCount = 1;
+        write.pImageInfo = &image_infos[binding];
+    }
+    vkUpdateDescriptorSets(runtime.logical_device, ARRAY_SIZE(writes), writes, 0, nullptr);
+}
+
+void destroy_sdf_volume(RuntimeData& runtime)
+{
+    VkDevice logical_device = runtime.logical_device;
+    SdfVolume& sdf = runtime.sdf;
+    vkDestroyPipeline(logical_device, sdf.bricks_pipeline, nullptr);
+    vkDestroyPipeline(logical_device, sdf.bake_pipeline, nullptr);
+    vkDestroyPipelineLayout(logical_device, sdf.layout, nullptr);
+    vkDestroyDescriptorSetLayout(logical_device, sdf.set_layout, nullptr);
+    vkDestroySampler(logical_device, sdf.sampler, nullptr);
+    destroy_render_image(&runtime.gpu_allocator, sdf.bricks);
+    destroy_render_image(&runtime.gpu_allocator, sdf.volume);
+    sdf = {};
+}
+
+// ===== END SDF VOLUME
+
+RuntimeData initVulkan(const LaunchOptions& options)
 {    
-    const u32 program_max_mem = MEGABYTES_BYTES(2);
-    void* program_mem = TSYSALLOC(program_max_mem);
+    TINY_PROFILE_SCOPE("initVulkan");
+    auto init_start = std::chrono::steady_clock::now();
+    // just address space, pages get committed as it fills up. Nothing close to this is ever used
+    const size_t program_max_mem = GIGABYTES_BYTES(4ull);
     RuntimeData runtime;
-    runtime.arena = arena_init(program_mem, program_max_mem, "MainArena");
+    runtime.options = options;
+    const bool headless = options.headless;
+    runtime.arena = arena_init_virtual(program_max_mem, "MainArena");
     Arena& arena = runtime.arena;
-    // NOTE: because we set up of the debug messenger after the instance - any bugs/messages in instance creation
-    // won't be shown. There is a way around this...
-    runtime.instance = createInstance(&arena);
-    setup_debug_messenger(runtime.instance, runtime.debug_messenger);
-    runtime.surface = get_native_window_surface(runtime.instance);
-    runtime.physical_device = find_physical_device(&arena, runtime.instance, runtime.surface);
-    runtime.logical_device = create_logical_device(&arena, runtime.instance, runtime.physical_device, runtime.surface);
-    QueueFamilyIndices indices = find_queue_families(&arena, runtime.physical_device, runtime.surface);
-    runtime.indices = indices;
-    vkGetDeviceQueue(runtime.logical_device, indices.graphics_family.value(), 0, &runtime.graphics_queue);
-    vkGetDeviceQueue(runtime.logical_device, indices.present_family.value(), 0, &runtime.present_queue);
+    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "FrameArena%u", i);
+        runtime.frame_arenas[i] = arena_init_virtual(FRAME_ARENA_RESERVE, name);
+    }
+    {
+        TINY_PROFILE_SCOPE("createInstance");
+        // NOTE: because we set up of the debug messenger after the instance - any bugs/messages in instance creation
+        // won't be shown. There is a way around this...
+        runtime.instance = createInstance(&arena, headless);
+        setup_debug_messenger(runtime.instance, runtime.debug_messenger);
+        // no window means no surface. Everything downstream treats a null surface as headless
+        runtime.surface = headless ? VK_NULL_HANDLE : get_native_window_surface(runtime.instance);
+    }
+    QueueFamilyIndices indices = {};
+    {
+        TINY_PROFILE_SCOPE("create_device");
+        runtime.physical_device = find_physical_device(&arena, runtime.instance, runtime.surface);
+        runtime.logical_device = create_logical_device(&arena, runtime.instance, runtime.physical_device, runtime.surface);
+        indices = find_queue_families(&arena, runtime.physical_device, runtime.surface);
+        runtime.indices = indices;
+        vkGetDeviceQueue(runtime.logical_device, indices.graphics_family.value(), 0, &runtime.graphics_queue);
+        vkGetDeviceQueue(runtime.logical_device, indices.present_family.value(), 0, &runtime.present_queue);
+        vkGetDeviceQueue(runtime.logical_device, indices.transfer_family.value(), 0, &runtime.transfer_queue);
+        gpu_allocator_init(&runtime.gpu_allocator, runtime.physical_device, runtime.logical_device);
+        upload_manager_init(&runtime.uploads, &runtime.gpu_allocator, runtime.physical_device, runtime.transfer_queue, 
+            indices.transfer_family.value(), indices.graphics_family.value(), UPLOAD_DEFAULT_RING_SIZE);
+        pipeline_cache_init(&runtime.pipeline_cache, runtime.physical_device, runtime.logical_device, options.pipeline_cache_path);
+    }
     
-    constexpr u32 swapchain_arena_size = MEGABYTES_BYTES(1);
-    void* swapchain_arena_mem = arena_alloc(&arena, swapchain_arena_size);
-    runtime.swapchain_arena = arena_init(swapchain_arena_mem, swapchain_arena_size, "SwapchainArena");;
-    runtime.swapchain_info = create_swapchain(&runtime.swapchain_arena, runtime.logical_device, runtime.physical_device, runtime.surface);
-    runtime.swapchain_image_views = create_swapchain_image_views(&runtime.swapchain_arena, runtime.logical_device, runtime.swapchain_info);
-    runtime.render_pass = create_render_pass(&arena, runtime.logical_device, runtime.swapchain_info);
-    runtime.descriptor_set_layout = create_descriptor_set_layout(runtime.logical_device);
-    runtime.graphics_pipeline = create_graphics_pipeline(&arena, runtime.logical_device, runtime.descriptor_set_layout, runtime.swapchain_info, runtime.render_pass, runtime.pipline_layout);
-    runtime.swapchain_framebuffers = create_framebuffers(&runtime.swapchain_arena, runtime.swapchain_image_views, runtime.logical_device, runtime.render_pass, runtime.swapchain_info.extent);
+    {
+        TINY_PROFILE_SCOPE("create_swapchain");
+        constexpr u32 swapchain_arena_size = MEGABYTES_BYTES(1);
+        void* swapchain_arena_mem = arena_alloc(&arena, swapchain_arena_size);
+        runtime.swapchain_arena = arena_init(swapchain_arena_mem, swapchain_arena_size, "SwapchainArena");;
+        if (headless)
+        {
+            runtime.swapchain_info = create_offscreen_swapchain(&runtime.swapchain_arena, &runtime.gpu_allocator, {options.width, options.height});
+        }
+        else
+        {
+            runtime.swapchain_info = create_swapchain(&runtime.swapchain_arena, runtime.logical_device, runtime.physical_device, runtime.surface);
+        }
+        runtime.swapchain_image_views = create_swapchain_image_views(&runtime.swapchain_arena, runtime.logical_device, runtime.swapchain_info);
+    }
+    {
+        TINY_PROFILE_SCOPE("create_pipeline");
+        runtime.render_pass = create_render_pass(&arena, runtime.logical_device, runtime.swapchain_info, headless);
+        runtime.descriptor_set_layout = create_descriptor_set_layout(runtime.logical_device);
+        create_frame_passes(runtime);
+        VkDescriptorSetLayout scene_layouts[] = {runtime.descriptor_set_layout, runtime.passes.scene_set_layout};
+        runtime.pipline_layout = create_pipeline_layout(runtime.logical_device, scene_layouts, ARRAY_SIZE(scene_layouts));
+        create_light_grid(runtime);
+        create_occupancy_grid(runtime);
+        create_terrain_map(runtime);
+        create_sdf_volume(runtime);
+        runtime.shader_compiler = shader_compiler_init(shader_source_dir, shader_cache_dir);
+        ShaderWatch shader_watches[MAIN_SHADER_COUNT];
+        get_main_shader_watches(runtime.physical_device, shader_watches);
+        load_main_shaders(runtime.shader_compiler, shader_watches, runtime.main_spirv);
+        auto pipeline_start = std::chrono::steady_clock::now();
+        runtime.quality = options.quality;
+        runtime.cloud_downsample = options.cloud_downsample;
+        runtime.procedural_noise = options.procedural_noise;
+        runtime.relaxed_tracing = options.relaxed_tracing;
+        runtime.cone_prepass = options.cone_prepass;
+        runtime.lod_bias = options.lod_bias;
+        create_composite_pipeline(runtime);
+        create_occupancy_pipelines(runtime);
+        create_terrain_pipelines(runtime);
+        create_sdf_pipelines(runtime);
+        runtime.active_variant = get_pipeline_variant(runtime, get_shader_quality(runtime));
+        runtime.pipeline_cache.create_ms += std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - pipeline_start).count();
+        if (!headless) // headless/bench runs are fire and forget, nobody's editing shaders underneath them
+        {
+            runtime.shader_hot_reload = shader_hot_reload_start(runtime.shader_compiler, shader_watches, ARRAY_SIZE(shader_watches), 
+                main_shader_includes, ARRAY_SIZE(main_shader_includes));
+        }
+        runtime.swapchain_framebuffers = create_framebuffers(&runtime.swapchain_arena, runtime.swapchain_image_views, runtime.logical_device, runtime.render_pass, runtime.swapchain_info.extent);
+    }
 
-    runtime.command_pool = create_command_pool(&arena, indices, runtime.logical_device);
-    runtime.command_buffers = create_command_buffers(&arena, runtime.logical_device, runtime.command_pool);
-    create_sync_objects(&arena, runtime.logical_device, runtime.img_available_semaphores, runtime.render_finished_semaphores, runtime.inflight_fences);
+    {
+        TINY_PROFILE_SCOPE("create_commands_and_sync");
+        runtime.command_pool = create_command_pool(&arena, indices, runtime.logical_device);
+        runtime.command_buffers = create_command_buffers(&arena, runtime.logical_device, runtime.command_pool);
+        create_sync_objects(&arena, runtime.logical_device, runtime.img_available_semaphores, runtime.render_finished_semaphores, runtime.inflight_fences);
+    }
     
-    create_vertex_buffer(runtime.logical_device, runtime.physical_device, runtime.command_pool, runtime.graphics_queue, {vertex_data_test::vertices, ARRAY_SIZE(vertex_data_test::vertices)}, runtime.vertex_buffer, runtime.vertex_buffer_mem);
-    create_index_buffer(runtime.logical_device, runtime.physical_device, runtime.command_pool, runtime.graphics_queue, {vertex_data_test::indices, ARRAY_SIZE(vertex_data_test::indices)}, runtime.index_buffer, runtime.index_buffer_mem);
-    create_uniform_buffers(&arena, runtime.logical_device, runtime.physical_device, runtime.uniform_buffers, runtime.uniform_buffers_mem, runtime.uniform_buffers_mapped);
-    runtime.descriptor_pool = create_descriptor_pool(runtime.logical_device);
-    runtime.descriptor_sets = create_descriptor_sets(&arena, runtime.logical_device, runtime.descriptor_pool, runtime.descriptor_set_layout, runtime.uniform_buffers);
-
-    LOG_INFO("Vulkan initialization complete. Arena %i / %i bytes", arena.offset, arena.backing_mem_size);
-    init_imgui(runtime);
+    {
+        TINY_PROFILE_SCOPE("create_buffers_and_descriptors");
+        create_vertex_buffer(&runtime.gpu_allocator, &runtime.uploads, {vertex_data_test::vertices, ARRAY_SIZE(vertex_data_test::vertices)}, runtime.vertex_buffer, runtime.vertex_buffer_mem);
+        create_index_buffer(&runtime.gpu_allocator, &runtime.uploads, {vertex_data_test::indices, ARRAY_SIZE(vertex_data_test::indices)}, runtime.index_buffer, runtime.index_buffer_mem);
+        runtime.uniform_ring = create_uniform_ring(&runtime.gpu_allocator, runtime.physical_device);
+        create_noise_textures(runtime);
+        step_stats_init(&runtime.step_stats, &arena, &runtime.gpu_allocator, MAX_FRAMES_IN_FLIGHT);
+        runtime.descriptor_pool = create_descriptor_pool(runtime.logical_device);
+        runtime.descriptor_set = create_descriptor_set(runtime.logical_device, runtime.descriptor_pool, runtime.descriptor_set_layout, runtime.uniform_ring, 
+            runtime.noise, runtime.light_grid, runtime.occupancy, runtime.terrain, runtime.sdf, runtime.step_stats);
+        allocate_light_grid_set(runtime);
+        allocate_occupancy_sets(runtime);
+        allocate_terrain_sets(runtime);
+        allocate_sdf_set(runtime);
+        allocate_frame_pass_sets(runtime);
+        create_frame_targets(runtime, runtime.swapchain_info.extent);
+    }
+
+    if (headless && (options.output_dir != nullptr || options.pipe_command != nullptr))
+    {
+        TINY_PROFILE_SCOPE("create_frame_writer");
+        FrameWriterDesc writer_desc = {};
+        writer_desc.format = options.pipe_command != nullptr ? FRAME_FORMAT_PIPE : options.output_format;
+        writer_desc.output_dir = options.output_dir;
+        writer_desc.pipe_command = options.pipe_command;
+        writer_desc.width = runtime.swapchain_info.extent.width;
+        writer_desc.height = runtime.swapchain_info.extent.height;
+        writer_desc.num_threads = options.writer_threads;
+        runtime.frame_writer = frame_writer_init(writer_desc);
+        if (runtime.frame_writer != nullptr)
+        {
+            create_readback_buffers(&arena, &runtime.gpu_allocator, runtime.swapchain_info.extent, 
+                runtime.readback_buffers, runtime.readback_buffers_mem, runtime.readback_buffers_mapped, runtime.readback_frame_indices);
+        }
+    }
+
+    VkPhysicalDeviceFeatures enabled_features = {};
+    vkGetPhysicalDeviceFeatures(runtime.physical_device, &enabled_features);
+    gpu_profiler_init(&runtime.gpu_profiler, &arena, runtime.logical_device, runtime.physical_device, indices.graphics_family.value(), 
+        MAX_FRAMES_IN_FLIGHT, enabled_features.pipelineStatisticsQuery);
+
+    LOG_INFO("Vulkan initialization complete. Arena %zu bytes used, %zu committed", arena.offset, arena.committed);
+    if (!headless)
+    {
+        TINY_PROFILE_SCOPE("init_imgui");
+        auto imgui_start = std::chrono::steady_clock::now();
+        init_imgui(runtime);
+        runtime.pipeline_cache.create_ms += std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - imgui_start).count();
+    }
+    // run twice (or once with --no-pipeline-cache) to compare cold and warm starts
+    f64 init_ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - init_start).count();
+    LOG_INFO("Startup took %.2fms, %.2fms of it creating pipelines (%s pipeline cache)", 
+        init_ms, runtime.pipeline_cache.create_ms, runtime.pipeline_cache.warm ? "warm" : "cold");
     return runtime;
 }
 
@@ -1564,7 +3419,19 @@ void destroy_swapchain(RuntimeData& runtime)
     {
         vkDestroyImageView(runtime.logical_device, runtime.swapchain_image_views.data[i], nullptr);
     }
-    vkDestroySwapchainKHR(runtime.logical_device, runtime.swapchain_info.swapchain, nullptr);
+    if (runtime.options.headless)
+    {
+        // offscreen images are ours, unlike swapchain images which are owned by the swapchain
+        for (u32 i = 0; i < runtime.swapchain_info.swapchain_images.size; i++)
+        {
+            vkDestroyImage(runtime.logical_device, runtime.swapchain_info.swapchain_images.data[i], nullptr);
+            gpu_free(&runtime.gpu_allocator, runtime.swapchain_info.offscreen_image_mems.data[i]);
+        }
+    }
+    else
+    {
+        vkDestroySwapchainKHR(runtime.logical_device, runtime.swapchain_info.swapchain, nullptr);
+    }
     arena_clear(&runtime.swapchain_arena);
 }
 
@@ -1585,23 +3452,98 @@ void recreate_swapchain(RuntimeData& runtime)
     runtime.swapchain_info = create_swapchain(&runtime.swapchain_arena, runtime.logical_device, runtime.physical_device, runtime.surface);
     runtime.swapchain_image_views = create_swapchain_image_views(&runtime.swapchain_arena, runtime.logical_device, runtime.swapchain_info);
     runtime.swapchain_framebuffers = create_framebuffers(&runtime.swapchain_arena, runtime.swapchain_image_views, runtime.logical_device, runtime.render_pass, runtime.swapchain_info.extent);
+    destroy_frame_targets(runtime);
+    create_frame_targets(runtime, runtime.swapchain_info.extent);
     // NOTE: not recreating render passes here. In theory swapchain image format may change during an app's lifetime
     // like if you drag the window from a standard monitor to a high DPI monitor. In that case we'd need to recreate the render pass
 }
 
-void render(RuntimeData& runtime)
+// headless version of render(). No swapchain to aquire from or present to, 
+// the offscreen image for this frame in flight is rendered into and that's it
+void render_headless(RuntimeData& runtime)
 {
+    TINY_PROFILE_SCOPE("render_headless");
+    u32& current_frame = runtime.current_frame;
+    {
+        TINY_PROFILE_SCOPE("vkWaitForFences");
+        vkWaitForFences(runtime.logical_device, 1, &runtime.inflight_fences.data[current_frame], VK_TRUE, UINT64_MAX);
+    }
+    // the frame that last used this slot is done, so its readback and timestamps are complete
+    retire_frame_slot(runtime, current_frame);
+    frame_slot_begin(runtime, current_frame);
+    vkResetFences(runtime.logical_device, 1, &runtime.inflight_fences.data[current_frame]);
+
+    u32 img_index = current_frame;
+    // ubo goes in before recording, the draw needs its offset
+    u32 ubo_offset = update_uniform_buffer(runtime.swapchain_info.extent, runtime.uniform_ring, runtime);
+    vkResetCommandBuffer(runtime.command_buffers.data[current_frame], 0);
+    record_cmd_buffer(runtime.command_buffers.data[current_frame], 
+                        img_index, 
+                        runtime.render_pass, 
+                        runtime.swapchain_info, 
+                        runtime.swapchain_framebuffers, 
+                        runtime.active_variant, 
+                        runtime.passes, 
+                        runtime.terrain,
+                        runtime.sdf,
+                        runtime.light_grid,
+                        runtime.occupancy,
+                        runtime.vertex_buffer,
+                        runtime.index_buffer,
+                        runtime.pipline_layout,
+                        runtime.descriptor_set,
+                        ubo_offset,
+                        runtime.current_frame,
+                        false,
+                        runtime.frame_writer ? runtime.readback_buffers.data[current_frame] : VK_NULL_HANDLE,
+                        &runtime.gpu_profiler,
+                        &runtime.step_stats);
+    advance_cloud_history(runtime);
+    runtime.terrain.bake_pending = false;
+
+    VkSemaphore* wait_semaphores = nullptr;
+    VkPipelineStageFlags* wait_stages = nullptr;
+    u32 num_wait_semaphores = take_frame_wait_semaphores(runtime, VK_NULL_HANDLE, &wait_semaphores, &wait_stages);
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.waitSemaphoreCount = num_wait_semaphores;
+    submit_info.pWaitSemaphores = wait_semaphores;
+    submit_info.pWaitDstStageMask = wait_stages;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &runtime.command_buffers.data[current_frame];
+    VkResult result = vkQueueSubmit(runtime.graphics_queue, 1, &submit_info, runtime.inflight_fences.data[current_frame]);
+    VK_CHECK(result);
+    if (runtime.frame_writer)
+    {
+        runtime.readback_frame_indices.data[current_frame] = runtime.frame_index;
+    }
+    gpu_profiler_frame_submitted(&runtime.gpu_profiler, current_frame, runtime.frame_index);
+    step_stats_frame_submitted(&runtime.step_stats, current_frame, runtime.frame_index);
+    runtime.frame_index++;
+}
 
+void render(RuntimeData& runtime)
+{
+    TINY_PROFILE_SCOPE("render");
     u32& current_frame = runtime.current_frame;
     // wait until previous frame is finished drawing
-    vkWaitForFences(runtime.logical_device, 1, &runtime.inflight_fences.data[current_frame], VK_TRUE, UINT64_MAX);
+    {
+        TINY_PROFILE_SCOPE("vkWaitForFences");
+        vkWaitForFences(runtime.logical_device, 1, &runtime.inflight_fences.data[current_frame], VK_TRUE, UINT64_MAX);
+    }
+    retire_frame_slot(runtime, current_frame);
+    frame_slot_begin(runtime, current_frame);
 
     // aquire image from swapchain
     u32 img_index;
-    // img_available_semaphore is signaled when we aquire this image
-    VkResult result = vkAcquireNextImageKHR(
-        runtime.logical_device, runtime.swapchain_info.swapchain, 
-        UINT64_MAX, runtime.img_available_semaphores.data[current_frame], VK_NULL_HANDLE, &img_index);
+    VkResult result = VK_SUCCESS;
+    {
+        TINY_PROFILE_SCOPE("vkAcquireNextImageKHR");
+        // img_available_semaphore is signaled when we aquire this image
+        result = vkAcquireNextImageKHR(
+            runtime.logical_device, runtime.swapchain_info.swapchain, 
+            UINT64_MAX, runtime.img_available_semaphores.data[current_frame], VK_NULL_HANDLE, &img_index);
+    }
     if (result == VK_ERROR_OUT_OF_DATE_KHR)
     {
         // if we need to recreate the swapchain
@@ -1617,28 +3559,41 @@ void render(RuntimeData& runtime)
     vkResetFences(runtime.logical_device, 1, &runtime.inflight_fences.data[current_frame]);
     imgui_tick(runtime);
 
+    // ubo goes in before recording, the draw needs its offset
+    u32 ubo_offset = update_uniform_buffer(runtime.swapchain_info.extent, runtime.uniform_ring, runtime);
     vkResetCommandBuffer(runtime.command_buffers.data[current_frame], 0);
     record_cmd_buffer(runtime.command_buffers.data[current_frame], 
                         img_index, 
                         runtime.render_pass, 
                         runtime.swapchain_info, 
                         runtime.swapchain_framebuffers, 
-                        runtime.graphics_pipeline, 
+                        runtime.active_variant, 
+                        runtime.passes, 
+                        runtime.terrain,
+                        runtime.sdf,
+                        runtime.light_grid,
+                        runtime.occupancy,
                         runtime.vertex_buffer,
                         runtime.index_buffer,
                         runtime.pipline_layout,
-                        runtime.descriptor_sets,
-                        runtime.current_frame);
-    update_uniform_buffer(runtime.current_frame, runtime.swapchain_info.extent, runtime.uniform_buffers_mapped, runtime);
+                        runtime.descriptor_set,
+                        ubo_offset,
+                        runtime.current_frame,
+                        true,
+                        VK_NULL_HANDLE,
+                        &runtime.gpu_profiler,
+                        &runtime.step_stats);
+    advance_cloud_history(runtime);
+    runtime.terrain.bake_pending = false;
 
     // submitting the recorded command buffer
     VkSubmitInfo submit_info = {};
     submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    VkSemaphore wait_semaphores[] = {runtime.img_available_semaphores.data[current_frame]};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submit_info.waitSemaphoreCount = 1;
+    VkSemaphore* wait_semaphores = nullptr;
+    VkPipelineStageFlags* wait_stages = nullptr;
+    submit_info.waitSemaphoreCount = take_frame_wait_semaphores(runtime, runtime.img_available_semaphores.data[current_frame], &wait_semaphores, &wait_stages);
     submit_info.pWaitSemaphores = wait_semaphores;
-    submit_info.pWaitDstStageMask = waitStages;
+    submit_info.pWaitDstStageMask = wait_stages;
     submit_info.commandBufferCount = 1;
     submit_info.pCommandBuffers = &runtime.command_buffers.data[current_frame];
     VkSemaphore signal_semaphores[] = {runtime.render_finished_semaphores.data[current_frame]};
@@ -1648,6 +3603,9 @@ void render(RuntimeData& runtime)
     // since we wait on that fence at the beginning of the frame
     result = vkQueueSubmit(runtime.graphics_queue, 1, &submit_info, runtime.inflight_fences.data[current_frame]);
     VK_CHECK(result);
+    gpu_profiler_frame_submitted(&runtime.gpu_profiler, current_frame, runtime.frame_index);
+    step_stats_frame_submitted(&runtime.step_stats, current_frame, runtime.frame_index);
+    runtime.frame_index++;
 
     VkPresentInfoKHR present_info = {};
     present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1658,7 +3616,10 @@ void render(RuntimeData& runtime)
     present_info.pSwapchains = swapchains;
     present_info.pImageIndices = &img_index;
     present_info.pResults = nullptr; // Optional
-    result = vkQueuePresentKHR(runtime.present_queue, &present_info);
+    {
+        TINY_PROFILE_SCOPE("vkQueuePresentKHR");
+        result = vkQueuePresentKHR(runtime.present_queue, &present_info);
+    }
     VK_CHECK(result);
     if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || runtime.framebufferWasResized) 
     {
@@ -1667,8 +3628,31 @@ void render(RuntimeData& runtime)
     }
 }
 
+f64 get_time(const RuntimeData& runtime)
+{
+    if (runtime.options.headless)
+    {
+        // glfw is never initialized when headless
+        static auto start_time = std::chrono::steady_clock::now();
+        return std::chrono::duration<f64>(std::chrono::steady_clock::now() - start_time).count();
+    }
+    return glfwGetTime();
+}
+
 void tick(RuntimeData& runtime)
 {
+    TINY_PROFILE_SCOPE("tick");
+    if (runtime.options.bench)
+    {
+        bench_pin_frame_state(runtime.cloud, runtime.frame_index);
+        return;
+    }
+    runtime.cloud.sun_dir_and_time.w = get_time(runtime);
+    if (runtime.options.headless)
+    {
+        return; // no window, no input
+    }
+    hot_reload_shaders(runtime);
     glm::vec3 input_dir = glm::vec3(0);
     if (glfwGetKey(glob_glfw_window, GLFW_KEY_W) == GLFW_PRESS)
     {
@@ -1699,14 +3683,32 @@ void tick(RuntimeData& runtime)
         input_dir = glm::normalize(input_dir);
         runtime.cloud.cameraOffset += glm::vec4(input_dir.x, input_dir.y, input_dir.z, 0.0);
     }
-    runtime.cloud.sun_dir_and_time.w = glfwGetTime();
 }
 
 // draws a frame
 void vulkanMainLoop(RuntimeData& runtime)
 {
+    TINY_PROFILE_SCOPE("frame");
     tick(runtime);
-    render(runtime);
+    // picks up quality changes made through imgui last frame
+    runtime.active_variant = get_pipeline_variant(runtime, get_shader_quality(runtime));
+    light_grid_begin_frame(runtime);
+    if (runtime.cloud_downsample != runtime.passes.cloud_downsample)
+    {
+        // the targets are shared by every frame in flight
+        vkDeviceWaitIdle(runtime.logical_device);
+        destroy_frame_targets(runtime);
+        runtime.passes.cloud_downsample = runtime.cloud_downsample;
+        create_frame_targets(runtime, runtime.swapchain_info.extent);
+    }
+    if (runtime.options.headless)
+    {
+        render_headless(runtime);
+    }
+    else
+    {
+        render(runtime);
+    }
     runtime.current_frame = (runtime.current_frame+1) % MAX_FRAMES_IN_FLIGHT;
 }
 
@@ -1715,10 +3717,37 @@ void vulkanMainLoop(RuntimeData& runtime)
 void vulkanCleanup(RuntimeData& runtime)
 {
     vkDeviceWaitIdle(runtime.logical_device);
-    ImGui_ImplVulkan_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext();
-    vkDestroyDescriptorPool(runtime.logical_device, runtime.imgui_pool, nullptr);
+    // the last MAX_FRAMES_IN_FLIGHT frames are still sitting in their slots. Oldest first
+    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        retire_frame_slot(runtime, (runtime.current_frame + i) % MAX_FRAMES_IN_FLIGHT);
+    }
+    if (runtime.options.gpu_csv_output != nullptr)
+    {
+        gpu_profiler_export_csv(&runtime.gpu_profiler, runtime.options.gpu_csv_output);
+    }
+    gpu_profiler_destroy(&runtime.gpu_profiler, runtime.logical_device);
+    shader_hot_reload_stop(runtime.shader_hot_reload);
+    runtime.shader_hot_reload = nullptr;
+    shader_compiler_destroy(runtime.shader_compiler);
+    runtime.shader_compiler = nullptr;
+    if (runtime.frame_writer)
+    {
+        frame_writer_shutdown(runtime.frame_writer);
+        runtime.frame_writer = nullptr;
+        for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            vkDestroyBuffer(runtime.logical_device, runtime.readback_buffers.data[i], nullptr);
+            gpu_free(&runtime.gpu_allocator, runtime.readback_buffers_mem.data[i]);
+        }
+    }
+    if (!runtime.options.headless)
+    {
+        ImGui_ImplVulkan_Shutdown();
+        ImGui_ImplGlfw_Shutdown();
+        ImGui::DestroyContext();
+        vkDestroyDescriptorPool(runtime.logical_device, runtime.imgui_pool, nullptr);
+    }
     if (validation_layers_enabled)
     {
         DestroyDebugUtilsMessengerEXT(runtime.instance, runtime.debug_messenger, nullptr);
@@ -1730,22 +3759,52 @@ void vulkanCleanup(RuntimeData& runtime)
         vkDestroySemaphore(runtime.logical_device, runtime.render_finished_semaphores.data[i], nullptr);
         vkDestroyFence(runtime.logical_device, runtime.inflight_fences.data[i], nullptr);
     }
-    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-    {
-        vkDestroyBuffer(runtime.logical_device, runtime.uniform_buffers.data[i], nullptr);
-        vkFreeMemory(runtime.logical_device, runtime.uniform_buffers_mem.data[i], nullptr);
-    }
+    vkDestroyBuffer(runtime.logical_device, runtime.uniform_ring.buffer, nullptr);
+    gpu_free(&runtime.gpu_allocator, runtime.uniform_ring.mem);
+    step_stats_destroy(&runtime.step_stats, &runtime.gpu_allocator);
     vkDestroyDescriptorPool(runtime.logical_device, runtime.descriptor_pool, nullptr);
+    destroy_noise_textures(runtime);
     vkDestroyDescriptorSetLayout(runtime.logical_device, runtime.descriptor_set_layout, nullptr);
     vkDestroyBuffer(runtime.logical_device, runtime.vertex_buffer, nullptr);
-    vkFreeMemory(runtime.logical_device, runtime.vertex_buffer_mem, nullptr);
+    gpu_free(&runtime.gpu_allocator, runtime.vertex_buffer_mem);
     vkDestroyBuffer(runtime.logical_device, runtime.index_buffer, nullptr);
-    vkFreeMemory(runtime.logical_device, runtime.index_buffer_mem, nullptr);
+    gpu_free(&runtime.gpu_allocator, runtime.index_buffer_mem);
     vkDestroyCommandPool(runtime.logical_device, runtime.command_pool, nullptr);
-    vkDestroyPipeline(runtime.logical_device, runtime.graphics_pipeline, nullptr);
+    for (const PipelineVariant& variant : runtime.pipeline_variants)
+    {
+        vkDestroyPipeline(runtime.logical_device, variant.scene, nullptr);
+        vkDestroyPipeline(runtime.logical_device, variant.clouds, nullptr);
+        vkDestroyPipeline(runtime.logical_device, variant.light_grid, nullptr);
+        vkDestroyPipeline(runtime.logical_device, variant.cone, nullptr);
+    }
+    runtime.pipeline_variants.clear();
+    destroy_frame_targets(runtime);
+    destroy_frame_passes(runtime);
+    destroy_occupancy_grid(runtime);
+    destroy_terrain_map(runtime);
+    destroy_sdf_volume(runtime);
+    destroy_light_grid(runtime);
+    pipeline_cache_destroy(&runtime.pipeline_cache, runtime.logical_device);
     vkDestroyPipelineLayout(runtime.logical_device, runtime.pipline_layout, nullptr);
     vkDestroyRenderPass(runtime.logical_device, runtime.render_pass, nullptr);
-    vkDestroySurfaceKHR(runtime.instance, runtime.surface, nullptr);
+    if (runtime.surface != VK_NULL_HANDLE)
+    {
+        vkDestroySurfaceKHR(runtime.instance, runtime.surface, nullptr);
+    }
+    upload_manager_destroy(&runtime.uploads, &runtime.gpu_allocator);
+    gpu_allocator_destroy(&runtime.gpu_allocator);
     vkDestroyDevice(runtime.logical_device, nullptr);
     vkDestroyInstance(runtime.instance, nullptr);
+    arena_free_all(&runtime.arena); // the swapchain arena lives inside it
+    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        arena_free_all(&runtime.frame_arenas[i]);
+    }
+    // after the frame writer has been joined so its zones are all in
+    if (runtime.options.trace_output != nullptr)
+    {
+        tiny_profile_dump_chrome_trace(runtime.options.trace_output);
+    }
+    // every other thread that recorded zones has been joined by now
+    tiny_profile_shutdown();
 }
\ No newline at end of file
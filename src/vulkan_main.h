@@ -3,13 +3,16 @@
 #ifdef _WIN32
 #define VK_USE_PLATFORM_WIN32_KHR
 #define GLFW_EXPOSE_NATIVE_WIN32
+#elif defined(__linux__)
+// nothing to expose - glfwCreateWindowSurface picks X11/Wayland for us, 
+// and headless runs never touch a window system at all
 #else
 #error Unsupported platform
 #endif
 
 #define GLFW_INCLUDE_VULKAN
 #include "glfw/glfw3.h"
-#include <GLFW/glfw3native.h>
+#include "glfw/glfw3native.h"
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
@@ -21,8 +24,18 @@
 
 #include "defines.h"
 #include "tiny/tiny_arena.h"
+#include "frame_writer.h"
+#include "bench.h"
+#include "gpu_profiler.h"
+#include "step_stats.h"
+#include "gpu_allocator.h"
+#include "upload_manager.h"
+#include "pipeline_cache.h"
+#include "shader_compiler.h"
+#include "noise_bake.h"
 
 constexpr u32 MAX_FRAMES_IN_FLIGHT = 2;
+constexpr size_t FRAME_ARENA_RESERVE = MEGABYTES_BYTES(256ull); // address space per frame arena, committed as it's used
 
 struct Vertex
 {
@@ -75,8 +88,10 @@ struct BufferView
 
 struct SwapchainInfo
 {
-    VkSwapchainKHR swapchain = {};
+    VkSwapchainKHR swapchain = {}; // VK_NULL_HANDLE when running headless
     BufferView<VkImage> swapchain_images = {};
+    // headless only: backing memory for the device-owned images that stand in for swapchain images
+    BufferView<GpuAllocation> offscreen_image_mems = {};
     VkFormat image_format = {};
     VkExtent2D extent = {};
     u32 image_count = 0;
@@ -86,6 +101,8 @@ struct QueueFamilyIndices
 {
     std::optional<u32> graphics_family = {};
     std::optional<u32> present_family = {};
+    // dedicated transfer-only family if there is one, graphics otherwise. Always filled in by find_queue_families
+    std::optional<u32> transfer_family = {};
     bool is_complete()
     {
         // check if all values have been filled
@@ -102,8 +119,288 @@ struct CloudData
     glm::vec4 sun_dir_and_time = glm::vec4(1, 5, 1, 0);
 };
 
+// specialization constants of main.frag, in constant_id order. All 4 bytes wide (bools are VkBool32)
+// so the struct itself is the specialization data and doubles as the pipeline variant key
+struct ShaderQuality
+{
+    u32 max_steps = 30; // sdf raymarch + soft shadow steps
+    u32 cloud_sample_count = 64;
+    u32 light_sample_count = 3; // steps of the light march per light grid texel
+    VkBool32 use_light = VK_TRUE;
+    u32 fbm_octaves = 12;
+    VkBool32 baked_noise = VK_TRUE; // clouds sample the baked noise volumes instead of running fbm(). Not part of the presets
+    VkBool32 relaxed_tracing = VK_TRUE; // over-relaxed sphere tracing in raymarch(). Not part of the presets
+    VkBool32 cone_prepass = VK_TRUE; // the scene pass starts its rays where scene_cone.comp got to. Not part of the presets
+};
+
+enum QualityPreset
+{
+    QUALITY_LOW = 0,
+    QUALITY_MEDIUM,
+    QUALITY_HIGH,
+    QUALITY_ULTRA,
+
+    QUALITY_PRESET_COUNT,
+};
+extern const char* quality_preset_names[QUALITY_PRESET_COUNT];
+// "low" | "medium" | "high" | "ultra". Returns QUALITY_PRESET_COUNT if unknown
+QualityPreset quality_preset_from_string(const char* str);
+
+// parsed from the command line in main.cpp
+struct LaunchOptions
+{
+    // render into device-owned images with no window, surface or swapchain
+    bool headless = false;
+    u32 width = 800;
+    u32 height = 600;
+    // headless only: number of frames to render before exiting. 0 means run until killed
+    u32 frame_count = 0;
+    // headless only: where rendered frames get streamed to. No readback happens if neither is set
+    const char* output_dir = nullptr;
+    const char* pipe_command = nullptr;
+    FrameFormat output_format = FRAME_FORMAT_PPM;
+    u32 writer_threads = 0; // 0 = pick based on hardware threads
+    // deterministic benchmark. Implies headless so present/vsync never caps the measurement
+    bool bench = false;
+    u32 bench_warmup_frames = 60;
+    u32 bench_frames = 600;
+    const char* bench_output = nullptr; // optional json file, results always go to stdout
+    const char* gpu_csv_output = nullptr; // dumps the gpu profiler history here on exit
+    const char* trace_output = nullptr; // chrome trace of the cpu profile zones, written on exit
+    const char* pipeline_cache_path = "pipeline_cache.bin"; // null = always compile pipelines cold
+    QualityPreset quality = QUALITY_HIGH;
+    u32 cloud_downsample = 2; // cloud pass runs at 1/N res. 1, 2 or 4
+    NoiseBakeDesc noise = {}; // baked cloud noise volumes
+    bool procedural_noise = false; // start with the reference fbm() path instead of the baked volumes
+    f32 lod_bias = 0.0f; // fbm octave LOD bias, so --bench can compare biases
+    bool relaxed_tracing = true; // --bench with and without these to compare what they save
+    bool cone_prepass = true;
+    u32 sdf_size = 128; // baked static sdf voxels along x and z, y gets a quarter. Multiple of 4 * SDF_BRICK_SIZE
+};
+
+// every uniform_buffer_object lives in this one persistently mapped buffer. It's split into a region per frame in flight
+// and each draw pushes its own ubo into the current frame's region, bound through a dynamic offset.
+// Anything else the gpu reads for just one frame can be bump allocated out of the region too (uniform_ring_alloc).
+// A region is free again as soon as its frame's fence has been waited on
+constexpr VkDeviceSize UNIFORM_RING_FRAME_SIZE = 256 * 1024;
+struct UniformRing
+{
+    VkBuffer buffer = {};
+    GpuAllocation mem = {};
+    VkDeviceSize alignment = 0; // minUniformBufferOffsetAlignment, what ubo pushes align to
+    VkDeviceSize frame_begin = 0; // start of the current frame's region
+    VkDeviceSize head = 0; // next free byte in the current frame's region
+};
+
+// a pipeline that's been replaced but may still be referenced by frames in flight
+struct RetiredPipeline
+{
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    u32 pending_slots = 0; // bit per frame slot whose fence hasn't been waited on since the swap
+};
+
+// one set of pipelines per set of specialization constants it's been asked for. Switching back to a tier is free
+struct PipelineVariant
+{
+    ShaderQuality quality = {};
+    VkPipeline scene = VK_NULL_HANDLE;
+    VkPipeline clouds = VK_NULL_HANDLE;
+    VkPipeline light_grid = VK_NULL_HANDLE;
+    VkPipeline cone = VK_NULL_HANDLE;
+};
+
+// every shader the frame is built from, in the order they're compiled/hot reloaded
+enum MainShader
+{
+    MAIN_SHADER_VERT = 0, // fullscreen quad, shared by the scene and composite passes
+    MAIN_SHADER_SCENE_FRAG,
+    MAIN_SHADER_CLOUDS_COMP,
+    MAIN_SHADER_COMPOSITE_FRAG,
+    MAIN_SHADER_LIGHT_GRID_COMP,
+    MAIN_SHADER_OCCUPANCY_COMP,
+    MAIN_SHADER_OCCUPANCY_MIP_COMP,
+    MAIN_SHADER_TERRAIN_BAKE_COMP,
+    MAIN_SHADER_TERRAIN_MINMAX_COMP,
+    MAIN_SHADER_TERRAIN_HORIZON_COMP,
+    MAIN_SHADER_SDF_BRICKS_COMP,
+    MAIN_SHADER_SDF_BAKE_COMP,
+    MAIN_SHADER_SCENE_CONE_COMP,
+
+    MAIN_SHADER_COUNT,
+};
+
+struct RenderImage
+{
+    VkImage image = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    GpuAllocation mem = {};
+};
+
+constexpr VkFormat SCENE_COLOR_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+constexpr VkFormat SCENE_DEPTH_FORMAT = VK_FORMAT_R32_SFLOAT; // distance along the camera ray, not a depth buffer
+constexpr VkFormat CONE_DEPTH_FORMAT = VK_FORMAT_R32_SFLOAT; // same, for a whole tile
+constexpr u32 CONE_TILE_SIZE = 8; // pixels per cone prepass tile side, matches common.glsl
+constexpr u32 CONE_GROUP_SIZE = 8; // matches local_size in scene_cone.comp
+constexpr VkFormat CLOUD_COLOR_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+// r = scene depth, g = distance to the clouds. rg formats would need shaderStorageImageExtendedFormats
+constexpr VkFormat CLOUD_DEPTH_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+constexpr u32 CLOUD_GROUP_SIZE = 8; // matches local_size in clouds.comp
+// r = transmittance towards the sun, g = cloud density. Storage + linear filtering are only both guaranteed for rgba16f
+constexpr VkFormat LIGHT_GRID_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+constexpr u32 LIGHT_GRID_SIZE = 64; // texels per side, over the box in common.glsl
+constexpr u32 LIGHT_GRID_GROUP_SIZE = 8; // matches local_size in light_grid.comp
+// while only time is moving, a frame refreshes every LIGHT_GRID_SLICE_FRAMES'th z slice, so the whole grid turns over in that many frames
+constexpr u32 LIGHT_GRID_SLICE_FRAMES = 4;
+// r = min density, g = max density of each cell. Same rg storage restriction as CLOUD_DEPTH_FORMAT
+constexpr VkFormat OCCUPANCY_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+constexpr u32 OCCUPANCY_CELL_TEXELS = 4; // light grid texels per finest occupancy cell, per side
+constexpr u32 OCCUPANCY_SIZE = LIGHT_GRID_SIZE / OCCUPANCY_CELL_TEXELS;
+constexpr u32 OCCUPANCY_LEVELS = 4; // 16^3 down to 2^3, matches common.glsl
+constexpr u32 OCCUPANCY_GROUP_SIZE = 4; // matches local_size in occupancy.comp + occupancy_mip.comp
+// heightfield: r = height, gb = height gradient (d/dx, d/dz), a = the fbm value the ground is colored by
+constexpr VkFormat TERRAIN_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+constexpr u32 TERRAIN_SIZE = 1024; // heightfield texels per side, over the square in common.glsl
+constexpr u32 TERRAIN_MINMAX_LEVELS = 8; // 1024^2 down to 8^2, matches common.glsl
+constexpr u32 TERRAIN_HORIZON_SIZE = 256;
+constexpr u32 TERRAIN_HORIZON_LAYERS = 2; // 4 horizon directions per rgba layer, 8 in total
+constexpr u32 TERRAIN_GROUP_SIZE = 8; // matches local_size in the terrain_*.comp shaders
+constexpr VkFormat SDF_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+constexpr u32 SDF_BRICK_SIZE = 8; // voxels per brick side, matches common.glsl
+constexpr u32 SDF_GROUP_SIZE = 4; // matches local_size in sdf_bricks.comp + sdf_bake.comp
+
+// the frame is built in three passes (plus the light + occupancy grid updates between scene and clouds, see LightGrid):
+//  scene: raymarches the sdf scene into scene_color + scene_depth, full res
+//  clouds: compute, marches the cloud volume at 1/cloud_downsample res, up to the scene depth.
+//          Only one texel of every 4x4 block is marched per frame, the rest are reprojected from the previous frame's output
+//  composite: depth aware upsample of the clouds over the scene, straight into the swapchain image (followed by imgui)
+// The images depend on the swapchain extent and get recreated with it
+struct FramePasses
+{
+    u32 cloud_downsample = 2;
+    VkExtent2D extent = {};
+    VkExtent2D cloud_extent = {};
+    VkRenderPass scene_render_pass = VK_NULL_HANDLE;
+    VkFramebuffer scene_framebuffer = VK_NULL_HANDLE;
+    RenderImage scene_color = {};
+    RenderImage scene_depth = {};
+    // cloud output, one per frame slot. Each frame writes its own slot's and reads the previous slot's as history
+    RenderImage cloud_color[MAX_FRAMES_IN_FLIGHT] = {}; // rgb scattered light, a transmittance
+    RenderImage cloud_depth[MAX_FRAMES_IN_FLIGHT] = {}; // the scene depth each texel marched against + where its clouds are
+    u32 history_frames = 0; // frames written since the images were created. The history is garbage until this is > 0
+    glm::vec4 history_camera_offset = {}; // CloudData::cameraOffset the newest history was rendered with
+    VkSampler sampler = VK_NULL_HANDLE; // everything's read with texelFetch, so nearest
+    // cone prepass: per CONE_TILE_SIZE^2 tile, how far every ray in the tile can safely skip. Written before the scene pass
+    // in the same frame, so one is enough. GENERAL layout
+    VkExtent2D cone_extent = {};
+    RenderImage cone_depth = {};
+    VkDescriptorSetLayout cone_set_layout = VK_NULL_HANDLE; // scene_cone.comp: the tile depths as storage
+    VkDescriptorSetLayout scene_set_layout = VK_NULL_HANDLE; // main.frag: the tile depths, sampled
+    VkDescriptorSet cone_set = VK_NULL_HANDLE;
+    VkDescriptorSet scene_set = VK_NULL_HANDLE;
+    VkPipelineLayout cone_layout = VK_NULL_HANDLE;
+    // set 1 of the cloud and composite passes. Set 0 is the ubo set every pass shares
+    VkDescriptorSetLayout clouds_set_layout = VK_NULL_HANDLE;
+    VkDescriptorSetLayout composite_set_layout = VK_NULL_HANDLE;
+    VkDescriptorSet clouds_sets[MAX_FRAMES_IN_FLIGHT] = {};
+    VkDescriptorSet composite_sets[MAX_FRAMES_IN_FLIGHT] = {};
+    VkPipelineLayout clouds_layout = VK_NULL_HANDLE;
+    VkPipelineLayout composite_layout = VK_NULL_HANDLE;
+    VkPipeline composite_pipeline = VK_NULL_HANDLE; // doesn't depend on quality, so it isn't part of the variants
+};
+
+// the baked noise volumes (see noise_bake.h), bound in set 0 next to the ubo
+struct NoiseTextures
+{
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    RenderImage shape = {};
+    RenderImage detail = {};
+    VkSampler sampler = VK_NULL_HANDLE; // trilinear, repeat. The volumes tile
+};
+
+// low res grid of sun transmittance over the cloud volume, written by light_grid.comp and sampled by cloud_march()
+// in place of a light march per cloud sample. Also holds the density at each texel, which the occupancy grid is built from.
+// Lives in GENERAL layout for its whole life (bound as storage and sampled)
+struct LightGrid
+{
+    RenderImage volume = {};
+    VkSampler sampler = VK_NULL_HANDLE; // trilinear, white border: outside the grid is fully lit
+    VkDescriptorSetLayout set_layout = VK_NULL_HANDLE; // set 1 of light_grid.comp, the volume as a storage image
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    // what the whole grid was last built from. Changing any of these rebuilds it in one frame
+    bool valid = false;
+    glm::vec4 sun_dir = {};
+    glm::vec4 density_params = {};
+    ShaderQuality quality = {};
+    f32 lod_bias = 0.0f;
+    f32 time = 0.0f; // time the newest slices were computed at
+    u32 next_slice = 0;
+    // this frame's update, see light_grid_begin_frame. slice_stride 0 = nothing to update
+    u32 first_slice = 0;
+    u32 slice_stride = 0;
+};
+
+// min/max cloud density per cell over the light grid box, with a mip pyramid. cloud_march() uses it to jump over empty cells.
+// Rebuilt whenever the light grid changes: occupancy.comp reduces the light grid's densities into level 0,
+// occupancy_mip.comp each level into the next. GENERAL layout throughout, like the light grid
+struct OccupancyGrid
+{
+    RenderImage volume = {}; // view covers every level, for sampling
+    VkImageView level_views[OCCUPANCY_LEVELS] = {}; // storage views, one level each
+    VkSampler sampler = VK_NULL_HANDLE; // only ever texelFetch'd
+    VkDescriptorSetLayout set_layout = VK_NULL_HANDLE; // source + destination storage image
+    VkDescriptorSet sets[OCCUPANCY_LEVELS] = {}; // level 0 reads the light grid, level i reads level i - 1
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    // don't depend on quality, so they're built once like the composite pipeline
+    VkPipeline build_pipeline = VK_NULL_HANDLE;
+    VkPipeline mip_pipeline = VK_NULL_HANDLE;
+};
+
+// the ground, baked: scene() used to run fbm() for every evaluation of the ground plane. Baked once by three compute passes,
+// recorded into the first frame (and again after its shaders are hot reloaded):
+//  terrain_bake.comp: heightfield + gradients
+//  terrain_minmax.comp: min/max height pyramid the scene pass traces the heightfield through
+//  terrain_horizon.comp: horizon elevation in 8 directions for every texel, for shadows from any sun direction
+// All GENERAL layout, like the light grid
+struct TerrainMap
+{
+    RenderImage heightfield = {};
+    RenderImage minmax = {}; // view covers every level, for sampling
+    VkImageView minmax_level_views[TERRAIN_MINMAX_LEVELS] = {}; // storage views, one level each
+    RenderImage horizon = {}; // 2d array
+    VkSampler sampler = VK_NULL_HANDLE; // bilinear, clamp
+    VkDescriptorSetLayout set_layout = VK_NULL_HANDLE; // source + destination storage image, for every bake pass
+    VkDescriptorSet bake_set = VK_NULL_HANDLE;
+    VkDescriptorSet minmax_sets[TERRAIN_MINMAX_LEVELS] = {}; // level 0 reads the heightfield, level i reads level i - 1
+    VkDescriptorSet horizon_set = VK_NULL_HANDLE;
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    // baked at full detail whatever the quality, so built once like the composite pipeline
+    VkPipeline bake_pipeline = VK_NULL_HANDLE;
+    VkPipeline minmax_pipeline = VK_NULL_HANDLE;
+    VkPipeline horizon_pipeline = VK_NULL_HANDLE;
+    bool bake_pending = true; // the next recorded frame bakes before its scene pass
+};
+
+// static sdf geometry (the ground, everything else in the scene moves) baked into a distance volume over the middle of the scene,
+// which raymarch() and softShadows() sample instead of evaluating it. Narrow band: only bricks the surface passes near get
+// exact distances (sdf_bake.comp), sdf_bricks.comp marks the rest as all above/below the band first, and sampling takes
+// the band's width from those without touching the volume. Baked from the terrain maps, so it's rebaked along with them
+struct SdfVolume
+{
+    VkExtent3D extent = {}; // voxels
+    RenderImage volume = {}; // r = signed distance, clamped to +-band
+    RenderImage bricks = {}; // a texel per brick. r = signed distance lower bound, g = 1 if the brick is in the band
+    VkSampler sampler = VK_NULL_HANDLE; // trilinear, clamp
+    VkDescriptorSetLayout set_layout = VK_NULL_HANDLE; // bricks + volume storage images, shared by both passes
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    VkPipeline bricks_pipeline = VK_NULL_HANDLE;
+    VkPipeline bake_pipeline = VK_NULL_HANDLE;
+};
+
 struct RuntimeData
 {
+    LaunchOptions options = {};
     CloudData cloud = {};
     VkInstance instance = {};
     VkDebugUtilsMessengerEXT debug_messenger = {};
@@ -111,6 +408,7 @@ struct RuntimeData
     VkDevice logical_device = {};
     VkQueue graphics_queue = {};
     VkQueue present_queue = {};
+    VkQueue transfer_queue = {};
     QueueFamilyIndices indices = {};
     VkSurfaceKHR surface = {};
     SwapchainInfo swapchain_info = {};
@@ -118,29 +416,60 @@ struct RuntimeData
     VkRenderPass render_pass = {};
     VkDescriptorSetLayout descriptor_set_layout = {};
     VkDescriptorPool descriptor_pool = {};
-    BufferView<VkDescriptorSet> descriptor_sets = {};
-    VkPipelineLayout pipline_layout = {};
-    VkPipeline graphics_pipeline = {};
+    VkDescriptorSet descriptor_set = {}; // ubo is a dynamic uniform buffer, so one set covers every draw in every frame
+    VkPipelineLayout pipline_layout = {}; // scene pass. The ubo set + FramePasses::scene_set_layout
+    FramePasses passes = {};
+    PipelineCache pipeline_cache = {};
+    ShaderCompiler* shader_compiler = nullptr;
+    ShaderHotReload* shader_hot_reload = nullptr;
+    std::vector<RetiredPipeline> retired_pipelines = {};
+    PipelineVariant active_variant = {}; // the variant for the current quality, owned by pipeline_variants
+    QualityPreset quality = QUALITY_HIGH;
+    u32 cloud_downsample = 2; // requested through imgui, the pass targets get rebuilt to match at the start of the next frame
+    bool procedural_noise = false;
+    bool relaxed_tracing = true;
+    bool cone_prepass = true;
+    f32 lod_bias = 0.0f; // fbm octave LOD bias, positive drops detail closer to the camera
+    NoiseTextures noise = {};
+    LightGrid light_grid = {};
+    OccupancyGrid occupancy = {};
+    TerrainMap terrain = {};
+    SdfVolume sdf = {};
+    std::vector<PipelineVariant> pipeline_variants = {};
+    std::vector<u32> main_spirv[MAIN_SHADER_COUNT] = {}; // kept around so new variants don't need a recompile
     BufferView<VkFramebuffer> swapchain_framebuffers = {};
     VkCommandPool command_pool = {};
     BufferView<VkCommandBuffer> command_buffers = {};
     BufferView<VkSemaphore> img_available_semaphores = {};
     BufferView<VkSemaphore> render_finished_semaphores = {};
     BufferView<VkFence> inflight_fences = {};
+    GpuAllocator gpu_allocator = {};
+    UploadManager uploads = {};
     VkBuffer vertex_buffer = {};
-    VkDeviceMemory vertex_buffer_mem = {};
+    GpuAllocation vertex_buffer_mem = {};
     VkBuffer index_buffer = {};
-    VkDeviceMemory index_buffer_mem = {};
-    BufferView<VkBuffer> uniform_buffers = {};
-    BufferView<VkDeviceMemory> uniform_buffers_mem = {};
-    BufferView<void*> uniform_buffers_mapped = {};
+    GpuAllocation index_buffer_mem = {};
+    UniformRing uniform_ring = {};
+    // cpu side of the per frame memory: scratch for anything that only has to live until this frame's commands are done.
+    // A slot's arena is cleared along with its uniform ring region, right after its fence wait (frame_slot_begin)
+    Arena frame_arenas[MAX_FRAMES_IN_FLIGHT] = {};
+    // headless readback. One persistently mapped buffer per frame in flight, filled at the end of that frame's command buffer
+    BufferView<VkBuffer> readback_buffers = {};
+    BufferView<GpuAllocation> readback_buffers_mem = {};
+    BufferView<void*> readback_buffers_mapped = {};
+    BufferView<u64> readback_frame_indices = {}; // which frame is sitting in each readback buffer. UINT64_MAX if none
+    FrameWriter* frame_writer = nullptr;
+    GpuProfiler gpu_profiler = {};
+    StepStats step_stats = {};
+    BenchResults* bench_results = nullptr; // receives gpu timings when running --bench
     VkDescriptorPool imgui_pool = {};
     Arena arena = {};
     Arena swapchain_arena = {};
     u32 current_frame = 0;
+    u64 frame_index = 0; // total frames submitted
     bool framebufferWasResized = false;
 };
 
-RuntimeData initVulkan();
+RuntimeData initVulkan(const LaunchOptions& options);
 void vulkanMainLoop(RuntimeData& runtime);
 void vulkanCleanup(RuntimeData& runtime);